@@ -1,11 +1,21 @@
 
 #include <stdlib.h>
+#include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include <cli_debug.h>
 #include "list.h"
+#include "list_stack.h"
 #include "cli.h"
+#include "cli_index.h"
+#include "cli_table.h"
+#include "cli_rcu.h"
 
 #if defined(CLI_NS)
 using namespace CLI_NS;
@@ -17,6 +27,217 @@ static pList* next_fn(pList item)
     return (pList*) & cmd->next;
 }
 
+    /*
+     *  Raw output : use the write() / writev() slots if the backend has them
+     */
+
+static int out_fprintf(CliOutput *out, const char *fmt, ...) __attribute__((format(printf,2,3)));
+
+static int out_fprintf(CliOutput *out, const char *fmt, ...)
+{
+    ASSERT(out);
+    ASSERT(out->fprintf);
+
+    va_list va;
+    va_start(va, fmt);
+    const int n = out->fprintf(out->ctx, fmt, va);
+    va_end(va);
+    return n;
+}
+
+static void out_write(CliOutput *out, const void *data, size_t len)
+{
+    ASSERT(out);
+
+    if (out->write)
+    {
+        out->write(out->ctx, data, len);
+        return;
+    }
+
+    if (out->writev)
+    {
+        struct iovec iov = { (void*) data, len };
+        out->writev(out->ctx, & iov, 1);
+        return;
+    }
+
+    out_fprintf(out, "%.*s", (int) len, (const char*) data);
+}
+
+static void output_write(CLI *cli, const void *data, size_t len)
+{
+    ASSERT(cli);
+    out_write(cli->output, data, len);
+}
+
+static void output_writev(CLI *cli, const struct iovec *iov, int count)
+{
+    ASSERT(cli);
+    ASSERT(cli->output);
+    CliOutput *out = cli->output;
+
+    if (out->writev)
+    {
+        out->writev(out->ctx, iov, count);
+        return;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        output_write(cli, iov[i].iov_base, iov[i].iov_len);
+    }
+}
+
+    /**
+     * @brief send any buffered output to CLI.output
+     */
+
+void cli_flush(CLI *cli)
+{
+    ASSERT(cli);
+
+    if (!cli->out_used)
+    {
+        return;
+    }
+
+    output_write(cli, cli->out_buff, cli->out_used);
+    cli->out_used = 0;
+}
+
+    /*
+     *  Copy to the staging buffer, if there is one
+     */
+
+static bool stage(CLI *cli, const void *data, size_t len)
+{
+    if (!cli->out_buff)
+    {
+        return false;
+    }
+
+    if (len > (cli->out_size - cli->out_used))
+    {
+        // doesn't fit : make room
+        cli_flush(cli);
+    }
+
+    if (len > cli->out_size)
+    {
+        // too big for the buffer, send it straight out
+        output_write(cli, data, len);
+        return true;
+    }
+
+    memcpy(& cli->out_buff[cli->out_used], data, len);
+    cli->out_used += len;
+
+    if (cli->out_used >= cli->out_high)
+    {
+        cli_flush(cli);
+    }
+
+    return true;
+}
+
+    /**
+     * @brief write \a len chars of unformatted output
+     */
+
+void cli_write(CLI *cli, const void *data, size_t len)
+{
+    ASSERT(cli);
+
+    if (!stage(cli, data, len))
+    {
+        output_write(cli, data, len);
+    }
+}
+
+    /**
+     * @brief write the string \a s without any formatting
+     */
+
+void cli_puts(CLI *cli, const char *s)
+{
+    cli_write(cli, s, strlen(s));
+}
+
+    /*
+     *  Write the '\0' terminated list of strings as one vectored write
+     */
+
+static void cli_putv(CLI *cli, const char *s, ...)
+{
+    ASSERT(cli);
+
+    struct iovec iov[8];
+    int count = 0;
+
+    va_list va;
+    va_start(va, s);
+    for (; s; s = va_arg(va, const char*))
+    {
+        ASSERT(count < 8);
+        iov[count].iov_base = (void*) s;
+        iov[count].iov_len = strlen(s);
+        count += 1;
+    }
+    va_end(va);
+
+    if (!cli->out_buff)
+    {
+        output_writev(cli, iov, count);
+        return;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        stage(cli, iov[i].iov_base, iov[i].iov_len);
+    }
+}
+
+static void cli_backspaces(CLI *cli, size_t n)
+{
+    static const char bs[] = "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b";
+
+    while (n)
+    {
+        const size_t len = (n < (sizeof(bs) - 1)) ? n : (sizeof(bs) - 1);
+        cli_write(cli, bs, len);
+        n -= len;
+    }
+}
+
+    /**
+     * @brief stage output in a buffer of \a size chars
+     *
+     * Output is then written once per input chunk, once per command,
+     * or whenever more than \a high_water chars are waiting.
+     * A \a size of 0 turns buffering off.
+     *
+     * Call after cli_init(). The buffer is freed by cli_close().
+     */
+
+void cli_set_output_buffer(CLI *cli, size_t size, size_t high_water)
+{
+    ASSERT(cli);
+
+    cli_flush(cli);
+    free(cli->out_buff);
+    cli->out_buff = 0;
+    cli->out_size = 0;
+    cli->out_high = 0;
+
+    if (size)
+    {
+        cli->out_buff = (char*) malloc(size+1);
+        cli->out_size = size;
+        cli->out_high = ((high_water > 0) && (high_water < size)) ? high_water : size;
+    }
+}
+
     /**
      * @brief printf style output 
      */
@@ -29,8 +250,48 @@ void cli_print(CLI *cli, const char *fmt, ...)
 
     va_list va;
     va_start(va, fmt);
-    cli->output->fprintf(cli->output->ctx, fmt, va);
+
+    if (!cli->out_buff)
+    {
+        cli->output->fprintf(cli->output->ctx, fmt, va);
+        va_end(va);
+        return;
+    }
+
+    va_list again;
+    va_copy(again, va);
+
+    size_t room = cli->out_size - cli->out_used;
+    const int n = vsnprintf(& cli->out_buff[cli->out_used], room+1, fmt, va);
+
+    if ((n >= 0) && (((size_t) n) > room))
+    {
+        // doesn't fit : make room
+        cli_flush(cli);
+
+        if (((size_t) n) > cli->out_size)
+        {
+            // too big for the buffer, send it straight out
+            cli->output->fprintf(cli->output->ctx, fmt, again);
+        }
+        else
+        {
+            vsnprintf(cli->out_buff, cli->out_size+1, fmt, again);
+            cli->out_used = (size_t) n;
+        }
+    }
+    else if (n > 0)
+    {
+        cli->out_used += (size_t) n;
+    }
+
+    va_end(again);
     va_end(va);
+
+    if (cli->out_used >= cli->out_high)
+    {
+        cli_flush(cli);
+    }
 }
 
     /**
@@ -42,8 +303,10 @@ void cli_clear(CLI *cli)
     cli->end = 0;
     cli->cursor = 0;
     cli->escape = false;
+    cli->discard = false;
     cli->buff[0] = '\0';
     cli->nest = 0;
+    cli->argc = 0;
     for (int i = 0; i < CLI_MAX_ARGS; i++)
     {
         cli->args[i] = 0;
@@ -56,6 +319,8 @@ void cli_clear(CLI *cli)
      * allocates a text buffer \a size chars long
      *
      * sets the context CLI.ctx to \a ctx
+     *
+     * writes the first prompt
      */
 
 void cli_init(CLI *cli, size_t size, void *ctx)
@@ -65,27 +330,103 @@ void cli_init(CLI *cli, size_t size, void *ctx)
     cli->buff[0] = '\0';
     cli->size = size;
     cli->head = 0;
+    cli->tail = 0;
+    cli->tail_head = 0;
+    cli->tail_gen = 0;
     cli->ctx = ctx;
     cli->echo = true;
+    cli->ansi = false;
+    cli->index = 0;
+    cli->table = 0;
+    cli->executor = 0;
+    cli->tasks = 0;
+    cli->deferred = false;
+    cli->task = false;
+    cli->status = 0;
+    cli->compound = false;
+    cli->marker = 0;
+    cli->discard = false;
+    cli->held = 0;
+    cli->executing = false;
+    cli->held_buff = 0;
+    cli->held_used = 0;
+    cli->held_size = 0;
+    cli->screen = (char*) malloc(size+1);
+    cli->screen_end = 0;
+    cli->screen_cursor = 0;
+    cli->out_buff = 0;
+    cli->out_size = 0;
+    cli->out_used = 0;
+    cli->out_high = 0;
+    cli->argv = 0;
+    cli->argv_owned = false;
+    cli_set_arg_storage(cli, 0, 0);
 
     cli_clear(cli);
 
     // Start with the initial prompt
-    cli_print(cli, "%s", cli->prompt);
+    cli_puts(cli, cli->prompt);
+}
+
+    /**
+     * @brief index the command names, for O(1) lookup
+     *
+     * The index starts with \a slots entries and grows as needed.
+     * A \a slots of 0 removes the index.
+     */
+
+void cli_set_index(CLI *cli, size_t slots)
+{
+    Lock lock(cli->mutex);
+
+    index_delete(cli->index);
+    cli->index = slots ? index_create(slots) : 0;
+}
+
+    /**
+     * @brief use a constant table of commands
+     *
+     * Commands registered at runtime are searched before the table.
+     */
+
+void cli_set_table(CLI *cli, const CliTable *table)
+{
+    cli->table = table;
+}
+
+static void cli_indexed(CLI *cli, CliCommand **head, CliCommand *cmd, bool replace)
+{
+    Lock lock(cli->mutex);
+    index_add(cli->index, head, cmd, replace);
 }
 
 void cli_insert(CLI *cli, CliCommand **head, CliCommand *cmd)
 {
     ASSERT(head);
-    list_push((pList*) head, (pList) cmd, next_fn, cli->mutex);
+    list_push((pList*) head, (pList) cmd, next_fn, rcu_writer());
+    cli_indexed(cli, head, cmd, true);
 }
 
+// bumped by cli_remove(), under the writer lock : the tail hints may be stale
+static unsigned long removals = 0;
+
 void cli_append(CLI *cli, CliCommand *cmd)
 {
-    CliCommand **head = & cli->head;
-    for ( ; *head; head = &((*head)->next))
-        ;
-    cli_insert(cli, head, cmd);
+    ASSERT(cmd);
+
+    {
+        Lock lock(rcu_writer());
+        // start from the last command appended, unless it may have gone,
+        // or cli->head has been set to another list
+        const bool valid = cli->head && (cli->head == cli->tail_head) && (cli->tail_gen == removals);
+        CliCommand *from = valid ? cli->tail : 0;
+        list_append_from((pList*) & cli->head, (pList) from, (pList) cmd, next_fn, 0);
+        cli->tail = cmd;
+        cli->tail_head = cli->head;
+        cli->tail_gen = removals;
+    }
+
+    cli_indexed(cli, & cli->head, cmd, false);
 } 
 
     /**
@@ -104,82 +445,91 @@ void cli_register(CLI *cli, CliCommand *cmd)
      *
      */
 
-static int match_cmd(pList w, void *arg)
+static CliCommand* find_registered(CLI *cli, CliCommand **head, const char* name)
 {
-    CliCommand *cmd = (CliCommand *) w;
-    const char* match = (const char*) arg;
-
-    return strcmp(cmd->cmd, match) == 0;
-}
+    if (cli->index)
+    {
+        Lock lock(cli->mutex);
+        return index_find(cli->index, head, name);
+    }
 
-static CliCommand* _find_command(CLI *cli, CliCommand **head, const char* name)
-{
     // Look up the command
-    CliCommand *exec = (CliCommand*) list_find((pList*) head, next_fn, match_cmd, (void*) name, cli->mutex);
-    return exec;
+    return list_find_if(head, [name](CliCommand *cmd) { return strcmp(cmd->cmd, name) == 0; });
 }
 
-static CliCommand* find_command(CLI *cli, const char* name)
+    /*
+     *  Is the constant command \a cmd hidden by one registered at runtime?
+     */
+
+static bool shadowed(CLI *cli, CliCommand **head, const CliCommand *cmd)
 {
-    return _find_command(cli, & cli->head, name);
+    return *head && find_registered(cli, head, cmd->cmd);
 }
 
-static CliCommand* find_subcommand(CLI *cli, CliCommand *cmd, const char* name)
+static CliCommand* _find_command(CLI *cli, CliCommand **head, const CliTable *table, const char* name)
 {
-    return _find_command(cli, & cmd->subcommand, name);
+    CliCommand *exec = find_registered(cli, head, name);
+
+    if (!exec)
+    {
+        // handlers are passed a non-const command, but must not change it
+        exec = const_cast<CliCommand*>(table_find(table, name));
+    }
+
+    return exec;
 }
 
-static void not_found(CLI *cli, const char *cmd)
+static CliCommand* find_command(CLI *cli, const char* name)
 {
-    cli_print(cli, "'%s' not found%s", cmd, cli->eol);
+    return _find_command(cli, & cli->head, cli->table, name);
 }
 
     /*
-     *
+     *  The subcommands of \a cmd share a slot : a list, or a table if
+     *  CLI_SUBTABLE is set
      */
 
-static bool execute(CLI *cli, CliCommand* cmd)
+static CliCommand *no_subcommands = 0;
+
+static CliCommand **sub_head(CliCommand *cmd)
 {
-    if (cmd->handler)
-    {
-        cmd->handler(cli, cmd);
-    }
-    return true;
+    return (cmd->flags & CLI_SUBTABLE) ? & no_subcommands : & cmd->subcommand;
 }
 
-const char* cli_get_arg(CLI *cli, int offset)
+static const CliTable *sub_table(const CliCommand *cmd)
 {
-    if ((offset < 0) || ((cli->nest + offset) >= CLI_MAX_ARGS))
-    {
-        return 0;
-    }
-    return cli->args[cli->nest + offset];
+    return (cmd->flags & CLI_SUBTABLE) ? cmd->subtable : 0;
 }
 
-static bool run_command(CLI *cli, CliCommand* cmd)
+static CliCommand* find_subcommand(CLI *cli, CliCommand *cmd, const char* name)
 {
-    while (true)
-    {
-        if (!cmd->subcommand)
-        {
-            // Execute the command
-            return execute(cli, cmd);
-        }
+    return _find_command(cli, sub_head(cmd), sub_table(cmd), name);
+}
 
+    /*
+     *  Follow the args down the subcommands of \a cmd : returns the command
+     *  to run, with cli->nest past its name. Call in a read section.
+     */
+
+static CliCommand *resolve(CLI *cli, CliCommand* cmd)
+{
+    // a list or a table
+    while (cmd->subcommand)
+    {
         const char *s = cli_get_arg(cli, 0);
-     
+
         if (!s)
         {
             // no args found
-            return execute(cli, cmd);
+            break;
         }
-     
+
         // search subcommands looking or a match
         CliCommand *sub = find_subcommand(cli, cmd, s);
         if (!sub)
         {
             // no matching subcommand found
-            return execute(cli, cmd);
+            break;
         }
 
         // if we have positively found a subcommand, increment the nest
@@ -187,80 +537,1180 @@ static bool run_command(CLI *cli, CliCommand* cmd)
         // test the matching subcommand
         cmd = sub;
     }
+    return cmd;
 }
 
-static void cli_execute(CLI *cli)
-{
-    // Extract the words in the buffer
+    /*
+     *  Run \a cmd, found in the read section the caller is in, and end the
+     *  section. Only the lookup is in the read section : the command is
+     *  pinned while it runs, so a handler can wait on a thread that removes
+     *  other commands.
+     */
 
-    cli->nest = 0;
-    char *save = 0;
-    char *s = cli->buff;
-    for (int i = 0; i < CLI_MAX_ARGS; i++)
+static void run_pinned(CLI *cli, CliCommand *cmd, void (*run)(CLI *cli, CliCommand *cmd))
+{
+    const bool pinned = rcu_pin(cmd);
+    if (pinned)
     {
-        const char* cmd = strtok_r(s, " ", & save);
-        cli->args[i] = cmd;
-        if (!cmd)
-        {
-            break;
-        }
-        s = 0;
+        rcu_read_unlock();
     }
 
-    const char *cmd = cli->args[cli->nest++];
+    run(cli, cmd);
 
-    if (!cmd)
+    if (pinned)
     {
-        //  Empty line. Reply with a prompt
-        cli_print(cli, "%s", cli->prompt);
-        return;
+        rcu_unpin();
     }
-
-    // Look up the command
-    CliCommand *exec = find_command(cli, cmd);
-
-    if (!exec)
+    else
     {
-        // Command not found
-        not_found(cli, cmd);
-        return;
+        // out of pins : it runs in the read section
+        rcu_read_unlock();
     }
+}
 
-    run_command(cli, exec);
+static void not_found(CLI *cli, const char *cmd)
+{
+    cli->status = 1;
+    cli_putv(cli, "'", cmd, "' not found", cli->eol, (const char*) 0);
 }
 
     /*
-     *
+     *  Deferred commands : the line is copied into a CliTask, and the
+     *  handler runs on the executor with a CLI of its own. Its output
+     *  is collected, then written to the owning CLI by cli_poll(), in
+     *  the order the lines were entered.
      */
 
-static void _help(CLI *cli, CliCommand *cmd)
+typedef struct CliTask
+{
+    struct CliTask *next;
+    unsigned long seq;
+    CLI *owner;
+    CliCommand *cmd;
+    unsigned long removals; // when cmd was looked up
+    CLI cli;
+    CliOutput out;
+    char *text;
+    size_t used;
+    size_t size;
+}   CliTask;
+
+typedef struct CliTasks
 {
-    cli_print(cli, "%s : %s%s", cmd->cmd, cmd->help ? cmd->help : "", cli->eol);
+    ListStack done;         // finished, pushed by the workers
+    CliTask *waiting;       // finished, in seq order
+    unsigned long submitted;
+    unsigned long delivered;
+    int running;            // submitted, and not yet pushed to done
+    CliTask *capture;       // output of a line run inline, see capture_start()
+    CliOutput *output;      // the CLI's own output, while capturing
+    unsigned long removals; // before the last command was looked up
+}   CliTasks;
+
+static pList* task_next(pList item)
+{
+    CliTask *task = (CliTask*) item;
+    return (pList*) & task->next;
 }
 
-static int visit_help(pList w, void *arg)
+static int task_cmp(const pList w1, const pList w2)
 {
-    // Callback function : called for each command in the list
-    CliCommand *cmd = (CliCommand *) w;
-    CLI *cli = (CLI*) arg;
-
-    _help(cli, cmd);
-    return 0;
+    const CliTask *a = (const CliTask*) w1;
+    const CliTask *b = (const CliTask*) w2;
+    return (a->seq < b->seq) ? 1 : -1;
 }
 
-static void _cli_help(CLI *cli, CliCommand* cmd, CliCommand **head, int offset)
+static char *task_reserve(CliTask *task, size_t len)
 {
-    const char *s = cli_get_arg(cli, offset);
-
-    if (s)
+    if ((task->used + len) > task->size)
     {
-        CliCommand *peer = _find_command(cli, head, s);
-        // if there is a matching subcommand, nest
-        if (peer)
+        size_t size = task->size ? task->size : 64;
+        while (size < (task->used + len))
         {
-            return _cli_help(cli, peer, & peer->subcommand, offset+1);
+            size *= 2;
         }
-
+        task->text = (char*) realloc(task->text, size);
+        ASSERT(task->text);
+        task->size = size;
+    }
+    return & task->text[task->used];
+}
+
+static int task_write(void *ctx, const void *data, size_t len)
+{
+    CliTask *task = (CliTask*) ctx;
+    memcpy(task_reserve(task, len), data, len);
+    task->used += len;
+    return (int) len;
+}
+
+static int task_fprintf(void *ctx, const char *fmt, va_list va)
+{
+    CliTask *task = (CliTask*) ctx;
+
+    va_list again;
+    va_copy(again, va);
+    const int n = vsnprintf(0, 0, fmt, va);
+    if (n > 0)
+    {
+        vsnprintf(task_reserve(task, (size_t) n + 1), (size_t) n + 1, fmt, again);
+        task->used += (size_t) n;
+    }
+    va_end(again);
+    return n;
+}
+
+    /*
+     *  The end of a command's output : the prompt, or the marker and the
+     *  status in machine mode
+     */
+
+static void cli_done(CLI *cli)
+{
+    if (!cli->marker)
+    {
+        cli_puts(cli, cli->prompt);
+        return;
+    }
+
+    char status[16];
+    snprintf(status, sizeof(status), " %d", cli->status);
+    cli_putv(cli, cli->marker, status, cli->eol, (const char*) 0);
+}
+
+    /*
+     *  The command of a task was looked up on the input thread, so may have
+     *  been removed since : if so, look it up again. Call in a read section.
+     */
+
+static bool task_found(CliTask *task)
+{
+    if (__atomic_load_n(& removals, __ATOMIC_ACQUIRE) == task->removals)
+    {
+        return true;
+    }
+
+    CLI *cli = & task->cli;
+    const int nest = cli->nest;
+    cli->nest = 0;
+    const char *name = cli_get_arg(cli, 0);
+    cli->nest = 1;
+    CliCommand *cmd = find_command(cli, name);
+    const bool same = cmd && (resolve(cli, cmd) == task->cmd) && (cli->nest == nest);
+    cli->nest = nest;
+    if (!same)
+    {
+        not_found(cli, name);
+    }
+    return same;
+}
+
+static void task_run(void *arg)
+{
+    CliTask *task = (CliTask*) arg;
+    CLI *cli = & task->cli;
+
+    rcu_read_lock();
+    if (task_found(task))
+    {
+        run_pinned(cli, task->cmd, task->cmd->handler);
+    }
+    else
+    {
+        rcu_read_unlock();
+    }
+    // the prompt held back in process()
+    cli_done(cli);
+
+    CLI *owner = task->owner;
+    CliTasks *tasks = owner->tasks;
+    CliExecutor *executor = owner->executor;
+
+    // the task belongs to the owner from here
+    list_stack_push(& tasks->done, (pList) task, task_next);
+    if (executor->ready)
+    {
+        executor->ready(executor->ctx, owner);
+    }
+    __atomic_sub_fetch(& tasks->running, 1, __ATOMIC_RELEASE);
+}
+
+static void defer(CLI *cli, CliCommand *cmd)
+{
+    const size_t args = sizeof(CliArg) * (size_t) cli->argc;
+    CliTask *task = (CliTask*) malloc(sizeof(CliTask) + args + cli->size + 1);
+    ASSERT(task);
+
+    // the args, then the split line, follow the task
+    CliArg *argv = (CliArg*) & task[1];
+    char *buff = (char*) & argv[cli->argc];
+    memcpy(argv, cli->argv, args);
+    memcpy(buff, cli->buff, cli->size + 1);
+
+    task->owner = cli;
+    task->cmd = cmd;
+    task->removals = cli->tasks->removals;
+    task->seq = cli->tasks->submitted++;
+    task->text = 0;
+    task->used = 0;
+    task->size = 0;
+
+    task->out.fprintf = task_fprintf;
+    task->out.ctx = task;
+    task->out.write = task_write;
+    task->out.writev = 0;
+
+    CLI *tc = & task->cli;
+    *tc = *cli;
+    tc->buff = buff;
+    tc->argv = argv;
+    tc->argv_size = cli->argc;
+    tc->argv_owned = false;
+    for (int i = 0; i < CLI_MAX_ARGS; i++)
+    {
+        tc->args[i] = cli->args[i] ? & buff[cli->args[i] - cli->buff] : 0;
+    }
+    tc->output = & task->out;
+    tc->screen = 0;
+    tc->out_buff = 0;
+    tc->out_size = 0;
+    tc->out_used = 0;
+    tc->executor = 0;
+    tc->tasks = 0;
+    // the index changes as it is read : the task walks the lists instead
+    tc->index = 0;
+    tc->deferred = false;
+    tc->task = true;
+    tc->status = 0;
+
+    cli->deferred = true;
+    __atomic_add_fetch(& cli->tasks->running, 1, __ATOMIC_RELAXED);
+    cli->executor->submit(cli->executor->ctx, task_run, task);
+}
+
+    /**
+     * @brief write the output of any finished deferred commands
+     *
+     * Call from the thread that feeds the CLI, eg. when woken by
+     * CliExecutor.ready. cli_process() and cli_process_buffer() call it too.
+     */
+
+void cli_poll(CLI *cli)
+{
+    ASSERT(cli);
+
+    CliTasks *tasks = cli->tasks;
+    if (!tasks)
+    {
+        return;
+    }
+
+    CliTask *done = (CliTask*) list_stack_pop_all(& tasks->done);
+    while (done)
+    {
+        CliTask *next = done->next;
+        list_add_sorted((pList*) & tasks->waiting, (pList) done, task_next, task_cmp, 0);
+        done = next;
+    }
+
+    if (tasks->capture)
+    {
+        // staged output belongs to the capture
+        cli_flush(cli);
+    }
+
+    bool wrote = false;
+    while (tasks->waiting && (tasks->waiting->seq == tasks->delivered))
+    {
+        CliTask *task = tasks->waiting;
+        tasks->waiting = task->next;
+        if (!task->used)
+        {
+            // eg. a deferred line, captured
+        }
+        else if (tasks->capture)
+        {
+            // a held command is still writing to the capture
+            out_write(tasks->output, task->text, task->used);
+        }
+        else
+        {
+            cli_write(cli, task->text, task->used);
+        }
+        free(task->text);
+        free(task);
+        tasks->delivered += 1;
+        wrote = true;
+    }
+
+    if (wrote)
+    {
+        cli_flush(cli);
+    }
+}
+
+    /**
+     * @brief the number of lines passed to the executor whose output
+     * cli_poll() has yet to write
+     */
+
+int cli_pending(CLI *cli)
+{
+    ASSERT(cli);
+    CliTasks *tasks = cli->tasks;
+    return tasks ? (int) (tasks->submitted - tasks->delivered) : 0;
+}
+
+static void drain(CLI *cli)
+{
+    CliTasks *tasks = cli->tasks;
+    CliExecutor *executor = cli->executor;
+
+    while (true)
+    {
+        cli_poll(cli);
+
+        // a task may still be in its ready call after it was delivered
+        const bool running = __atomic_load_n(& tasks->running, __ATOMIC_ACQUIRE);
+        const bool delivered = tasks->delivered == tasks->submitted;
+        if (!running && delivered)
+        {
+            break;
+        }
+        // only help while handlers are still to finish
+        if (running && !delivered && executor->yield)
+        {
+            executor->yield(executor->ctx);
+        }
+    }
+}
+
+    /*
+     *  While deferred output is still to be delivered, the output of a line
+     *  run on this thread, error messages and the prompt included, is
+     *  collected in a task of its own, so it is delivered in order too.
+     *
+     *  Returns true if a capture was started : the caller ends it.
+     */
+
+static bool capture_start(CLI *cli)
+{
+    CliTasks *tasks = cli->tasks;
+    if (!tasks || tasks->capture || (tasks->submitted == tasks->delivered))
+    {
+        return false;
+    }
+
+    cli_flush(cli);
+
+    CliTask *task = (CliTask*) calloc(1, sizeof(CliTask));
+    ASSERT(task);
+    task->seq = tasks->submitted++;
+    task->owner = cli;
+    task->out.fprintf = task_fprintf;
+    task->out.ctx = task;
+    task->out.write = task_write;
+
+    tasks->capture = task;
+    tasks->output = cli->output;
+    cli->output = & task->out;
+    return true;
+}
+
+static void capture_end(CLI *cli)
+{
+    CliTasks *tasks = cli->tasks;
+    if (!tasks || !tasks->capture)
+    {
+        return;
+    }
+
+    cli_flush(cli);
+    cli->output = tasks->output;
+    list_stack_push(& tasks->done, (pList) tasks->capture, task_next);
+    tasks->capture = 0;
+    tasks->output = 0;
+    cli_poll(cli);
+}
+
+    /**
+     * @brief run command handlers with \a executor, or inline if it is null
+     *
+     * A completed line is split on the input thread, then the copied args
+     * and the command go to the executor, and the CLI is free for the next
+     * line. The output of deferred commands, and the prompt after them,
+     * is written by cli_poll() in the order the lines were entered. While
+     * any is waiting, the output of commands run inline, and error
+     * messages, waits its turn too.
+     *
+     * Handlers run with their own CLI, a copy of this one : commands that
+     * change the CLI, or use the line editor, should set CLI_INLINE.
+     */
+
+void cli_set_executor(CLI *cli, CliExecutor *executor)
+{
+    ASSERT(cli);
+
+    if (cli->tasks)
+    {
+        // not from a command run inline while output is waiting
+        ASSERT(!cli->tasks->capture);
+        drain(cli);
+    }
+
+    if (executor)
+    {
+        ASSERT(executor->submit);
+        if (!cli->tasks)
+        {
+            cli->tasks = (CliTasks*) calloc(1, sizeof(CliTasks));
+            ASSERT(cli->tasks);
+        }
+    }
+    else
+    {
+        free(cli->tasks);
+        cli->tasks = 0;
+    }
+
+    cli->executor = executor;
+}
+
+    /*
+     *
+     */
+
+static void execute(CLI *cli, CliCommand* cmd)
+{
+    if (cmd->handler)
+    {
+        // the rest of a compound line needs the output and status
+        if (cli->executor && !(cmd->flags & CLI_INLINE) && !cli->compound)
+        {
+            defer(cli, cmd);
+            return;
+        }
+        cmd->handler(cli, cmd);
+    }
+}
+
+    /**
+     * @brief return arg \a offset, counting from after the command, or 0
+     */
+
+const char* cli_get_arg(CLI *cli, int offset)
+{
+    if ((offset < 0) || ((cli->nest + offset) >= cli->argc))
+    {
+        return 0;
+    }
+    return & cli->buff[cli->argv[cli->nest + offset].offset];
+}
+
+    /**
+     * @brief return the length of arg \a offset, or 0 if there isn't one
+     */
+
+size_t cli_get_arg_len(CLI *cli, int offset)
+{
+    if ((offset < 0) || ((cli->nest + offset) >= cli->argc))
+    {
+        return 0;
+    }
+    return cli->argv[cli->nest + offset].len;
+}
+
+    /**
+     * @brief return the number of args after the command
+     */
+
+int cli_argc(CLI *cli)
+{
+    return (cli->argc > cli->nest) ? (cli->argc - cli->nest) : 0;
+}
+
+    /**
+     * @brief set the status of the command : 0 for success
+     *
+     * Called by handlers. In 'a && b', b is only run if a sets 0, the default.
+     */
+
+void cli_set_status(CLI *cli, int status)
+{
+    ASSERT(cli);
+    cli->status = status;
+}
+
+    /**
+     * @brief set the storage used for the args
+     *
+     * Uses the \a size entries at \a args : a line with more args than that
+     * is rejected. If \a args is null, the storage is allocated, and grows
+     * as needed.
+     */
+
+void cli_set_arg_storage(CLI *cli, CliArg *args, int size)
+{
+    if (cli->argv_owned)
+    {
+        free(cli->argv);
+    }
+
+    cli->argc = 0;
+
+    if (args)
+    {
+        ASSERT(size > 0);
+        cli->argv = args;
+        cli->argv_size = size;
+        cli->argv_owned = false;
+        return;
+    }
+
+    cli->argv_size = CLI_MAX_ARGS;
+    cli->argv = (CliArg*) malloc(sizeof(CliArg) * CLI_MAX_ARGS);
+    ASSERT(cli->argv);
+    cli->argv_owned = true;
+}
+
+    /*
+     *  Look up command \a name and run it.
+     */
+
+static void dispatch(CLI *cli, const char *name)
+{
+    rcu_read_lock();
+
+    if (cli->tasks)
+    {
+        // a deferred command checks for removals since
+        cli->tasks->removals = __atomic_load_n(& removals, __ATOMIC_ACQUIRE);
+    }
+
+    CliCommand *cmd = find_command(cli, name);
+    if (!cmd)
+    {
+        rcu_read_unlock();
+        not_found(cli, name);
+        return;
+    }
+
+    run_pinned(cli, resolve(cli, cmd), execute);
+}
+
+static bool arg_push(CLI *cli, size_t offset)
+{
+    if (cli->argc == cli->argv_size)
+    {
+        if (!cli->argv_owned)
+        {
+            return false;
+        }
+
+        cli->argv_size *= 2;
+        cli->argv = (CliArg*) realloc(cli->argv, sizeof(CliArg) * (size_t) cli->argv_size);
+        ASSERT(cli->argv);
+    }
+
+    CliArg *arg = & cli->argv[cli->argc++];
+    arg->offset = offset;
+    arg->len = 0;
+    arg->op = 0;
+    return true;
+}
+
+    /*
+     *  Operators between the commands on a line
+     */
+
+enum { OP_SEQ = 1, OP_AND, OP_PIPE };
+
+static int is_op(const char *s, size_t *len)
+{
+    *len = 1;
+    switch (*s)
+    {
+        case ';' : return OP_SEQ;
+        case '|' : return OP_PIPE;
+        case '&' :
+        {
+            if (s[1] != '&')
+            {
+                return 0;
+            }
+            *len = 2;
+            return OP_AND;
+        }
+        default : return 0;
+    }
+}
+
+    /*
+     *  Split the buffer into args, in a single pass.
+     *
+     *  Args are separated by spaces. Text in '' is taken as it is, in ""
+     *  a '\' escapes the next char, as it does outside quotes. The unquoted
+     *  text is written back into the buffer : it can only get shorter, so
+     *  there is always room to terminate each arg.
+     *
+     *  An unquoted ';', '&&' or '|' also ends an arg, and is put in an arg
+     *  of its own, with CliArg.op set. \a ops is set to the number of them.
+     *
+     *  Returns an error message, or 0 on success.
+     */
+
+static const char *cli_split(CLI *cli, int *ops)
+{
+    char *buff = cli->buff;
+    size_t r = 0;
+    size_t w = 0;
+    size_t len = 0;
+    int op = 0;
+
+    cli->argc = 0;
+    *ops = 0;
+
+    while (true)
+    {
+        // skip the spaces between args
+        for (; buff[r] == ' '; r++)
+            ;
+
+        if (!buff[r])
+        {
+            break;
+        }
+
+        if (!arg_push(cli, w))
+        {
+            return "too many args";
+        }
+
+        op = is_op(& buff[r], & len);
+        if (op)
+        {
+            cli->argv[cli->argc - 1].op = op;
+            *ops += 1;
+            r += len;
+            continue;
+        }
+
+        char quote = 0;
+        for (; buff[r]; r++)
+        {
+            char c = buff[r];
+
+            if (quote)
+            {
+                if (c == quote)
+                {
+                    quote = 0;
+                    continue;
+                }
+            }
+            else if ((c == ' ') || is_op(& buff[r], & len))
+            {
+                break;
+            }
+            else if ((c == '\'') || (c == '"'))
+            {
+                quote = c;
+                continue;
+            }
+
+            if ((c == '\\') && (quote != '\'') && buff[r+1])
+            {
+                c = buff[++r];
+            }
+
+            buff[w++] = c;
+        }
+
+        if (quote)
+        {
+            return "unterminated quote";
+        }
+
+        CliArg *arg = & cli->argv[cli->argc - 1];
+        arg->len = w - arg->offset;
+
+        // read it first : w can have caught up with r
+        const char next = buff[r];
+        op = next ? is_op(& buff[r], & len) : 0;
+        buff[w++] = '\0';
+        if (!next)
+        {
+            break;
+        }
+        if (!op)
+        {
+            r += 1;
+            continue;
+        }
+
+        // the operator that ended the arg
+        if (!arg_push(cli, w))
+        {
+            return "too many args";
+        }
+        cli->argv[cli->argc - 1].op = op;
+        *ops += 1;
+        r += len;
+    }
+
+    // the first few args are also available as pointers
+    for (int i = 0; i < CLI_MAX_ARGS; i++)
+    {
+        cli->args[i] = (i < cli->argc) ? & buff[cli->argv[i].offset] : 0;
+    }
+
+    return 0;
+}
+
+    /*
+     *  Pipelines : each stage after the first is a built-in filter.
+     *
+     *  The output of the stage before is fed in as it is written, and cut
+     *  into lines in a buffer of CLI_PIPE_SIZE chars : a longer line is
+     *  passed on in parts. Nothing else is kept, so the output of a command
+     *  can be any length.
+     */
+
+typedef struct PipeStage PipeStage;
+
+struct PipeStage
+{
+    CliOutput in;       // the stage before writes to this
+    CliOutput *next;    // and this stage writes to here
+    void (*line)(PipeStage *ps, const char *text, size_t len);
+    void (*end)(PipeStage *ps);
+    const char *eol;
+    const char *text;   // grep
+    size_t text_len;
+    bool invert;
+    long limit;         // head
+    long lines;
+    int status;
+    size_t used;
+    char buff[CLI_PIPE_SIZE];
+};
+
+static bool contains(const char *s, size_t len, const char *text, size_t text_len)
+{
+    if (!text_len)
+    {
+        return true;
+    }
+
+    for (const char *end = s + len; (size_t)(end - s) >= text_len; s++)
+    {
+        s = (const char*) memchr(s, text[0], (size_t)(end - s) - text_len + 1);
+        if (!s)
+        {
+            return false;
+        }
+        if (!memcmp(s, text, text_len))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void grep_line(PipeStage *ps, const char *text, size_t len)
+{
+    if (contains(text, len, ps->text, ps->text_len) != ps->invert)
+    {
+        ps->status = 0;
+        out_write(ps->next, text, len);
+    }
+}
+
+static void head_line(PipeStage *ps, const char *text, size_t len)
+{
+    if (ps->lines < ps->limit)
+    {
+        out_write(ps->next, text, len);
+    }
+    ps->lines += 1;
+}
+
+static void count_line(PipeStage *ps, const char *text, size_t len)
+{
+    UNUSED(text);
+    UNUSED(len);
+    ps->lines += 1;
+}
+
+static void count_end(PipeStage *ps)
+{
+    out_fprintf(ps->next, "%ld%s", ps->lines, ps->eol);
+}
+
+static void stage_line(PipeStage *ps)
+{
+    ps->line(ps, ps->buff, ps->used);
+    ps->used = 0;
+}
+
+static int stage_write(void *ctx, const void *data, size_t len)
+{
+    PipeStage *ps = (PipeStage*) ctx;
+    const char *s = (const char*) data;
+    const char *end = s + len;
+
+    while (s < end)
+    {
+        const size_t room = sizeof(ps->buff) - ps->used;
+        const size_t avail = (size_t)(end - s);
+        const size_t n = (avail < room) ? avail : room;
+        const char *nl = (const char*) memchr(s, '\n', n);
+        const size_t copy = nl ? (size_t)(nl + 1 - s) : n;
+
+        memcpy(& ps->buff[ps->used], s, copy);
+        ps->used += copy;
+        s += copy;
+
+        if (nl || (ps->used == sizeof(ps->buff)))
+        {
+            stage_line(ps);
+        }
+    }
+    return (int) len;
+}
+
+static int stage_writev(void *ctx, const struct iovec *iov, int count)
+{
+    int n = 0;
+    for (int i = 0; i < count; i++)
+    {
+        n += stage_write(ctx, iov[i].iov_base, iov[i].iov_len);
+    }
+    return n;
+}
+
+static int stage_fprintf(void *ctx, const char *fmt, va_list va)
+{
+    char text[CLI_PIPE_SIZE];
+    va_list copy;
+    va_copy(copy, va);
+    const int n = vsnprintf(text, sizeof(text), fmt, copy);
+    va_end(copy);
+
+    if (n < 0)
+    {
+        return n;
+    }
+
+    if ((size_t) n < sizeof(text))
+    {
+        return stage_write(ctx, text, (size_t) n);
+    }
+
+    char *big = (char*) malloc((size_t) n + 1);
+    ASSERT(big);
+    vsnprintf(big, (size_t) n + 1, fmt, va);
+    stage_write(ctx, big, (size_t) n);
+    free(big);
+    return n;
+}
+
+static void stage_end(PipeStage *ps)
+{
+    if (ps->used)
+    {
+        // the last line, with no eol
+        stage_line(ps);
+    }
+    if (ps->end)
+    {
+        ps->end(ps);
+    }
+}
+
+    /*
+     *  Set up a filter from its args. Returns an error message, or 0
+     */
+
+static const char *stage_init(CLI *cli, PipeStage *ps, const CliArg *argv, int argc)
+{
+    memset(ps, 0, offsetof(PipeStage, buff));
+    ps->in.fprintf = stage_fprintf;
+    ps->in.ctx = ps;
+    ps->in.write = stage_write;
+    ps->in.writev = stage_writev;
+    ps->eol = cli->eol;
+
+    const char *name = & cli->buff[argv[0].offset];
+
+    if (!strcmp(name, "grep"))
+    {
+        int i = 1;
+        if ((argc == 3) && !strcmp(& cli->buff[argv[1].offset], "-v"))
+        {
+            ps->invert = true;
+            i += 1;
+        }
+        if (argc != (i + 1))
+        {
+            return "usage : grep [-v] <text>";
+        }
+        ps->text = & cli->buff[argv[i].offset];
+        ps->text_len = argv[i].len;
+        ps->line = grep_line;
+        // no match : fail
+        ps->status = 1;
+        return 0;
+    }
+
+    if (!strcmp(name, "head"))
+    {
+        int n = 10;
+        if ((argc > 2) || ((argc == 2) && !(cli_parse_int(& cli->buff[argv[1].offset], & n, 10) && (n >= 0))))
+        {
+            return "usage : head [<lines>]";
+        }
+        ps->limit = n;
+        ps->line = head_line;
+        return 0;
+    }
+
+    if (!strcmp(name, "count"))
+    {
+        if (argc != 1)
+        {
+            return "usage : count";
+        }
+        ps->line = count_line;
+        ps->end = count_end;
+        return 0;
+    }
+
+    return "";
+}
+
+    /*
+     *  Run the command in argv[0..argc), with cli->argv pointing at it
+     */
+
+static void run_segment(CLI *cli, CliArg *argv, int argc)
+{
+    cli->argv = argv;
+    cli->argc = argc;
+    cli->nest = 0;
+
+    for (int i = 0; i < CLI_MAX_ARGS; i++)
+    {
+        cli->args[i] = (i < argc) ? & cli->buff[argv[i].offset] : 0;
+    }
+
+    const char *cmd = cli_get_arg(cli, 0);
+    cli->nest += 1;
+    cli->status = 0;
+
+    dispatch(cli, cmd);
+}
+
+static void run_pipeline(CLI *cli, CliArg *argv, int argc)
+{
+    PipeStage stages[CLI_MAX_STAGES];
+    int start[CLI_MAX_STAGES + 1];
+    int count = 0;
+
+    // find the stages
+    start[count++] = 0;
+    for (int i = 0; i < argc; i++)
+    {
+        if (argv[i].op != OP_PIPE)
+        {
+            continue;
+        }
+        if (count == CLI_MAX_STAGES)
+        {
+            cli->status = 1;
+            cli_putv(cli, "too many stages", cli->eol, (const char*) 0);
+            return;
+        }
+        start[count++] = i + 1;
+    }
+    start[count] = argc + 1;
+
+    for (int i = 0; i < count; i++)
+    {
+        const int n = start[i + 1] - start[i] - 1;
+        if (!n)
+        {
+            cli->status = 1;
+            cli_putv(cli, "missing command", cli->eol, (const char*) 0);
+            return;
+        }
+        if (!i)
+        {
+            continue;
+        }
+
+        const char *err = stage_init(cli, & stages[i], & argv[start[i]], n);
+        if (err)
+        {
+            cli->status = 1;
+            if (*err)
+            {
+                cli_putv(cli, err, cli->eol, (const char*) 0);
+            }
+            else
+            {
+                not_found(cli, & cli->buff[argv[start[i]].offset]);
+            }
+            return;
+        }
+    }
+
+    if (count == 1)
+    {
+        run_segment(cli, argv, argc);
+        return;
+    }
+
+    const char *cmd = & cli->buff[argv[0].offset];
+    bool found;
+    {
+        ReadLock rcu;
+        found = find_command(cli, cmd) != 0;
+    }
+    if (!found)
+    {
+        // before the output goes down the pipe
+        not_found(cli, cmd);
+        return;
+    }
+
+    // chain the stages : the last one writes to the real output
+    CliOutput *output = cli->output;
+    for (int i = 1; i < count; i++)
+    {
+        stages[i].next = ((i + 1) < count) ? & stages[i + 1].in : output;
+    }
+
+    cli_flush(cli);
+    cli->output = & stages[1].in;
+    run_segment(cli, argv, start[1] - 1);
+    cli_flush(cli);
+    cli->output = output;
+
+    for (int i = 1; i < count; i++)
+    {
+        stage_end(& stages[i]);
+    }
+    cli->status = stages[count - 1].status;
+}
+
+    /*
+     *  Run a line with ';', '&&' or '|' in it
+     *
+     *  'a ; b' runs both, 'a && b' runs b if a succeeds, and in 'a | b' the
+     *  output of a is passed through the filter b. The commands run in turn,
+     *  with the executor bypassed. Commands that hold the CLI, see
+     *  cli_hold(), can't be used here : the rest of the line won't wait.
+     */
+
+static void run_compound(CLI *cli)
+{
+    CliArg *argv = cli->argv;
+    const int argc = cli->argc;
+    const bool compound = cli->compound;
+
+    cli->compound = true;
+
+    int op = OP_SEQ;
+    int start = 0;
+    for (int i = 0; i <= argc; i++)
+    {
+        const int next = (i < argc) ? argv[i].op : OP_SEQ;
+        if ((i < argc) && ((next == 0) || (next == OP_PIPE)))
+        {
+            continue;
+        }
+
+        if ((i > start) && ((op == OP_SEQ) || !cli->status))
+        {
+            run_pipeline(cli, & argv[start], i - start);
+        }
+        else if ((i == start) && (next == OP_AND))
+        {
+            // eg. '&& a' or 'a ; && b'
+            cli->status = 1;
+            cli_putv(cli, "missing command", cli->eol, (const char*) 0);
+            break;
+        }
+
+        op = next;
+        start = i + 1;
+    }
+
+    cli->compound = compound;
+    cli->argv = argv;
+    cli->argc = argc;
+}
+
+static void cli_execute(CLI *cli)
+{
+    // Extract the words in the buffer
+
+    cli->nest = 0;
+    cli->status = 0;
+    int ops = 0;
+    const char *err = cli_split(cli, & ops);
+
+    if (err)
+    {
+        cli->status = 1;
+        cli_putv(cli, err, cli->eol, (const char*) 0);
+        cli->argc = 0;
+        return;
+    }
+
+    if (ops)
+    {
+        run_compound(cli);
+        return;
+    }
+
+    const char *cmd = cli_get_arg(cli, 0);
+    cli->nest += 1;
+
+    if (!cmd)
+    {
+        //  Empty line. Reply with a prompt
+        if (!cli->marker) cli_puts(cli, cli->prompt);
+        return;
+    }
+
+    // Look up the command, and run it
+    dispatch(cli, cmd);
+}
+
+    /*
+     *
+     */
+
+static void _help(CLI *cli, const CliCommand *cmd)
+{
+    cli_putv(cli, cmd->cmd, " : ", cmd->help ? cmd->help : "", cli->eol, (const char*) 0);
+}
+
+static void _cli_help(CLI *cli, CliCommand* cmd, CliCommand **head, const CliTable *table, int offset)
+{
+    const char *s = cli_get_arg(cli, offset);
+
+    if (s)
+    {
+        CliCommand *peer = _find_command(cli, head, table, s);
+        // if there is a matching subcommand, nest
+        if (peer)
+        {
+            return _cli_help(cli, peer, sub_head(peer), sub_table(peer), offset+1);
+        }
+
         // Can't find the command help has been requested for
         not_found(cli, s);
         return;
@@ -273,9 +1723,21 @@ static void _cli_help(CLI *cli, CliCommand* cmd, CliCommand **head, int offset)
         return;
     }
 
-    // Call visit_help() on all elements of the list
+    // Call _help() on all elements of the list
     ASSERT(head);
-    list_visit((pList*) head, next_fn, visit_help, (void*) cli, cli->mutex);
+    for (CliCommand *peer : list_range(head))
+    {
+        _help(cli, peer);
+    }
+
+    // then the constant commands
+    for (size_t i = 0; table && (i < table->count); i++)
+    {
+        if (!shadowed(cli, head, & table->cmds[i]))
+        {
+            _help(cli, & table->cmds[i]);
+        }
+    }
 }
 
     /**
@@ -290,7 +1752,8 @@ static void _cli_help(CLI *cli, CliCommand* cmd, CliCommand **head, int offset)
 
 void cli_help(CLI *cli, CliCommand* cmd)
 {
-    _cli_help(cli, cmd, & cli->head, 0);
+    ReadLock rcu;
+    _cli_help(cli, cmd, & cli->head, cli->table, 0);
 }
 
     /**
@@ -309,203 +1772,614 @@ void cli_nowt(CLI *cli, CliCommand *cmd)
      *
      */
 
+static void cli_draw_to_end(CLI *cli)
+{
+    const size_t more = cli->end - cli->cursor;
+
+    if (more)
+    {
+        cli_write(cli, & cli->buff[cli->cursor], more);
+        cli_backspaces(cli, more);
+    }
+}
+
+    /*
+     *  ANSI redraw engine.
+     *
+     *  CLI.screen holds a copy of the line as the terminal shows it.
+     *  cli_redraw() works out the shortest mix of cursor moves,
+     *  overwrite, insert-char, delete-char and erase-to-end sequences
+     *  that brings the terminal in line with CLI.buff and CLI.cursor.
+     */
+
+static size_t csi_format(char *seq, size_t n, char code)
+{
+    // n defaults to 1, so can be left out
+    if (n == 1)
+    {
+        return (size_t) snprintf(seq, 16, "\x1b[%c", code);
+    }
+    return (size_t) snprintf(seq, 16, "\x1b[%u%c", (unsigned) n, code);
+}
+
+static size_t csi_len(size_t n)
+{
+    char seq[16];
+    return csi_format(seq, n, 'D');
+}
+
+static void csi(CLI *cli, size_t n, char code)
+{
+    char seq[16];
+    const size_t len = csi_format(seq, n, code);
+    cli_write(cli, seq, len);
+}
+
+static size_t move_cost(size_t from, size_t to)
+{
+    const size_t n = (from > to) ? (from - to) : (to - from);
+    const size_t seq = csi_len(n);
+    return (n > seq) ? seq : n;
+}
+
+static void cursor_move(CLI *cli, size_t from, size_t to, const char *text)
+{
+    if (to < from)
+    {
+        const size_t n = from - to;
+        if (n > csi_len(n)) csi(cli, n, 'D');
+        else                cli_backspaces(cli, n);
+    }
+    else if (to > from)
+    {
+        // overtyping the text already there moves right
+        const size_t n = to - from;
+        if (n > csi_len(n)) csi(cli, n, 'C');
+        else                cli_write(cli, & text[from], n);
+    }
+}
+
+static bool cli_ansi(CLI *cli)
+{
+    return cli->echo && cli->ansi;
+}
+
+static bool cli_dumb(CLI *cli)
+{
+    return cli->echo && !cli->ansi;
+}
+
+static void screen_save(CLI *cli)
+{
+    if (!cli_ansi(cli))
+    {
+        return;
+    }
+
+    memcpy(cli->screen, cli->buff, cli->end + 1);
+    cli->screen_end = cli->end;
+    cli->screen_cursor = cli->cursor;
+}
+
+static void cli_redraw(CLI *cli)
+{
+    if (!cli_ansi(cli))
+    {
+        return;
+    }
+
+    const char *was = cli->screen;
+    const size_t lo = cli->screen_end;
+    const size_t oc = cli->screen_cursor;
+    const char *now = cli->buff;
+    const size_t ln = cli->end;
+    const size_t nc = cli->cursor;
+
+    // skip the unchanged start and end of the line
+    size_t p = 0;
+    for (; (p < lo) && (p < ln) && (was[p] == now[p]); p++)
+        ;
+    size_t same = 0;
+    for (; ((p + same) < lo) && ((p + same) < ln) && (was[lo-1-same] == now[ln-1-same]); same++)
+        ;
+
+    if ((p == lo) && (p == ln))
+    {
+        // only the cursor has moved
+        cursor_move(cli, oc, nc, now);
+        return;
+    }
+
+    // chars deleted / inserted at p
+    const size_t del = lo - same - p;
+    const size_t ins = ln - same - p;
+    const size_t over = (del < ins) ? del : ins;
+
+    // cost of editing in place : overtype, then insert or delete chars
+    size_t edit = over + move_cost(p + ins, nc);
+    if (ins > del) edit += csi_len(ins - del) + (ins - del);
+    if (del > ins) edit += csi_len(del - ins);
+
+    // cost of rewriting the rest of the line
+    const size_t rewrite = (ln - p) + ((ln < lo) ? 3 : 0) + move_cost(ln, nc);
+
+    cursor_move(cli, oc, p, was);
+
+    if (edit <= rewrite)
+    {
+        cli_write(cli, & now[p], over);
+        if (ins > del)
+        {
+            csi(cli, ins - del, '@');
+            cli_write(cli, & now[p + over], ins - del);
+        }
+        if (del > ins)
+        {
+            csi(cli, del - ins, 'P');
+        }
+        cursor_move(cli, p + ins, nc, now);
+    }
+    else
+    {
+        cli_write(cli, & now[p], ln - p);
+        if (ln < lo)
+        {
+            cli_puts(cli, "\x1b[K");
+        }
+        cursor_move(cli, ln, nc, now);
+    }
+}
+
+static void cli_edit(CLI *cli, char c)
+{
+    switch (c)
+    {
+        case 'C'    :   // cursor right
+        {
+            if (cli->cursor < cli->end)
+            {
+                if (cli_dumb(cli)) cli_write(cli, & cli->buff[cli->cursor], 1);
+                cli->cursor += 1;
+            }
+            break;
+        }
+        case 'D'    :   // cursor left
+        {
+            if (cli->cursor > 0)
+            {
+                if (cli_dumb(cli)) cli_backspaces(cli, 1);
+                cli->cursor -= 1;
+            }
+            break;
+        }
+        default:    //  ignore all other ESC codes
+        {
+            break;
+        }
+    }
+}
+
+static void cli_backspace(CLI *cli)
+{
+    if (cli->cursor == 0)
+    {
+        // nothing to delete
+        return;
+    }
+
+    // move chars down one
+    memmove(& cli->buff[cli->cursor-1], & cli->buff[cli->cursor], cli->end - cli->cursor);
+
+    cli->end -= 1;
+    cli->buff[cli->end] = '\0';
+    cli->cursor -= 1;
+    // overwrite the deleted char
+    if (cli_dumb(cli))
+    {
+        cli_puts(cli, " \b");
+        cli_draw_to_end(cli);
+    }
+}
+
+    /*
+     *  Autocompletion
+     *
+     *  Each ' ' separated word before the cursor selects the first command
+     *  (in list order, then in the table) that it is a prefix of. The last
+     *  word is completed against the subcommands of that.
+     */
+
 struct autocomplete
 {
     CLI *cli;
-    CliCommand *last;
-    int count;
-    int complete;
-    size_t offset;
+    const char *s;
+    size_t len;
+    CliMatch match;
     bool print;
 };
 
-static int visit_auto(pList w, void *arg)
+static void visit_auto(CliCommand *cmd, struct autocomplete *ac)
+{
+    // called for each command in the list
+    ASSERT(cmd);
+    ASSERT(ac);
+
+    if (!strncmp(ac->s, cmd->cmd, ac->len))
+    {
+        // matches the command so far
+        if (!ac->match.first)
+        {
+            ac->match.first = cmd;
+        }
+        ac->match.count += 1;
+
+        if (ac->print)
+        {
+            cli_putv(ac->cli, cmd->cmd, ac->cli->eol, (const char*) 0);
+        }
+    }
+}
+
+static int print_match(CliCommand *cmd, void *arg)
+{
+    CLI *cli = (CLI*) arg;
+    cli_putv(cli, cmd->cmd, cli->eol, (const char*) 0);
+    return 0;
+}
+
+    /*
+     *  Find (or print) the commands in one level that start with the word
+     */
+
+static void auto_level(struct autocomplete *ac, CliCommand **head, const CliTable *table)
 {
-    // Callback function : called for each command in the list
-    ASSERT(w);
-    ASSERT(arg);
-    CliCommand *cmd = (CliCommand *) w;
-    struct autocomplete *ac = (struct autocomplete *) arg;
     CLI *cli = ac->cli;
 
-    ASSERT(cli->end >= ac->offset);
-    const char *s = & cli->buff[ac->offset];
+    ac->match.count = 0;
+    ac->match.first = 0;
 
-    // are there any spaces in the command?
-    const char *space = strchr(s, ' ');
-    // completion with spaces needs to resolve the complete commands
-    if (space)
+    if (cli->index)
     {
-        if (!strncmp(s, cmd->cmd, (size_t) (space - s)))
+        // use the radix trie
+        Lock lock(cli->mutex);
+        if (ac->print)
         {
-            // match this one completely typed command
-            ac->last = cmd;
-            ac->count = 1;
-            // skip over all trailing ' ' for the next comparison
-            for (; *space == ' '; space++)
-                ;
-            ac->offset += (size_t) (space - s);
-            ac->complete += 1;
-            return 1;
+            index_visit(cli->index, head, ac->s, ac->len, false, print_match, cli);
+        }
+        else
+        {
+            index_match(cli->index, head, ac->s, ac->len, & ac->match);
+        }
+    }
+    else
+    {
+        for (CliCommand *cmd : list_range(head))
+        {
+            visit_auto(cmd, ac);
         }
-        return 0;
     }
 
-    if (!strncmp(s, cmd->cmd, (size_t) (cli->end - ac->offset)))
+    // then the constant commands, less any hidden by registered ones
+    const CliCommand *cmds = 0;
+    const size_t n = table_match(table, ac->s, ac->len, & cmds);
+
+    for (size_t i = 0; i < n; i++)
     {
-        // matches the command so far
-        ac->last = cmd;
-        ac->count += 1;
+        const CliCommand *cmd = & cmds[i];
+        if (shadowed(cli, head, cmd))
+        {
+            continue;
+        }
+
+        if (!ac->match.first)
+        {
+            ac->match.first = const_cast<CliCommand*>(cmd);
+        }
+        ac->match.count += 1;
 
         if (ac->print)
         {
-            cli_print(cli, "%s%s", cmd->cmd, cli->eol);
+            cli_putv(cli, cmd->cmd, cli->eol, (const char*) 0);
         }
     }
+}
+
+    /*
+     *  Insert the rest of a completed word, and a ' ', at the cursor
+     */
+
+static void cli_complete(CLI *cli, const char *suffix)
+{
+    const size_t n = strlen(suffix) + 1;
+
+    if ((cli->end + n) >= cli->size)
+    {
+        //  line is full : ERROR
+        cli_clear(cli);
+        if (cli->echo) cli_putv(cli, cli->eol, cli->prompt, (const char*) 0);
+        return;
+    }
+
+    screen_save(cli);
+
+    char *at = & cli->buff[cli->cursor];
+    memmove(at + n, at, cli->end - cli->cursor);
+    memcpy(at, suffix, n - 1);
+    at[n - 1] = ' ';
+
+    cli->end += n;
+    cli->cursor += n;
+    cli->buff[cli->end] = '\0';
 
-    return 0;
+    if (cli_dumb(cli))
+    {
+        cli_write(cli, at, n);
+        cli_draw_to_end(cli);
+    }
+    cli_redraw(cli);
 }
 
 static void cli_autocomplete(CLI *cli)
 {
     // Check for partial match of command handlers
-    struct autocomplete ac = { .cli = cli, .complete = 0, .offset = 0, .print = false };
+    struct autocomplete ac = { .cli = cli, .s = cli->buff, .len = 0, .print = false };
+    const char *end = & cli->buff[cli->cursor];
+    ReadLock rcu;
 
     CliCommand **head = & cli->head;
+    const CliTable *table = cli->table;
 
     while (true)
     {
         // search through the ' ' seperated list of commands so far ..
-        ac.count = 0;
-        ac.last = 0;
-        CliCommand *cmd = (CliCommand *) list_find((pList*) head, next_fn, visit_auto, (void*) & ac, cli->mutex);
-        if (!cmd)
+        const char *space = (const char*) memchr(ac.s, ' ', (size_t) (end - ac.s));
+        ac.len = (size_t) ((space ? space : end) - ac.s);
+        auto_level(& ac, head, table);
+
+        if ((!space) || (!ac.match.count))
         {
             break;
         }
 
-        // found completed this command. search for subcommands
-        head = & cmd->subcommand;
+        // found completed this command. skip the ' ', search for subcommands
+        for (; (space < end) && (*space == ' '); space++)
+            ;
+        ac.s = space;
+        head = sub_head(ac.match.first);
+        table = sub_table(ac.match.first);
     }
 
-    if (ac.count == 0)
+    if (ac.match.count == 0)
     {
         // No match. Do nothing
         return;
     }
 
-    if (ac.count == 1)
+    if (ac.match.count == 1)
     {
         // Single match. autocomplete this
-        CliCommand *cmd = ac.last;
-        // offset into the sole matching command
-        ASSERT(cli->end >= ac.offset);
-        const size_t offset = cli->end - ac.offset;
-        const char *s = & cmd->cmd[offset];
-        for (; *s; s++)
-        {
-            cli_process(cli, *s);
-        }
-        cli_process(cli, ' ');
+        cli_complete(cli, & ac.match.first->cmd[ac.len]);
         return;
     }
 
     // Print the partial matches
     ac.print = true;
-    cli_print(cli, "%s", cli->eol);
-    list_visit((pList*) head, next_fn, visit_auto, (void*) & ac, cli->mutex);
-    cli_print(cli, "%s", cli->prompt);
+    cli_puts(cli, cli->eol);
+    auto_level(& ac, head, table);
     // restore the buffer so far ..
-    cli_print(cli, "%s", cli->buff);
+    cli_putv(cli, cli->prompt, cli->buff, (const char*) 0);
+    if (cli_ansi(cli))
+    {
+        cursor_move(cli, cli->end, cli->cursor, cli->buff);
+    }
+    else
+    {
+        cli_backspaces(cli, cli->end - cli->cursor);
+    }
 }
 
     /*
      *
      */
 
-static void cli_draw_to_end(CLI *cli)
+    /*
+     *  Held commands : input is kept until the command finishes
+     */
+
+static void hold_input(CLI *cli, const char *buf, size_t len)
 {
-    const size_t more = cli->end - cli->cursor;
+    if ((cli->held_used + len) > cli->held_size)
+    {
+        size_t size = cli->held_size ? cli->held_size : 64;
+        while (size < (cli->held_used + len))
+        {
+            size *= 2;
+        }
+        cli->held_buff = (char*) realloc(cli->held_buff, size);
+        ASSERT(cli->held_buff);
+        cli->held_size = size;
+    }
 
-    if (more)
+    memcpy(& cli->held_buff[cli->held_used], buf, len);
+    cli->held_used += len;
+}
+
+    /**
+     * @brief called by a handler that will finish after it returns
+     *
+     * Until the matching cli_release() the prompt is held back and any
+     * input is kept, so the command has the CLI to itself. Handlers that
+     * hold must run inline : set CLI_INLINE if there is an executor.
+     * They can't be used in a compound line or a script.
+     */
+
+void cli_hold(CLI *cli)
+{
+    ASSERT(cli);
+    // a deferred command's CLI is freed when its handler returns
+    ASSERT(!cli->task);
+    // the rest of a compound line or script would run before it finishes
+    ASSERT(!cli->compound);
+    cli->held += 1;
+}
+
+    /**
+     * @brief the held command has finished
+     *
+     * Writes the prompt, then processes the input that arrived meanwhile.
+     * Call it from the thread that feeds the CLI.
+     */
+
+void cli_release(CLI *cli)
+{
+    ASSERT(cli);
+    ASSERT(cli->held > 0);
+
+    cli->held -= 1;
+    if (cli->held || cli->executing)
+    {
+        // still held, or finished before the handler returned
+        return;
+    }
+
+    cli_done(cli);
+    capture_end(cli);
+
+    char *buf = cli->held_buff;
+    const size_t len = cli->held_used;
+    cli->held_buff = 0;
+    cli->held_used = 0;
+    cli->held_size = 0;
+
+    // this can hold again : the rest is kept in a new buffer
+    cli_process_buffer(cli, buf, len);
+    free(buf);
+}
+
+    /*
+     *  Execute the line in the buffer
+     */
+
+static void run_line(CLI *cli)
+{
+    const bool captured = capture_start(cli);
+
+    cli->executing = true;
+    cli_execute(cli);
+    cli->executing = false;
+    cli_clear(cli);
+    if (cli->deferred)
+    {
+        // the task writes the prompt after its output
+        cli->deferred = false;
+    }
+    else if (cli->held)
+    {
+        // cli_release() writes it, and ends the capture
+        return;
+    }
+    else
     {
-        cli_print(cli, "%s", & cli->buff[cli->cursor]);
+        cli_done(cli);
     }
-    for (size_t i = 0; i < more; i++)
+
+    if (captured)
     {
-        cli_print(cli, "\b");
+        capture_end(cli);
     }
 }
 
-static void cli_edit(CLI *cli, char c)
+    /*
+     *  Machine mode : add up to the next '\n' to the line, and run it if
+     *  it is complete. Returns the number of chars used.
+     */
+
+static size_t machine_input(CLI *cli, const char *buf, size_t len)
 {
-    switch (c)
+    const char *nl = (const char*) memchr(buf, '\n', len);
+    const size_t n = nl ? (size_t)(nl - buf) : len;
+
+    if (!cli->discard)
     {
-        case 'C'    :   // cursor right
-        {
-            if (cli->cursor < cli->end)
-            {
-                if (cli->echo) cli_print(cli, "%c", cli->buff[cli->cursor]);
-                cli->cursor += 1;
-            }
-            break;
-        }
-        case 'D'    :   // cursor left
+        if (n < (cli->size - cli->end))
         {
-            if (cli->cursor > 0)
-            {
-                if (cli->echo) cli_print(cli, "\b");
-                cli->cursor -= 1;
-            }
-            break;
+            memcpy(& cli->buff[cli->end], buf, n);
+            cli->end += n;
+            cli->cursor = cli->end;
         }
-        default:    //  ignore all other ESC codes
+        else
         {
-            break;
+            // drop the rest of the line
+            cli->discard = true;
         }
     }
-}
 
-static void cli_backspace(CLI *cli)
-{
-    if (cli->cursor == 0)
+    if (!nl)
     {
-        // nothing to delete
-        return;
+        return len;
     }
 
-    // move chars down one
-    memmove(& cli->buff[cli->cursor-1], & cli->buff[cli->cursor], cli->end - cli->cursor);
+    if (cli->discard)
+    {
+        const bool captured = capture_start(cli);
+        cli_clear(cli);
+        cli->status = 1;
+        cli_putv(cli, "line too long", cli->eol, (const char*) 0);
+        cli_done(cli);
+        if (captured)
+        {
+            capture_end(cli);
+        }
+        return n + 1;
+    }
 
-    cli->end -= 1;
-    cli->buff[cli->end] = '\0';
-    cli->cursor -= 1;
-    // overwrite the deleted char
-    if (cli->echo)
+    if (cli->end && (cli->buff[cli->end - 1] == '\r'))
     {
-        cli_print(cli, " \b");
-        cli_draw_to_end(cli);
+        cli->end -= 1;
     }
+    cli->buff[cli->end] = '\0';
+    run_line(cli);
+    return n + 1;
 }
 
     /**
-     * @brief send char \a c to the command interpreter
+     * @brief put the CLI in machine mode, or back to interactive if \a marker is null
+     *
+     * For programs rather than people : there is no echo, prompt, line
+     * editing or completion. Each '\n' terminated line is run as it is,
+     * then \a marker, a space, the status (see cli_set_status()) and the
+     * eol are written to mark the end of the response, eg. "." gives
+     * ". 0\r\n". A blank line gets that line alone, with status 0.
+     *
+     * cli_init() has already written the first prompt : give a CLI that
+     * starts in machine mode an empty prompt, and set the prompt if it goes
+     * back to interactive.
      */
 
-void cli_process(CLI *cli, char c)
+void cli_set_machine(CLI *cli, const char *marker)
+{
+    ASSERT(cli);
+    cli->marker = marker;
+    cli->escape = false;
+    cli->cursor = cli->end;
+}
+
+static void process(CLI *cli, char c)
 {
     if (((size_t)(cli->end + 1)) >= cli->size)
     {
         //  line is full : ERROR
         cli_clear(cli);
-        if (cli->echo) cli_print(cli, "%s%s", cli->eol, cli->prompt);
+        if (cli->echo) cli_putv(cli, cli->eol, cli->prompt, (const char*) 0);
         return;
     }
 
     if (cli->escape)
     {
         // Process cursor commands
+        screen_save(cli);
         cli_edit(cli, c);
+        cli_redraw(cli);
         cli->escape = false;
         return;
     }
@@ -522,8 +2396,11 @@ void cli_process(CLI *cli, char c)
         return;
     }
 
-    // Echo the char
-    if (cli->echo) cli_print(cli, "%c", c);
+    // Echo the char, edits are drawn by cli_redraw() on ANSI terminals
+    if (cli_dumb(cli) || (cli_ansi(cli) && ((c == '\r') || (c == '\n'))))
+    {
+        cli_write(cli, & c, 1);
+    }
 
     // Just ignore carriage return
     if (c == '\r')
@@ -534,19 +2411,22 @@ void cli_process(CLI *cli, char c)
     // handle backspace
     if (c == '\b')
     {
+        screen_save(cli);
         cli_backspace(cli);
+        cli_redraw(cli);
         return;
     }
 
     if (c == '\n')
     {
-        // Execute the line
-        cli_execute(cli);
-        cli_clear(cli);
-        cli_print(cli, "%s", cli->prompt);
+        run_line(cli);
+        // end of command
+        cli_flush(cli);
         return;
     }
 
+    screen_save(cli);
+
     if (cli->cursor != cli->end)
     {
         // Move the rest of the buffer up one
@@ -559,7 +2439,277 @@ void cli_process(CLI *cli, char c)
     cli->end += 1;
     cli->cursor += 1;
     cli->buff[cli->end] = '\0';
-    cli_draw_to_end(cli);
+
+    if (cli_dumb(cli)) cli_draw_to_end(cli);
+    cli_redraw(cli);
+}
+
+    /**
+     * @brief send char \a c to the command interpreter
+     */
+
+void cli_process(CLI *cli, char c)
+{
+    cli_poll(cli);
+    if (cli->held)
+    {
+        hold_input(cli, & c, 1);
+        return;
+    }
+    if (cli->marker)
+    {
+        machine_input(cli, & c, 1);
+    }
+    else
+    {
+        process(cli, c);
+    }
+    cli_flush(cli);
+}
+
+    /*
+     *  Return the length of the run of plain chars at the start of \a s.
+     *
+     *  Anything below ' ' (ESC, '\t', '\b', '\r', '\n', '\0' ...)
+     *  terminates the run and is left for cli_process() to handle.
+     */
+
+static size_t plain_run(const char *s, size_t len)
+{
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i ctrl = _mm_set1_epi8(0x1f);
+    for (; (i + 16) <= len; i += 16)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i*) & s[i]);
+        // v <= 0x1f (unsigned) iff min(v, 0x1f) == v
+        const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(v, ctrl), v));
+        if (mask)
+        {
+            return i + (size_t) __builtin_ctz((unsigned) mask);
+        }
+    }
+#else
+    // word at a time : test for any byte < 0x20
+    const unsigned long ones = ~0UL / 255;
+    for (; (i + sizeof(unsigned long)) <= len; i += sizeof(unsigned long))
+    {
+        unsigned long x;
+        memcpy(& x, & s[i], sizeof(x));
+        if ((x - (ones * 0x20)) & ~x & (ones * 0x80))
+        {
+            break;
+        }
+    }
+#endif
+
+    for (; i < len; i++)
+    {
+        if (((unsigned char) s[i]) < ' ')
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+    /**
+     * @brief send \a len chars from \a buf to the command interpreter
+     *
+     * Gives exactly the same result as calling cli_process() for each char,
+     * but runs of plain chars typed at the end of the line are copied into
+     * the buffer and echoed in one go.
+     */
+
+void cli_process_buffer(CLI *cli, const char *buf, size_t len)
+{
+    ASSERT(cli);
+    ASSERT(buf || !len);
+
+    cli_poll(cli);
+
+    const char *end = & buf[len];
+
+    while (buf < end)
+    {
+        if (cli->held)
+        {
+            // keep the rest until the command finishes
+            hold_input(cli, buf, (size_t) (end - buf));
+            break;
+        }
+
+        if (cli->marker)
+        {
+            // a line at a time, so a held command keeps the rest
+            buf += machine_input(cli, buf, (size_t) (end - buf));
+            continue;
+        }
+
+        size_t n = 0;
+
+        // insert mid-line and escape sequences take the slow path
+        if ((!cli->escape) && (cli->cursor == cli->end))
+        {
+            n = plain_run(buf, (size_t) (end - buf));
+
+            // leave room for the line full check in cli_process()
+            const size_t room = ((cli->end + 1) < cli->size) ? (cli->size - 1 - cli->end) : 0;
+            if (n > room)
+            {
+                n = room;
+            }
+        }
+
+        if (!n)
+        {
+            process(cli, *buf++);
+            continue;
+        }
+
+        memcpy(& cli->buff[cli->end], buf, n);
+        cli->end += n;
+        cli->cursor = cli->end;
+        cli->buff[cli->end] = '\0';
+
+        if (cli->echo) cli_write(cli, buf, n);
+
+        buf += n;
+    }
+
+    // end of chunk
+    cli_flush(cli);
+}
+
+    /*
+     *  Report a failed line of a script
+     */
+
+static void script_error(CLI *cli, const char *name, int line, const char *what)
+{
+    if (name)
+    {
+        cli_print(cli, "%s:%d : %s%s", name, line, what, cli->eol);
+        return;
+    }
+    cli_print(cli, "line %d : %s%s", line, what, cli->eol);
+}
+
+    /**
+     * @brief run each line of \a text as a command
+     *
+     * The lines are run straight from \a text, without the echo, the line
+     * editor or the prompt : the only output is from the commands. A line
+     * that fails, see cli_set_status(), is reported with its line number,
+     * after \a name if it isn't null. CLI_STOP_ON_ERROR in \a flags ends
+     * the run at the first one.
+     *
+     * Can be called from a handler : the line being run is kept. As in a
+     * compound line, the executor is bypassed and commands can't hold the CLI.
+     *
+     * @return the number of the first line that failed, or 0
+     */
+
+int cli_run_lines(CLI *cli, const char *name, const char *text, size_t len, unsigned flags)
+{
+    ASSERT(cli);
+    ASSERT(text || !len);
+
+    // keep the line being run
+    char *buff = cli->buff;
+    const char *args[CLI_MAX_ARGS];
+    memcpy(args, cli->args, sizeof(args));
+    const int nest = cli->nest;
+    CliArg *argv = cli->argv;
+    const int argc = cli->argc;
+    const int argv_size = cli->argv_size;
+    const bool argv_owned = cli->argv_owned;
+    const bool compound = cli->compound;
+
+    cli->buff = (char*) malloc(cli->size);
+    ASSERT(cli->buff);
+    cli->argv_owned = false;
+    cli_set_arg_storage(cli, 0, 0);
+    // each status is needed before the next line
+    cli->compound = true;
+    const bool captured = capture_start(cli);
+
+    int failed = 0;
+    int line = 0;
+    const char *end = text + len;
+
+    for (const char *s = text; s < end; )
+    {
+        const char *nl = (const char*) memchr(s, '\n', (size_t)(end - s));
+        const char *e = nl ? nl : end;
+        const char *next = nl ? (nl + 1) : end;
+        line += 1;
+
+        for (; (s < e) && (*s == ' '); s++)
+            ;
+        if ((s < e) && (e[-1] == '\r'))
+        {
+            e -= 1;
+        }
+
+        const size_t n = (size_t)(e - s);
+        if (!n)
+        {
+            s = next;
+            continue;
+        }
+
+        if (n >= cli->size)
+        {
+            cli->status = 1;
+            script_error(cli, name, line, "too long");
+        }
+        else
+        {
+            memcpy(cli->buff, s, n);
+            cli->buff[n] = '\0';
+            cli_execute(cli);
+            if (cli->status)
+            {
+                script_error(cli, name, line, "failed");
+            }
+        }
+
+        if (cli->status && !failed)
+        {
+            failed = line;
+        }
+        if (failed && (flags & CLI_STOP_ON_ERROR))
+        {
+            break;
+        }
+        s = next;
+    }
+
+    free(cli->buff);
+    if (cli->argv_owned)
+    {
+        free(cli->argv);
+    }
+
+    cli->buff = buff;
+    memcpy(cli->args, args, sizeof(args));
+    cli->nest = nest;
+    cli->argv = argv;
+    cli->argc = argc;
+    cli->argv_size = argv_size;
+    cli->argv_owned = argv_owned;
+    cli->compound = compound;
+    cli->status = failed ? 1 : 0;
+
+    cli_flush(cli);
+    if (captured)
+    {
+        capture_end(cli);
+    }
+    return failed;
 }
 
     /**
@@ -571,12 +2721,39 @@ void cli_close(CLI *cli)
     ASSERT(cli);
     ASSERT(cli->buff);
 
+    // Wait for any deferred commands
+    cli_set_executor(cli, 0);
+
+    // a held command must have finished
+    free(cli->held_buff);
+    cli->held_buff = 0;
+    cli->held_used = 0;
+    cli->held_size = 0;
+
     // Free the text input buffer
     free(cli->buff);
     cli->buff = 0;
+    free(cli->screen);
+    cli->screen = 0;
+
+    // Free the output buffer
+    cli_set_output_buffer(cli, 0, 0);
+
+    // Free the command index
+    cli_set_index(cli, 0);
+
+    // Free the arg storage
+    if (cli->argv_owned)
+    {
+        free(cli->argv);
+    }
+    cli->argv = 0;
+    cli->argv_owned = false;
 
     // Unlink all the actions
     cli->head = 0;
+    cli->tail = 0;
+    cli->tail_head = 0;
 }
 
     /*
@@ -670,18 +2847,49 @@ bool cli_parse_float(const char *s, float *value)
      *
      */
 
+    /**
+     * @brief remove \a item from the command list at \a head
+     *
+     * Waits until no other thread can be using \a item before returning : for
+     * the lookups in progress, and for any handler of \a item still running.
+     * Handlers of other commands run outside the read sections, so are not
+     * waited for.
+     */
+
 bool cli_remove(CliCommand **head, CliCommand *item)
 {
     ASSERT(head);
     ASSERT(item);
-    return list_remove((pList*) head, (pList) item, next_fn, 0);
+    bool found;
+    {
+        Lock lock(rcu_writer());
+        found = list_unlink((pList*) head, (pList) item, next_fn, 0);
+        __atomic_store_n(& removals, removals + (found ? 1 : 0), __ATOMIC_RELEASE);
+    }
+
+    if (found)
+    {
+        index_changed();
+        rcu_synchronize();
+        rcu_wait_unpinned(item);
+        item->next = 0;
+    }
+    return found;
 }
 
+    /**
+     * @brief find a command in the list at \a head
+     *
+     * The command returned can be removed by another thread unless the
+     * caller is in a read section (see cli_rcu.h).
+     */
+
 CliCommand *cli_find(CliCommand **head, int (*fn)(CliCommand *cmd, void *arg), void *arg)
 {
     ASSERT(head);
     ASSERT(fn);
-    return (CliCommand*) list_find((pList*) head, next_fn, (visitor) fn, arg, 0);
+    ReadLock rcu;
+    return list_find_if(head, [fn, arg](CliCommand *cmd) { return fn(cmd, arg) != 0; });
 }
 
 //  FIN
@@ -4,6 +4,13 @@
 #include <stdio.h>
 #include <stdarg.h>
 
+#if defined(__has_include)
+#if __has_include(<sys/uio.h>)
+#include <sys/uio.h>
+#define CLI_HAS_UIO
+#endif
+#endif
+
 #include "io.h"
 #include "list.h"
 
@@ -12,28 +19,84 @@ extern "C" {
 #endif
 
 struct CLI;
+struct CliIndex;
+struct CliTable;
 
 typedef struct CliCommand {
     const char *cmd;
     void (*handler)(struct CLI *cli, struct CliCommand *cmd);
     const char *help;
 
-    // Subcommands
-    struct CliCommand *subcommand; // TODO
+    // Subcommands : a list, or constant ones (see cli_table.h) with CLI_SUBTABLE
+    union {
+        struct CliCommand *subcommand;
+        const struct CliTable *subtable;
+    };
     void *ctx;
 
     // linked list when registered to a cli
     struct CliCommand *next;
+
+    unsigned flags; // CLI_INLINE ...
 }   CliCommand;
 
+// run the handler on the input thread, even if the CLI has an executor
+#define CLI_INLINE 0x01
+// the subcommands are in CliCommand.subtable
+#define CLI_SUBTABLE 0x02
+
+// constant commands, sorted by name
+typedef struct CliTable {
+    const CliCommand *cmds;
+    size_t count;
+}   CliTable;
+
 #define CLI_MAX_ARGS 8
 
+// an arg, as an offset into CLI.buff and a length
+typedef struct
+{
+    size_t offset;
+    size_t len;
+    int op; // an unquoted ';', '&&' or '|' : not passed to handlers
+}   CliArg;
+
+// the stages of a pipeline pass on lines of up to this many chars
+#define CLI_PIPE_SIZE 256
+#define CLI_MAX_STAGES 8
+
+#if !defined(CLI_HAS_UIO)
+struct iovec {
+    void *iov_base;
+    size_t iov_len;
+};
+#endif
+
 typedef struct
 {
     int (*fprintf)(void *, const char *fmt, va_list va);
     void *ctx;
+    // optional : used for unformatted output if present
+    int (*write)(void *, const void *data, size_t len);
+    int (*writev)(void *, const struct iovec *iov, int count);
 }   CliOutput;
 
+    /*
+     *  Runs command handlers on other threads, see cli_set_executor()
+     */
+
+typedef struct
+{
+    // queue fn(arg) to be run on another thread
+    void (*submit)(void *ctx, void (*fn)(void *arg), void *arg);
+    // optional : called on that thread when output for cli is waiting.
+    // Wake the thread that feeds cli, so it can call cli_poll().
+    void (*ready)(void *ctx, struct CLI *cli);
+    // optional : called while cli_close() waits for handlers to finish
+    void (*yield)(void *ctx);
+    void *ctx;
+}   CliExecutor;
+
 typedef struct CLI {
     char *buff;
     size_t size;
@@ -41,17 +104,55 @@ typedef struct CLI {
     size_t cursor;
     bool escape;
     bool echo;
+    bool ansi; // terminal supports ANSI cursor and edit sequences
 
     CliCommand *head;
+    CliCommand *tail; // a hint for cli_append()
+    CliCommand *tail_head; // the head when the hint was taken
+    unsigned long tail_gen;
     CliOutput *output;
     const char* prompt;
     const char* eol;
-    MUTEX *mutex; // can be null
+    MUTEX *mutex; // can be null : guards the index, the lists use cli_rcu.h
     void *ctx; // context
+    struct CliIndex *index; // optional, see cli_set_index()
+    const CliTable *table; // optional, see cli_set_table()
+    CliExecutor *executor; // optional, see cli_set_executor()
+    struct CliTasks *tasks;
+    bool deferred; // the line was passed to the executor
+    bool task; // the copy a deferred command runs on : it can't be held
+
+    int status; // of the last command, see cli_set_status()
+    bool compound; // running a line with ';', '&&' or '|'
+
+    const char *marker; // machine mode, see cli_set_machine()
+    bool discard; // machine mode : the line is too long
+
+    // a command still running, see cli_hold()
+    int held;
+    bool executing;
+    char *held_buff; // input that arrived while held
+    size_t held_used;
+    size_t held_size;
 
     // used by cli_execute to break input into parts
-    const char *args[CLI_MAX_ARGS];
+    const char *args[CLI_MAX_ARGS]; // the first CLI_MAX_ARGS args
     int nest;
+    CliArg *argv; // all the args, see cli_set_arg_storage()
+    int argc;
+    int argv_size;
+    bool argv_owned;
+
+    // the line as shown on an ANSI terminal
+    char *screen;
+    size_t screen_end;
+    size_t screen_cursor;
+
+    // optional output staging buffer, see cli_set_output_buffer()
+    char *out_buff;
+    size_t out_size;
+    size_t out_used;
+    size_t out_high; // high water mark
 }   CLI;
 
 void cli_init(CLI *cli, size_t size, void *ctx);
@@ -60,9 +161,27 @@ void cli_close(CLI *cli);
 void cli_register(CLI *cli, CliCommand *cmd);
 void cli_append(CLI *cli, CliCommand *cmd);
 void cli_insert(CLI *cli, CliCommand **head, CliCommand *cmd);
+void cli_set_index(CLI *cli, size_t slots);
+void cli_set_table(CLI *cli, const CliTable *table);
+void cli_set_executor(CLI *cli, CliExecutor *executor);
+void cli_poll(CLI *cli);
+int cli_pending(CLI *cli);
+void cli_set_machine(CLI *cli, const char *marker);
+void cli_hold(CLI *cli);
+void cli_release(CLI *cli);
 void cli_process(CLI *cli, char c);
+void cli_process_buffer(CLI *cli, const char *buf, size_t len);
+
+// cli_run_lines() flags
+#define CLI_STOP_ON_ERROR 0x01
+
+int cli_run_lines(CLI *cli, const char *name, const char *text, size_t len, unsigned flags);
 
 void cli_print(CLI *cli, const char *fmt, ...) __attribute__((format(printf,2,3)));
+void cli_write(CLI *cli, const void *data, size_t len);
+void cli_puts(CLI *cli, const char *s);
+void cli_set_output_buffer(CLI *cli, size_t size, size_t high_water);
+void cli_flush(CLI *cli);
 void cli_clear(CLI *cli);
 
 // Default 'help' command handler
@@ -73,6 +192,10 @@ void cli_nowt(CLI *cli, CliCommand *cmd);
 // accessing and parsing args
 
 const char* cli_get_arg(CLI *cli, int offset);
+size_t cli_get_arg_len(CLI *cli, int offset);
+int cli_argc(CLI *cli);
+void cli_set_status(CLI *cli, int status);
+void cli_set_arg_storage(CLI *cli, CliArg *args, int size);
 
 bool cli_parse_int(const char *s, int *value, int base);
 bool cli_parse_long(const char *s, long *value, int base);
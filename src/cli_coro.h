@@ -0,0 +1,217 @@
+#if !defined(__CLI_CORO_H__)
+
+#define __CLI_CORO_H__
+
+#if !defined(__cpp_impl_coroutine)
+#error "cli_coro.h needs C++20 coroutines : build with -std=c++20"
+#endif
+
+#include <coroutine>
+#include <exception>
+
+#include <cli_debug.h>
+#include "cli.h"
+#include "cli_events.h"
+
+    /*
+     *  Coroutine command handlers (C++20)
+     *
+     *  A handler returning CliCoro can co_await timers, fd readiness and
+     *  other CliCoros, without tying up a thread :
+     *
+     *      CliCoro wait_cmd(CLI *cli, CliCommand *cmd)
+     *      {
+     *          co_await cli_sleep(events, 100);
+     *          cli_print(cli, "done%s", cli->eol);
+     *      }
+     *
+     *      CliCommand wait = { .cmd = "wait", .handler = cli_async<wait_cmd> };
+     *
+     *  cli_async<> fits it into the usual handler slot. It holds the CLI
+     *  (see cli_hold()) until the coroutine finishes, so the input for the
+     *  session is kept and the prompt held back till then.
+     *
+     *  The coroutines are resumed by the event loop behind the CliEvents
+     *  hook : run it on the thread that feeds the CLI. Set CLI_INLINE on
+     *  the commands if the CLI has an executor : a deferred command can't
+     *  hold, as its CLI is freed when the handler returns. Nor can one in
+     *  a compound line or a script : the rest would run before it finishes.
+     *
+     *  gcc's -Wswitch-default warns about the switch it generates for each
+     *  coroutine : turn it off around them, see test/coro_test.cpp.
+     */
+
+#if defined(CLI_NS)
+namespace CLI_NS {
+#endif
+
+class CliCoro
+{
+public:
+    struct promise_type;
+    typedef std::coroutine_handle<promise_type> Handle;
+
+    struct promise_type
+    {
+        std::coroutine_handle<> waiter; // a task awaiting this one
+        CLI *cli = 0;                   // held : release it at the end
+        bool detached = false;          // nothing owns the handle
+
+        struct Final
+        {
+            bool await_ready() const noexcept { return false; }
+
+            std::coroutine_handle<> await_suspend(Handle h) noexcept
+            {
+                promise_type &p = h.promise();
+                std::coroutine_handle<> next = p.waiter ? p.waiter : std::noop_coroutine();
+                CLI *cli = p.cli;
+
+                if (p.detached)
+                {
+                    h.destroy();
+                }
+                if (cli)
+                {
+                    // can run the next command in the CLI
+                    cli_release(cli);
+                }
+                return next;
+            }
+
+            void await_resume() const noexcept { }
+        };
+
+        CliCoro get_return_object() { return CliCoro(Handle::from_promise(*this)); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        Final final_suspend() noexcept { return {}; }
+        void return_void() { }
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    CliCoro(CliCoro &&other) noexcept : handle(other.handle)
+    {
+        other.handle = 0;
+    }
+
+    CliCoro(const CliCoro &) = delete;
+    CliCoro &operator=(const CliCoro &) = delete;
+
+    ~CliCoro()
+    {
+        if (!handle)
+        {
+            return;
+        }
+
+        if (handle.done())
+        {
+            handle.destroy();
+            return;
+        }
+
+        // still running : it frees itself when it finishes
+        handle.promise().detached = true;
+    }
+
+    bool done() const
+    {
+        return !handle || handle.done();
+    }
+
+    // call cli_release(cli) when the task finishes
+    void release(CLI *cli)
+    {
+        if (done())
+        {
+            cli_release(cli);
+            return;
+        }
+        handle.promise().cli = cli;
+    }
+
+    // co_await a task : resumed when it finishes
+    bool await_ready() const noexcept { return done(); }
+    void await_suspend(std::coroutine_handle<> h) noexcept { handle.promise().waiter = h; }
+    void await_resume() const noexcept { }
+
+private:
+    explicit CliCoro(Handle h) : handle(h) { }
+
+    Handle handle;
+};
+
+    /**
+     *  A handler for CliCommand.handler that runs the coroutine \a fn
+     */
+
+template <CliCoro (*fn)(CLI *cli, CliCommand *cmd)>
+void cli_async(CLI *cli, CliCommand *cmd)
+{
+    cli_hold(cli);
+    fn(cli, cmd).release(cli);
+}
+
+    /*
+     *  Awaitables : resumed from the event loop
+     */
+
+class CliEventWait
+{
+public:
+    static void resume(void *arg)
+    {
+        std::coroutine_handle<>::from_address(arg).resume();
+    }
+
+    CliEventWait(CliEvents *events, int fd, int what, unsigned ms)
+    :   events(events), fd(fd), what(what), ms(ms)
+    {
+        ASSERT(events);
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> h)
+    {
+        if (fd < 0)
+        {
+            events->after(events->ctx, ms, resume, h.address());
+        }
+        else
+        {
+            events->watch(events->ctx, fd, what, resume, h.address());
+        }
+    }
+
+    void await_resume() const noexcept { }
+
+private:
+    CliEvents *events;
+    int fd;
+    int what;
+    unsigned ms;
+};
+
+inline CliEventWait cli_sleep(CliEvents *events, unsigned ms)
+{
+    return CliEventWait(events, -1, 0, ms);
+}
+
+inline CliEventWait cli_readable(CliEvents *events, int fd)
+{
+    return CliEventWait(events, fd, CLI_EV_READ, 0);
+}
+
+inline CliEventWait cli_writable(CliEvents *events, int fd)
+{
+    return CliEventWait(events, fd, CLI_EV_WRITE, 0);
+}
+
+#if defined(CLI_NS)
+} // namespace CLI_NS
+#endif
+
+#endif  //  __CLI_CORO_H__
+
+//  FIN
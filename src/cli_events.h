@@ -0,0 +1,35 @@
+#if !defined(__CLI_EVENTS_H__)
+
+#define __CLI_EVENTS_H__
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+    /*
+     *  Event loop hook, used by the awaitables in cli_coro.h
+     *
+     *  Any loop can provide it : each call asks for fn(arg) to be called
+     *  once, from the loop's thread, when the fd is ready or the time is up.
+     *  See src/linux/cli_epoll.h for one built on epoll.
+     */
+
+#define CLI_EV_READ     0x01
+#define CLI_EV_WRITE    0x02
+
+typedef struct
+{
+    // call fn(arg) once, when fd is ready for CLI_EV_READ / CLI_EV_WRITE
+    void (*watch)(void *ctx, int fd, int events, void (*fn)(void *arg), void *arg);
+    // call fn(arg) once, after ms milliseconds
+    void (*after)(void *ctx, unsigned ms, void (*fn)(void *arg), void *arg);
+    void *ctx;
+}   CliEvents;
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif  //  __CLI_EVENTS_H__
+
+//  FIN
@@ -0,0 +1,574 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <cli_debug.h>
+#include "cli_index.h"
+
+    /*
+     *  Radix trie over the names in one level, for autocompletion.
+     *
+     *  The leaves are held sorted by name (then by list position), so each
+     *  node covers a contiguous range of them. Children are stored together,
+     *  ordered by the first char of their edge label.
+     */
+
+typedef struct
+{
+    CliCommand *cmd;
+    size_t pos;         // position in the list
+}   Leaf;
+
+typedef struct
+{
+    const char *label;  // edge from the parent
+    size_t depth;       // length of the prefix at the end of the edge
+    size_t lo, hi;      // range of leaves
+    size_t child;       // first child node
+    size_t children;
+    CliCommand *first;  // first match in list order
+    size_t first_pos;
+}   Node;
+
+typedef struct
+{
+    Leaf *leaves;
+    Node *nodes;
+    size_t used;
+}   Trie;
+
+typedef struct
+{
+    const void *head;   // list head, 0 for an empty slot
+    CliCommand *cmd;    // 0 marks a level that has been indexed
+    size_t hash;
+    Trie *trie;         // level marker only : built on demand
+}   Entry;
+
+struct CliIndex
+{
+    Entry *table;
+    size_t slots;       // power of 2
+    size_t used;
+    unsigned gen;
+};
+
+// bumped on every change to any command list
+static unsigned generation = 1;
+
+static unsigned current()
+{
+    return __atomic_load_n(& generation, __ATOMIC_ACQUIRE);
+}
+
+    /*
+     *  FNV-1a of the name, seeded with the list head
+     */
+
+static size_t hash_name(const void *head, const char *name)
+{
+    size_t h = (size_t) 2166136261u ^ (((uintptr_t) head) >> 3);
+
+    for (; name && *name; name++)
+    {
+        h ^= (unsigned char) *name;
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+    /*
+     *  Find the slot for \a name (or the level marker if \a name is null)
+     */
+
+static Entry *probe(CliIndex *index, const void *head, const char *name, size_t hash)
+{
+    const size_t mask = index->slots - 1;
+
+    for (size_t i = hash & mask; ; i = (i + 1) & mask)
+    {
+        Entry *e = & index->table[i];
+
+        if (!e->head)
+        {
+            return e;
+        }
+
+        if ((e->hash != hash) || (e->head != head))
+        {
+            continue;
+        }
+
+        if (name ? (e->cmd && !strcmp(e->cmd->cmd, name)) : !e->cmd)
+        {
+            return e;
+        }
+    }
+}
+
+static void grow(CliIndex *index)
+{
+    Entry *old = index->table;
+    const size_t slots = index->slots;
+
+    index->slots *= 2;
+    index->table = (Entry*) calloc(index->slots, sizeof(Entry));
+    ASSERT(index->table);
+
+    for (size_t i = 0; i < slots; i++)
+    {
+        Entry *e = & old[i];
+        if (e->head)
+        {
+            *probe(index, e->head, e->cmd ? e->cmd->cmd : 0, e->hash) = *e;
+        }
+    }
+
+    free(old);
+}
+
+static void insert(CliIndex *index, const void *head, CliCommand *cmd, bool replace)
+{
+    // keep the load below 3/4
+    if (((index->used + 1) * 4) > (index->slots * 3))
+    {
+        grow(index);
+    }
+
+    const char *name = cmd ? cmd->cmd : 0;
+    const size_t hash = hash_name(head, name);
+    Entry *e = probe(index, head, name, hash);
+
+    if (!e->head)
+    {
+        e->head = head;
+        e->cmd = cmd;
+        e->hash = hash;
+        index->used += 1;
+    }
+    else if (replace)
+    {
+        e->cmd = cmd;
+    }
+}
+
+static Entry *marker(CliIndex *index, CliCommand **head)
+{
+    Entry *e = probe(index, head, 0, hash_name(head, 0));
+    return e->head ? e : 0;
+}
+
+static void trie_delete(Trie *trie)
+{
+    if (!trie)
+    {
+        return;
+    }
+
+    free(trie->leaves);
+    free(trie->nodes);
+    free(trie);
+}
+
+static void clear(CliIndex *index)
+{
+    for (size_t i = 0; i < index->slots; i++)
+    {
+        trie_delete(index->table[i].trie);
+    }
+
+    memset(index->table, 0, index->slots * sizeof(Entry));
+    index->used = 0;
+}
+
+    /*
+     *  Empty the table if any command list has changed
+     */
+
+static void sync(CliIndex *index)
+{
+    const unsigned gen = current();
+
+    if (index->gen == gen)
+    {
+        return;
+    }
+
+    clear(index);
+    index->gen = gen;
+}
+
+    /*
+     *  Return the marker for the level at \a head, indexing it if needed
+     */
+
+static Entry *level(CliIndex *index, CliCommand **head)
+{
+    sync(index);
+
+    Entry *e = marker(index, head);
+    if (e)
+    {
+        return e;
+    }
+
+    insert(index, head, 0, false);
+    for (CliCommand *cmd = *head; cmd; cmd = cmd->next)
+    {
+        insert(index, head, cmd, false);
+    }
+
+    return marker(index, head);
+}
+
+    /*
+     *  Trie construction
+     */
+
+static int leaf_cmp(const void *a, const void *b)
+{
+    const Leaf *la = (const Leaf*) a;
+    const Leaf *lb = (const Leaf*) b;
+
+    const int cmp = strcmp(la->cmd->cmd, lb->cmd->cmd);
+    if (cmp)
+    {
+        return cmp;
+    }
+    return (la->pos < lb->pos) ? -1 : ((la->pos > lb->pos) ? 1 : 0);
+}
+
+static int pos_cmp(const void *a, const void *b)
+{
+    const Leaf *la = (const Leaf*) a;
+    const Leaf *lb = (const Leaf*) b;
+    return (la->pos < lb->pos) ? -1 : ((la->pos > lb->pos) ? 1 : 0);
+}
+
+static const char *leaf_name(Trie *trie, size_t i)
+{
+    return trie->leaves[i].cmd->cmd;
+}
+
+static void trie_build(Trie *trie, size_t node, size_t lo, size_t hi, size_t depth)
+{
+    Node *n = & trie->nodes[node];
+    n->lo = lo;
+    n->hi = hi;
+    n->depth = depth;
+    n->first = 0;
+    n->first_pos = (size_t) -1;
+
+    // names that end here sort first
+    size_t i = lo;
+    for (; (i < hi) && !leaf_name(trie, i)[depth]; i++)
+    {
+        if (trie->leaves[i].pos < n->first_pos)
+        {
+            n->first = trie->leaves[i].cmd;
+            n->first_pos = trie->leaves[i].pos;
+        }
+    }
+
+    // count the children : one per distinct next char
+    n->children = 0;
+    for (size_t j = i; j < hi; n->children++)
+    {
+        const char c = leaf_name(trie, j)[depth];
+        for (; (j < hi) && (leaf_name(trie, j)[depth] == c); j++)
+            ;
+    }
+
+    n->child = trie->used;
+    trie->used += n->children;
+
+    for (size_t child = n->child; i < hi; child++)
+    {
+        const char c = leaf_name(trie, i)[depth];
+        size_t j = i;
+        for (; (j < hi) && (leaf_name(trie, j)[depth] == c); j++)
+            ;
+
+        // the edge is the common prefix of the first and last (sorted) names
+        const char *a = leaf_name(trie, i);
+        const char *b = leaf_name(trie, j - 1);
+        size_t common = depth;
+        for (; a[common] && (a[common] == b[common]); common++)
+            ;
+
+        trie->nodes[child].label = & a[depth];
+        trie_build(trie, child, i, j, common);
+
+        if (trie->nodes[child].first_pos < n->first_pos)
+        {
+            n->first = trie->nodes[child].first;
+            n->first_pos = trie->nodes[child].first_pos;
+        }
+
+        i = j;
+    }
+}
+
+static Trie *trie_create(CliCommand **head)
+{
+    size_t count = 0;
+    for (CliCommand *cmd = *head; cmd; cmd = cmd->next)
+    {
+        count += 1;
+    }
+
+    Trie *trie = (Trie*) malloc(sizeof(Trie));
+    ASSERT(trie);
+    trie->leaves = (Leaf*) malloc((count + 1) * sizeof(Leaf));
+    trie->nodes = (Node*) malloc(((2 * count) + 1) * sizeof(Node));
+    ASSERT(trie->leaves);
+    ASSERT(trie->nodes);
+
+    size_t pos = 0;
+    for (CliCommand *cmd = *head; cmd; cmd = cmd->next, pos++)
+    {
+        trie->leaves[pos].cmd = cmd;
+        trie->leaves[pos].pos = pos;
+    }
+    qsort(trie->leaves, count, sizeof(Leaf), leaf_cmp);
+
+    trie->nodes[0].label = "";
+    trie->used = 1;
+    trie_build(trie, 0, 0, count, 0);
+
+    return trie;
+}
+
+    /*
+     *  Find the node covering all names starting with \a prefix
+     */
+
+static const Node *trie_walk(Trie *trie, const char *prefix, size_t len)
+{
+    const Node *node = & trie->nodes[0];
+    size_t d = 0;
+
+    while (d < len)
+    {
+        const Node *next = 0;
+        for (size_t i = 0; i < node->children; i++)
+        {
+            const Node *child = & trie->nodes[node->child + i];
+            if (child->label[0] == prefix[d])
+            {
+                next = child;
+                break;
+            }
+        }
+
+        if (!next)
+        {
+            return 0;
+        }
+
+        // match along the edge
+        const size_t edge = next->depth - node->depth;
+        const size_t n = ((len - d) < edge) ? (len - d) : edge;
+        if (strncmp(next->label, & prefix[d], n))
+        {
+            return 0;
+        }
+
+        d += n;
+        node = next;
+    }
+
+    return node;
+}
+
+static Trie *level_trie(CliIndex *index, CliCommand **head)
+{
+    Entry *e = level(index, head);
+    if (!e->trie)
+    {
+        e->trie = trie_create(head);
+    }
+    return e->trie;
+}
+
+    /**
+     * @brief create an index, initially with \a slots entries
+     */
+
+CliIndex *index_create(size_t slots)
+{
+    CliIndex *index = (CliIndex*) malloc(sizeof(CliIndex));
+    ASSERT(index);
+
+    // round up to a power of 2
+    index->slots = 16;
+    while (index->slots < slots)
+    {
+        index->slots *= 2;
+    }
+
+    index->table = (Entry*) calloc(index->slots, sizeof(Entry));
+    ASSERT(index->table);
+    index->used = 0;
+    index->gen = current();
+
+    return index;
+}
+
+void index_delete(CliIndex *index)
+{
+    if (!index)
+    {
+        return;
+    }
+
+    clear(index);
+    free(index->table);
+    free(index);
+}
+
+    /**
+     * @brief find the command \a name in the list at \a head
+     *
+     * The level is indexed on first use. As with list_find(), the first
+     * match in the list wins.
+     */
+
+CliCommand *index_find(CliIndex *index, CliCommand **head, const char *name)
+{
+    ASSERT(index);
+    ASSERT(head);
+    ASSERT(name);
+
+    level(index, head);
+
+    Entry *e = probe(index, head, name, hash_name(head, name));
+    return e->cmd;
+}
+
+    /**
+     * @brief find the names in the list at \a head that start with \a prefix
+     *
+     * Gives the number of matches, the first in list order, and the length
+     * of the longest prefix they all share, in time set by the prefix length.
+     */
+
+void index_match(CliIndex *index, CliCommand **head, const char *prefix, size_t len, CliMatch *match)
+{
+    ASSERT(index);
+    ASSERT(head);
+    ASSERT(match);
+
+    Trie *trie = level_trie(index, head);
+    const Node *node = trie_walk(trie, prefix, len);
+
+    match->count = 0;
+    match->first = 0;
+    match->common = 0;
+
+    if ((!node) || (node->lo == node->hi))
+    {
+        return;
+    }
+
+    match->count = (int) (node->hi - node->lo);
+    match->first = node->first;
+
+    // follow the single branches down
+    while ((node->children == 1) && (trie->nodes[node->child].lo == node->lo))
+    {
+        node = & trie->nodes[node->child];
+    }
+    match->common = node->depth;
+}
+
+    /**
+     * @brief call \a fn for each name in the list at \a head starting with \a prefix
+     *
+     * The names are visited in list order, or by name if \a sorted is set.
+     * Stops if \a fn returns non-zero.
+     */
+
+void index_visit(CliIndex *index, CliCommand **head, const char *prefix, size_t len,
+                    bool sorted, int (*fn)(CliCommand *cmd, void *arg), void *arg)
+{
+    ASSERT(index);
+    ASSERT(head);
+    ASSERT(fn);
+
+    Trie *trie = level_trie(index, head);
+    const Node *node = trie_walk(trie, prefix, len);
+
+    if (!node)
+    {
+        return;
+    }
+
+    const size_t count = node->hi - node->lo;
+    Leaf *leaves = & trie->leaves[node->lo];
+    Leaf *copy = 0;
+
+    if (!sorted)
+    {
+        copy = (Leaf*) malloc((count + 1) * sizeof(Leaf));
+        ASSERT(copy);
+        memcpy(copy, leaves, count * sizeof(Leaf));
+        qsort(copy, count, sizeof(Leaf), pos_cmp);
+        leaves = copy;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (fn(leaves[i].cmd, arg))
+        {
+            break;
+        }
+    }
+
+    free(copy);
+}
+
+    /**
+     * @brief record that \a cmd has been added to the list at \a head
+     *
+     * \a replace is true if \a cmd went in ahead of any others of the same name.
+     * Other indexes are invalidated, \a index (which can be null) is updated.
+     */
+
+void index_add(CliIndex *index, CliCommand **head, CliCommand *cmd, bool replace)
+{
+    ASSERT(head);
+    ASSERT(cmd);
+
+    unsigned gen = index ? index->gen : 0;
+    if (!(index && __atomic_compare_exchange_n(& generation, & gen, gen + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)))
+    {
+        // stale, or no index : just invalidate everyone
+        index_changed();
+        return;
+    }
+
+    index->gen = gen + 1;
+
+    Entry *e = marker(index, head);
+    if (e)
+    {
+        // rebuild the trie when next needed
+        trie_delete(e->trie);
+        e->trie = 0;
+        insert(index, head, cmd, replace);
+    }
+}
+
+    /**
+     * @brief invalidate all indexes
+     */
+
+void index_changed()
+{
+    __atomic_add_fetch(& generation, 1, __ATOMIC_ACQ_REL);
+}
+
+//  FIN
@@ -0,0 +1,49 @@
+
+#if !defined(__CLI_INDEX_H__)
+
+#define __CLI_INDEX_H__
+
+#include "cli.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+    /*
+     *  Hash index of command names.
+     *
+     *  One table covers every level of the command tree : entries are keyed
+     *  on the address of the list head and the command name. Levels are
+     *  indexed the first time they are searched. Any change to any command
+     *  list bumps a global generation, which empties stale tables.
+     *
+     *  Each indexed level can also have a radix trie of its names, built
+     *  the first time it is used for prefix matching (autocompletion).
+     */
+
+typedef struct CliIndex CliIndex;
+
+typedef struct
+{
+    CliCommand *first;  // first match in list order
+    int count;          // number of matches
+    size_t common;      // length of the prefix shared by all the matches
+}   CliMatch;
+
+CliIndex *index_create(size_t slots);
+void index_delete(CliIndex *index);
+
+CliCommand *index_find(CliIndex *index, CliCommand **head, const char *name);
+void index_match(CliIndex *index, CliCommand **head, const char *prefix, size_t len, CliMatch *match);
+void index_visit(CliIndex *index, CliCommand **head, const char *prefix, size_t len,
+                    bool sorted, int (*fn)(CliCommand *cmd, void *arg), void *arg);
+void index_add(CliIndex *index, CliCommand **head, CliCommand *cmd, bool replace);
+void index_changed();
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif  //  __CLI_INDEX_H__
+
+//  FIN
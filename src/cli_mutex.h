@@ -12,10 +12,34 @@ public:
     virtual void lock() = 0;
     virtual void unlock() = 0;
 
+    // shared (read only) access : exclusive unless overridden
+    virtual void lock_shared()
+    {
+        lock();
+    }
+
+    virtual void unlock_shared()
+    {
+        unlock();
+    }
+
     static Mutex *create();
     static Mutex *create_critical_section();
 };
 
+    /*
+     *  Reader-writer lock : any number of lock_shared() holders, or one lock()
+     */
+
+class SharedMutex : public Mutex
+{
+public:
+    virtual void lock_shared() = 0;
+    virtual void unlock_shared() = 0;
+
+    static SharedMutex *create();
+};
+
     /*
      *
      */
@@ -41,6 +65,116 @@ public:
     }
 };
 
+class SharedLock
+{
+    Mutex *mutex;
+public:
+    SharedLock(Mutex *m) : mutex(m)
+    {
+        if (mutex)
+        {
+            mutex->lock_shared();
+        }
+    }
+
+    ~SharedLock()
+    {
+        if (mutex)
+        {
+            mutex->unlock_shared();
+        }
+    }
+};
+
+    /*
+     *  Lock policies : chosen at compile time, so the calls are inlined
+     *  and the null and virtual calls of Lock / Mutex go away.
+     */
+
+class NullLock
+{
+public:
+    void lock() { }
+    void unlock() { }
+};
+
+class SpinLock
+{
+    bool locked;
+public:
+    SpinLock() : locked(false) { }
+
+    void lock()
+    {
+        while (__atomic_test_and_set(& locked, __ATOMIC_ACQUIRE))
+        {
+            while (__atomic_load_n(& locked, __ATOMIC_RELAXED))
+            {
+#if defined(__x86_64__) || defined(__i386__)
+                __builtin_ia32_pause();
+#endif
+            }
+        }
+    }
+
+    void unlock()
+    {
+        __atomic_clear(& locked, __ATOMIC_RELEASE);
+    }
+};
+
+#if defined(__has_include)
+#if __has_include(<pthread.h>)
+
+#include <pthread.h>
+
+class PthreadLock
+{
+    pthread_mutex_t mutex;
+
+    PthreadLock(const PthreadLock&);
+    PthreadLock& operator=(const PthreadLock&);
+public:
+    PthreadLock()
+    {
+        pthread_mutex_init(& mutex, 0);
+    }
+
+    ~PthreadLock()
+    {
+        pthread_mutex_destroy(& mutex);
+    }
+
+    void lock()
+    {
+        pthread_mutex_lock(& mutex);
+    }
+
+    void unlock()
+    {
+        pthread_mutex_unlock(& mutex);
+    }
+};
+
+#endif
+#endif
+
+template <class P>
+class PolicyLock
+{
+    P & policy;
+public:
+    PolicyLock(P & p) : policy(p)
+    {
+        policy.lock();
+    }
+
+    ~PolicyLock()
+    {
+        policy.unlock();
+    }
+};
+
 #else  // __cplusplus
 
 struct Mutex;
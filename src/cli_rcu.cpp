@@ -0,0 +1,291 @@
+
+#include <stdlib.h>
+
+#if defined(__has_include)
+#if __has_include(<sched.h>)
+#include <sched.h>
+#define HAS_SCHED_YIELD
+#endif
+#endif
+
+#include <cli_debug.h>
+#include "cli_rcu.h"
+
+    /*
+     *  One record for each thread that has read : never freed, but reused
+     *  once the thread has exited.
+     */
+
+// the items a thread can pin at once, ie. how deep handlers can nest
+#define RCU_MAX_PINS 8
+
+typedef struct Reader
+{
+    unsigned long epoch;    // 0 when not in a read section
+    int nest;
+    bool used;
+    int pins;
+    const void *pinned[RCU_MAX_PINS];
+    struct Reader *next;
+}   Reader;
+
+static Reader *readers = 0;
+static unsigned long epoch = 1;
+
+class ThreadReader
+{
+public:
+    Reader *reader;
+
+    ThreadReader() : reader(0) { }
+
+    ~ThreadReader()
+    {
+        if (reader)
+        {
+            __atomic_store_n(& reader->used, false, __ATOMIC_RELEASE);
+        }
+    }
+};
+
+static thread_local ThreadReader self;
+
+static void relax()
+{
+#if defined(HAS_SCHED_YIELD)
+    sched_yield();
+#elif defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static Reader *reader()
+{
+    Reader *r = self.reader;
+    if (r)
+    {
+        return r;
+    }
+
+    // reuse a record left by a thread that has exited
+    for (r = __atomic_load_n(& readers, __ATOMIC_ACQUIRE); r; r = r->next)
+    {
+        bool expect = false;
+        if (__atomic_compare_exchange_n(& r->used, & expect, true, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        {
+            self.reader = r;
+            return r;
+        }
+    }
+
+    r = (Reader*) malloc(sizeof(Reader));
+    ASSERT(r);
+    r->epoch = 0;
+    r->nest = 0;
+    r->used = true;
+    r->pins = 0;
+    r->next = __atomic_load_n(& readers, __ATOMIC_RELAXED);
+
+    while (!__atomic_compare_exchange_n(& readers, & r->next, r, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+
+    self.reader = r;
+    return r;
+}
+
+    /**
+     * @brief start a read section
+     */
+
+void rcu_read_lock()
+{
+    Reader *r = reader();
+
+    if (r->nest++)
+    {
+        return;
+    }
+
+    __atomic_store_n(& r->epoch, __atomic_load_n(& epoch, __ATOMIC_ACQUIRE), __ATOMIC_RELAXED);
+    // the epoch must be visible before any list pointer is read
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+    /**
+     * @brief end a read section
+     */
+
+void rcu_read_unlock()
+{
+    Reader *r = self.reader;
+    ASSERT(r && r->nest);
+
+    if (--r->nest)
+    {
+        return;
+    }
+
+    __atomic_store_n(& r->epoch, 0, __ATOMIC_RELEASE);
+}
+
+    /**
+     * @brief start a grace period : returns its target for rcu_passed()
+     *
+     * Call after unlinking an item.
+     */
+
+unsigned long rcu_start()
+{
+    // order the unlink before reading the reader records
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return __atomic_add_fetch(& epoch, 1, __ATOMIC_SEQ_CST);
+}
+
+    /**
+     * @brief return true if the read sections in other threads that started before rcu_start() have ended
+     */
+
+bool rcu_passed(unsigned long target)
+{
+    Reader *me = self.reader;
+
+    for (Reader *r = __atomic_load_n(& readers, __ATOMIC_ACQUIRE); r; r = r->next)
+    {
+        if (r == me)
+        {
+            continue;
+        }
+
+        const unsigned long e = __atomic_load_n(& r->epoch, __ATOMIC_ACQUIRE);
+        if (e && (e < target))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+    /**
+     * @brief wait for all the read sections in other threads that started before this call
+     */
+
+void rcu_synchronize()
+{
+    const unsigned long target = rcu_start();
+
+    while (!rcu_passed(target))
+    {
+        relax();
+    }
+}
+
+    /**
+     * @brief keep \a item in use after the read section ends, until rcu_unpin()
+     *
+     * Call in a read section. Returns false if the thread has no pins left :
+     * the caller must then stay in the read section while it uses \a item.
+     */
+
+bool rcu_pin(const void *item)
+{
+    Reader *r = self.reader;
+    ASSERT(r && r->nest);
+
+    if (r->pins == RCU_MAX_PINS)
+    {
+        return false;
+    }
+
+    // seen by any writer that sees the end of the read section
+    __atomic_store_n(& r->pinned[r->pins], item, __ATOMIC_RELAXED);
+    __atomic_store_n(& r->pins, r->pins + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+    /**
+     * @brief release the last item pinned by rcu_pin()
+     */
+
+void rcu_unpin()
+{
+    Reader *r = self.reader;
+    ASSERT(r && r->pins);
+
+    const int n = r->pins - 1;
+    __atomic_store_n(& r->pins, n, __ATOMIC_RELEASE);
+    __atomic_store_n(& r->pinned[n], (const void*) 0, __ATOMIC_RELEASE);
+}
+
+static bool pinned(Reader *r, const void *item)
+{
+    const int n = __atomic_load_n(& r->pins, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < n; i++)
+    {
+        if (__atomic_load_n(& r->pinned[i], __ATOMIC_ACQUIRE) == item)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+    /**
+     * @brief wait until no other thread has \a item pinned
+     *
+     * Call after rcu_synchronize(), once \a item can no longer be found.
+     */
+
+void rcu_wait_unpinned(const void *item)
+{
+    Reader *me = self.reader;
+
+    for (Reader *r = __atomic_load_n(& readers, __ATOMIC_ACQUIRE); r; r = r->next)
+    {
+        if (r == me)
+        {
+            continue;
+        }
+
+        while (pinned(r, item))
+        {
+            relax();
+        }
+    }
+}
+
+    /*
+     *  Writers : a spinlock, as changes are rare and short
+     */
+
+class SpinMutex : public Mutex
+{
+    bool locked;
+public:
+    SpinMutex() : locked(false) { }
+
+    virtual void lock()
+    {
+        while (__atomic_test_and_set(& locked, __ATOMIC_ACQUIRE))
+        {
+            relax();
+        }
+    }
+
+    virtual void unlock()
+    {
+        __atomic_clear(& locked, __ATOMIC_RELEASE);
+    }
+};
+
+static SpinMutex writer;
+
+    /**
+     * @brief the lock shared by all writers to the command lists
+     */
+
+Mutex *rcu_writer()
+{
+    return & writer;
+}
+
+//  FIN
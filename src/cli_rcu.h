@@ -0,0 +1,71 @@
+
+#if !defined(__CLI_RCU_H__)
+
+#define __CLI_RCU_H__
+
+#include <cli_mutex.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+    /*
+     *  Epoch based read-copy-update for the command lists.
+     *
+     *  Readers bracket their traversal with rcu_read_lock() / rcu_read_unlock()
+     *  and take no lock : the calls only publish the current epoch in a
+     *  per-thread record. Writers serialise on rcu_writer(), publish changes
+     *  with release stores, and call rcu_synchronize() after unlinking an item
+     *  to wait for every reader that might still see it.
+     *
+     *  Read sections nest. rcu_synchronize() does not wait for the calling
+     *  thread, so a command handler can remove commands, but must not use the
+     *  removed ones afterwards.
+     *
+     *  To free items without waiting, a writer notes rcu_start() after
+     *  unlinking them, and frees them once rcu_passed() returns true.
+     *
+     *  Read sections should be short : a writer waits for all of them. To use
+     *  an item for longer, eg. to run a command's handler, a reader pins it
+     *  with rcu_pin() before leaving the read section, and the writer waits
+     *  for that item alone with rcu_wait_unpinned().
+     */
+
+void rcu_read_lock();
+void rcu_read_unlock();
+void rcu_synchronize();
+
+unsigned long rcu_start();
+bool rcu_passed(unsigned long target);
+
+bool rcu_pin(const void *item);
+void rcu_unpin();
+void rcu_wait_unpinned(const void *item);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#if defined(__cplusplus)
+
+Mutex *rcu_writer();
+
+class ReadLock
+{
+public:
+    ReadLock()
+    {
+        rcu_read_lock();
+    }
+
+    ~ReadLock()
+    {
+        rcu_read_unlock();
+    }
+};
+
+#endif  //  __cplusplus
+
+#endif  //  __CLI_RCU_H__
+
+//  FIN
@@ -0,0 +1,80 @@
+
+#include <string.h>
+
+#include <cli_debug.h>
+#include "cli_table.h"
+
+    /*
+     *  Index of the first command whose name, cut to \a len chars,
+     *  is not less than \a s (or greater than it, if \a upper)
+     */
+
+static size_t bound(const CliTable *table, const char *s, size_t len, bool upper)
+{
+    size_t lo = 0;
+    size_t hi = table->count;
+
+    while (lo < hi)
+    {
+        const size_t mid = lo + ((hi - lo) / 2);
+        const int cmp = strncmp(table->cmds[mid].cmd, s, len);
+        if (upper ? (cmp <= 0) : (cmp < 0))
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+    /**
+     * @brief find the command called \a name in \a table, or return 0
+     */
+
+const CliCommand *table_find(const CliTable *table, const char *name)
+{
+    if (!table)
+    {
+        return 0;
+    }
+
+    ASSERT(name);
+    const size_t i = bound(table, name, strlen(name) + 1, false);
+
+    if ((i < table->count) && !strcmp(table->cmds[i].cmd, name))
+    {
+        return & table->cmds[i];
+    }
+    return 0;
+}
+
+    /**
+     * @brief count the commands in \a table whose names start with \a prefix
+     *
+     * The matches are in the table from \a first onwards.
+     */
+
+size_t table_match(const CliTable *table, const char *prefix, size_t len, const CliCommand **first)
+{
+    *first = 0;
+
+    if (!table)
+    {
+        return 0;
+    }
+
+    const size_t lo = bound(table, prefix, len, false);
+    const size_t hi = bound(table, prefix, len, true);
+
+    if (lo < hi)
+    {
+        *first = & table->cmds[lo];
+    }
+    return hi - lo;
+}
+
+//  FIN
@@ -0,0 +1,87 @@
+
+#if !defined(__CLI_TABLE_H__)
+
+#define __CLI_TABLE_H__
+
+#include "cli.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+    /*
+     *  Constant command tables.
+     *
+     *  A CliTable is an array of commands, sorted by name, that is never
+     *  linked or modified at runtime, so it can live in read-only memory.
+     *  Names are found by binary search. Commands in a table must not use
+     *  CliCommand.subcommand or CliCommand.next : subcommands are given as
+     *  another table in CliCommand.subtable, with CLI_SUBTABLE set in
+     *  CliCommand.flags, as the two share a slot.
+     */
+
+const CliCommand *table_find(const CliTable *table, const char *name);
+size_t table_match(const CliTable *table, const char *prefix, size_t len, const CliCommand **first);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#if defined(__cplusplus)
+
+    /*
+     *  Compile time construction (C++14 constexpr) :
+     *
+     *      static constexpr CliCommand gpio[] = {
+     *          { .cmd = "PD5", .handler = gpio_out, .ctx = & pd5, },
+     *          { .cmd = "PA1", .handler = gpio_out, .ctx = & pa1, },
+     *      };
+     *      static constexpr auto gpio_sorted = cli_sort(gpio);
+     *      static constexpr CliTable gpio_table = cli_table(gpio_sorted);
+     *
+     *  cli_sort() is stable, so the first of any duplicate names is found.
+     */
+
+template <size_t N>
+struct CliSorted
+{
+    CliCommand cmds[N];
+};
+
+constexpr int cli_strcmp(const char *a, const char *b)
+{
+    for (; *a && (*a == *b); a++, b++)
+        ;
+    return (unsigned char) *a - (unsigned char) *b;
+}
+
+template <size_t N>
+constexpr CliSorted<N> cli_sort(const CliCommand (&cmds)[N])
+{
+    CliSorted<N> sorted = {};
+
+    // insertion sort
+    for (size_t i = 0; i < N; i++)
+    {
+        size_t j = i;
+        for (; j && (cli_strcmp(sorted.cmds[j-1].cmd, cmds[i].cmd) > 0); j--)
+        {
+            sorted.cmds[j] = sorted.cmds[j-1];
+        }
+        sorted.cmds[j] = cmds[i];
+    }
+
+    return sorted;
+}
+
+template <size_t N>
+constexpr CliTable cli_table(const CliSorted<N> &sorted)
+{
+    return CliTable { sorted.cmds, N };
+}
+
+#endif  //  __cplusplus
+
+#endif  //  __CLI_TABLE_H__
+
+//  FIN
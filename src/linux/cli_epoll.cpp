@@ -0,0 +1,304 @@
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include <cli_debug.h>
+#include "cli_epoll.h"
+
+typedef struct
+{
+    uint64_t when;      // ns, CLOCK_MONOTONIC
+    uint64_t order;     // equal times run in the order they were added
+    void (*fn)(void *arg);
+    void *arg;
+}   Timer;
+
+typedef struct
+{
+    int fd;
+    void (*fn)(void *arg);
+    void *arg;
+}   Watch;
+
+struct CliEpoll
+{
+    int epfd;
+    Timer *timers;      // a min heap
+    int ntimers;
+    int tsize;
+    uint64_t order;
+    int watches;
+    CliEvents events;
+};
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, & ts);
+    return ((uint64_t) ts.tv_sec * 1000000000UL) + (uint64_t) ts.tv_nsec;
+}
+
+    /*
+     *  Timer heap
+     */
+
+static bool before(const Timer *a, const Timer *b)
+{
+    return (a->when < b->when) || ((a->when == b->when) && (a->order < b->order));
+}
+
+static void heap_push(CliEpoll *loop, const Timer *t)
+{
+    if (loop->ntimers == loop->tsize)
+    {
+        loop->tsize = loop->tsize ? (loop->tsize * 2) : 64;
+        loop->timers = (Timer*) realloc(loop->timers, sizeof(Timer) * (size_t) loop->tsize);
+        ASSERT(loop->timers);
+    }
+
+    Timer *heap = loop->timers;
+    int i = loop->ntimers++;
+    while (i)
+    {
+        const int parent = (i - 1) / 2;
+        if (!before(t, & heap[parent]))
+        {
+            break;
+        }
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = *t;
+}
+
+static void heap_pop(CliEpoll *loop, Timer *t)
+{
+    Timer *heap = loop->timers;
+    *t = heap[0];
+
+    const Timer last = heap[--loop->ntimers];
+    const int n = loop->ntimers;
+    int i = 0;
+    while (true)
+    {
+        int child = (2 * i) + 1;
+        if (child >= n)
+        {
+            break;
+        }
+        if (((child + 1) < n) && before(& heap[child + 1], & heap[child]))
+        {
+            child += 1;
+        }
+        if (!before(& heap[child], & last))
+        {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (n)
+    {
+        heap[i] = last;
+    }
+}
+
+    /*
+     *  The CliEvents calls
+     */
+
+static void add_timer(CliEpoll *loop, uint64_t delay_ns, void (*fn)(void *arg), void *arg)
+{
+    const Timer t = { now_ns() + delay_ns, loop->order++, fn, arg };
+    heap_push(loop, & t);
+}
+
+static void ev_after(void *ctx, unsigned ms, void (*fn)(void *arg), void *arg)
+{
+    ASSERT(fn);
+    add_timer((CliEpoll*) ctx, (uint64_t) ms * 1000000UL, fn, arg);
+}
+
+static void ev_watch(void *ctx, int fd, int events, void (*fn)(void *arg), void *arg)
+{
+    CliEpoll *loop = (CliEpoll*) ctx;
+    ASSERT(fn);
+
+    Watch *w = (Watch*) malloc(sizeof(Watch));
+    ASSERT(w);
+    w->fd = fd;
+    w->fn = fn;
+    w->arg = arg;
+
+    struct epoll_event ev;
+    memset(& ev, 0, sizeof(ev));
+    ev.events = EPOLLONESHOT;
+    ev.events |= (events & CLI_EV_READ) ? (uint32_t) EPOLLIN : 0;
+    ev.events |= (events & CLI_EV_WRITE) ? (uint32_t) EPOLLOUT : 0;
+    ev.data.ptr = w;
+
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, & ev) == 0)
+    {
+        loop->watches += 1;
+        return;
+    }
+
+    // one watch per fd
+    ASSERT(errno != EEXIST);
+
+    // eg. a regular file, which is always ready : call it on the next run
+    free(w);
+    add_timer(loop, 0, fn, arg);
+}
+
+    /**
+     * @brief create an event loop
+     */
+
+CliEpoll *cli_epoll_create()
+{
+    CliEpoll *loop = (CliEpoll*) calloc(1, sizeof(CliEpoll));
+    ASSERT(loop);
+
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    ASSERT(loop->epfd >= 0);
+
+    loop->events.watch = ev_watch;
+    loop->events.after = ev_after;
+    loop->events.ctx = loop;
+    return loop;
+}
+
+    /**
+     * @brief free the loop : timers still waiting are dropped, and no fds can be watched
+     */
+
+void cli_epoll_delete(CliEpoll *loop)
+{
+    if (!loop)
+    {
+        return;
+    }
+
+    // the watches are only known to epoll : they leak if any are left
+    ASSERT(!loop->watches);
+
+    close(loop->epfd);
+    free(loop->timers);
+    free(loop);
+}
+
+    /**
+     * @brief the hook to pass to the awaitables in cli_coro.h
+     */
+
+CliEvents *cli_epoll_events(CliEpoll *loop)
+{
+    ASSERT(loop);
+    return & loop->events;
+}
+
+    /**
+     * @brief the epoll fd : readable when a watched fd is ready
+     */
+
+int cli_epoll_fd(CliEpoll *loop)
+{
+    ASSERT(loop);
+    return loop->epfd;
+}
+
+    /**
+     * @brief ms until the next timer, or -1 if there are none
+     */
+
+int cli_epoll_timeout(CliEpoll *loop)
+{
+    ASSERT(loop);
+
+    if (!loop->ntimers)
+    {
+        return -1;
+    }
+
+    const uint64_t now = now_ns();
+    const uint64_t when = loop->timers[0].when;
+    if (when <= now)
+    {
+        return 0;
+    }
+    // round up, so the timer is due when we wake
+    return (int) (((when - now) + 999999UL) / 1000000UL);
+}
+
+    /**
+     * @brief the number of watches and timers waiting
+     */
+
+int cli_epoll_pending(CliEpoll *loop)
+{
+    ASSERT(loop);
+    return loop->watches + loop->ntimers;
+}
+
+    /**
+     * @brief wait up to \a timeout_ms (-1 : forever) and run what is ready
+     *
+     * The wait ends early if a timer is due.
+     *
+     * @return the number of callbacks run, or -1 on error
+     */
+
+int cli_epoll_run(CliEpoll *loop, int timeout_ms)
+{
+    ASSERT(loop);
+
+    const int next = cli_epoll_timeout(loop);
+    if ((next >= 0) && ((timeout_ms < 0) || (next < timeout_ms)))
+    {
+        timeout_ms = next;
+    }
+
+    struct epoll_event events[64];
+    const int n = epoll_wait(loop->epfd, events, 64, timeout_ms);
+    if ((n < 0) && (errno != EINTR))
+    {
+        return -1;
+    }
+
+    // timers added by the callbacks, fd or timer, wait for the next run
+    const uint64_t added = loop->order;
+
+    int count = 0;
+    for (int i = 0; i < n; i++)
+    {
+        Watch *w = (Watch*) events[i].data.ptr;
+        epoll_ctl(loop->epfd, EPOLL_CTL_DEL, w->fd, 0);
+        loop->watches -= 1;
+
+        void (*fn)(void *arg) = w->fn;
+        void *arg = w->arg;
+        free(w);
+        // this can add a new watch on the fd
+        fn(arg);
+        count += 1;
+    }
+
+    const uint64_t now = now_ns();
+    while (loop->ntimers && (loop->timers[0].when <= now) && (loop->timers[0].order < added))
+    {
+        Timer t;
+        heap_pop(loop, & t);
+        t.fn(t.arg);
+        count += 1;
+    }
+
+    return count;
+}
+
+//  FIN
@@ -0,0 +1,38 @@
+#if !defined(__CLI_EPOLL_H__)
+
+#define __CLI_EPOLL_H__
+
+#include "../cli_events.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+    /*
+     *  A CliEvents loop built on epoll, with a heap of timers.
+     *
+     *  An fd can have one watch at a time. Run it with cli_epoll_run(), or
+     *  add cli_epoll_fd() to another loop and call cli_epoll_run(loop, 0)
+     *  when it is readable : the timers need a call by cli_epoll_timeout()
+     *  too. Not thread safe : use it from one thread.
+     */
+
+typedef struct CliEpoll CliEpoll;
+
+CliEpoll *cli_epoll_create();
+void cli_epoll_delete(CliEpoll *loop);
+
+CliEvents *cli_epoll_events(CliEpoll *loop);
+int cli_epoll_fd(CliEpoll *loop);
+int cli_epoll_timeout(CliEpoll *loop);
+int cli_epoll_pending(CliEpoll *loop);
+
+int cli_epoll_run(CliEpoll *loop, int timeout_ms);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif  //  __CLI_EPOLL_H__
+
+//  FIN
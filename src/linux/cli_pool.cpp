@@ -0,0 +1,358 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include <cli_debug.h>
+#include "cli_pool.h"
+
+#if defined(CLI_NS)
+using namespace CLI_NS;
+#endif
+
+typedef struct
+{
+    void (*fn)(void *arg);
+    void *arg;
+}   Job;
+
+    /*
+     *  A worker's deque : a ring of jobs, grown as needed. The owner pushes
+     *  and pops at the tail, thieves take from the head.
+     */
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+    Job *jobs;
+    unsigned size;      // a power of 2
+    unsigned head;      // oldest
+    unsigned tail;      // next free
+    int index;
+    pthread_t thread;
+    CliPool *pool;
+}   Worker;
+
+struct CliPool
+{
+    Worker *workers;
+    int count;
+    unsigned next;      // round robin for outside submits
+    int queued;         // jobs on the deques
+    int active;         // jobs running
+    int sleepers;
+    bool stop;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    pthread_cond_t idle;
+    CliExecutor executor;
+};
+
+static thread_local Worker *self;
+
+static void push(Worker *w, const Job *job)
+{
+    pthread_mutex_lock(& w->mutex);
+
+    if ((w->tail - w->head) == w->size)
+    {
+        // full : copy to a ring twice the size
+        Job *jobs = (Job*) malloc(sizeof(Job) * w->size * 2);
+        ASSERT(jobs);
+        for (unsigned i = 0; i < w->size; i++)
+        {
+            jobs[i] = w->jobs[(w->head + i) & (w->size - 1)];
+        }
+        free(w->jobs);
+        w->jobs = jobs;
+        w->tail = w->size;
+        w->head = 0;
+        w->size *= 2;
+    }
+
+    w->jobs[w->tail++ & (w->size - 1)] = *job;
+    pthread_mutex_unlock(& w->mutex);
+}
+
+static bool pop(Worker *w, Job *job)
+{
+    pthread_mutex_lock(& w->mutex);
+    const bool found = w->head != w->tail;
+    if (found)
+    {
+        *job = w->jobs[--w->tail & (w->size - 1)];
+    }
+    pthread_mutex_unlock(& w->mutex);
+    return found;
+}
+
+static bool steal(Worker *w, Job *job)
+{
+    pthread_mutex_lock(& w->mutex);
+    const bool found = w->head != w->tail;
+    if (found)
+    {
+        *job = w->jobs[w->head++ & (w->size - 1)];
+    }
+    pthread_mutex_unlock(& w->mutex);
+    return found;
+}
+
+    /*
+     *  Take a job : our own newest, or the oldest from the next worker along
+     */
+
+static bool take(CliPool *pool, Job *job)
+{
+    Worker *own = (self && (self->pool == pool)) ? self : 0;
+    bool found = own && pop(own, job);
+
+    const int start = own ? (own->index + 1) : 0;
+    for (int i = 0; !found && (i < pool->count); i++)
+    {
+        Worker *w = & pool->workers[(start + i) % pool->count];
+        if (w != own)
+        {
+            found = steal(w, job);
+        }
+    }
+
+    if (found)
+    {
+        __atomic_add_fetch(& pool->active, 1, __ATOMIC_SEQ_CST);
+        __atomic_sub_fetch(& pool->queued, 1, __ATOMIC_SEQ_CST);
+    }
+    return found;
+}
+
+static void run(CliPool *pool, const Job *job)
+{
+    job->fn(job->arg);
+
+    if ((__atomic_sub_fetch(& pool->active, 1, __ATOMIC_SEQ_CST) == 0) && !__atomic_load_n(& pool->queued, __ATOMIC_SEQ_CST))
+    {
+        pthread_mutex_lock(& pool->mutex);
+        pthread_cond_broadcast(& pool->idle);
+        pthread_mutex_unlock(& pool->mutex);
+    }
+}
+
+static void *worker_thread(void *arg)
+{
+    Worker *w = (Worker*) arg;
+    CliPool *pool = w->pool;
+    self = w;
+
+    while (true)
+    {
+        Job job;
+        if (take(pool, & job))
+        {
+            run(pool, & job);
+            continue;
+        }
+
+        pthread_mutex_lock(& pool->mutex);
+        __atomic_add_fetch(& pool->sleepers, 1, __ATOMIC_SEQ_CST);
+        while (!__atomic_load_n(& pool->queued, __ATOMIC_SEQ_CST) && !pool->stop)
+        {
+            pthread_cond_wait(& pool->wake, & pool->mutex);
+        }
+        __atomic_sub_fetch(& pool->sleepers, 1, __ATOMIC_SEQ_CST);
+        const bool quit = pool->stop && !__atomic_load_n(& pool->queued, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(& pool->mutex);
+
+        if (quit)
+        {
+            break;
+        }
+    }
+
+    self = 0;
+    return 0;
+}
+
+static void executor_submit(void *ctx, void (*fn)(void *arg), void *arg)
+{
+    cli_pool_submit((CliPool*) ctx, fn, arg);
+}
+
+static void executor_yield(void *ctx)
+{
+    if (!cli_pool_help((CliPool*) ctx))
+    {
+        sched_yield();
+    }
+}
+
+    /**
+     * @brief start a pool of \a threads workers : 0 for one per CPU
+     */
+
+CliPool *cli_pool_create(int threads)
+{
+    if (threads <= 0)
+    {
+        threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+        if (threads <= 0)
+        {
+            threads = 1;
+        }
+    }
+
+    CliPool *pool = (CliPool*) calloc(1, sizeof(CliPool));
+    ASSERT(pool);
+
+    pthread_mutex_init(& pool->mutex, 0);
+    pthread_cond_init(& pool->wake, 0);
+    pthread_cond_init(& pool->idle, 0);
+
+    pool->executor.submit = executor_submit;
+    pool->executor.ready = 0;
+    pool->executor.yield = executor_yield;
+    pool->executor.ctx = pool;
+
+    pool->count = threads;
+    pool->workers = (Worker*) calloc((size_t) threads, sizeof(Worker));
+    ASSERT(pool->workers);
+
+    for (int i = 0; i < threads; i++)
+    {
+        Worker *w = & pool->workers[i];
+        pthread_mutex_init(& w->mutex, 0);
+        w->size = 16;
+        w->jobs = (Job*) malloc(sizeof(Job) * w->size);
+        ASSERT(w->jobs);
+        w->index = i;
+        w->pool = pool;
+    }
+
+    // start them once all the deques exist
+    for (int i = 0; i < threads; i++)
+    {
+        Worker *w = & pool->workers[i];
+        const int err = pthread_create(& w->thread, 0, worker_thread, w);
+        ASSERT(err == 0);
+    }
+
+    return pool;
+}
+
+    /**
+     * @brief run the jobs still queued, then stop the workers and free the pool
+     */
+
+void cli_pool_delete(CliPool *pool)
+{
+    if (!pool)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(& pool->mutex);
+    pool->stop = true;
+    pthread_cond_broadcast(& pool->wake);
+    pthread_mutex_unlock(& pool->mutex);
+
+    for (int i = 0; i < pool->count; i++)
+    {
+        pthread_join(pool->workers[i].thread, 0);
+    }
+
+    // the others may steal from a worker until they have all stopped
+    for (int i = 0; i < pool->count; i++)
+    {
+        Worker *w = & pool->workers[i];
+        pthread_mutex_destroy(& w->mutex);
+        free(w->jobs);
+    }
+    free(pool->workers);
+
+    pthread_cond_destroy(& pool->idle);
+    pthread_cond_destroy(& pool->wake);
+    pthread_mutex_destroy(& pool->mutex);
+    free(pool);
+}
+
+    /**
+     * @brief queue fn(arg) to run on one of the workers
+     */
+
+void cli_pool_submit(CliPool *pool, void (*fn)(void *arg), void *arg)
+{
+    ASSERT(pool);
+    ASSERT(fn);
+
+    Worker *w = self;
+    if (!(w && (w->pool == pool)))
+    {
+        const unsigned n = __atomic_fetch_add(& pool->next, 1, __ATOMIC_RELAXED);
+        w = & pool->workers[n % (unsigned) pool->count];
+    }
+
+    // count it first, so queued never goes below the jobs in the deques
+    __atomic_add_fetch(& pool->queued, 1, __ATOMIC_SEQ_CST);
+
+    const Job job = { fn, arg };
+    push(w, & job);
+
+    if (__atomic_load_n(& pool->sleepers, __ATOMIC_SEQ_CST))
+    {
+        pthread_mutex_lock(& pool->mutex);
+        pthread_cond_signal(& pool->wake);
+        pthread_mutex_unlock(& pool->mutex);
+    }
+}
+
+    /**
+     * @brief run one queued job on the calling thread
+     *
+     * @return false if there was nothing to run
+     */
+
+bool cli_pool_help(CliPool *pool)
+{
+    ASSERT(pool);
+
+    Job job;
+    if (!take(pool, & job))
+    {
+        return false;
+    }
+    run(pool, & job);
+    return true;
+}
+
+    /**
+     * @brief wait until every job has run : not from a worker
+     */
+
+void cli_pool_wait(CliPool *pool)
+{
+    ASSERT(pool);
+    ASSERT(!(self && (self->pool == pool)));
+
+    pthread_mutex_lock(& pool->mutex);
+    while (__atomic_load_n(& pool->queued, __ATOMIC_SEQ_CST) || __atomic_load_n(& pool->active, __ATOMIC_SEQ_CST))
+    {
+        pthread_cond_wait(& pool->idle, & pool->mutex);
+    }
+    pthread_mutex_unlock(& pool->mutex);
+}
+
+    /**
+     * @brief an executor for cli_set_executor() that submits to the pool
+     *
+     * It has no ready callback : copy it and add one to be told when
+     * output is waiting.
+     */
+
+CliExecutor *cli_pool_executor(CliPool *pool)
+{
+    ASSERT(pool);
+    return & pool->executor;
+}
+
+//  FIN
@@ -0,0 +1,38 @@
+#if !defined(__CLI_POOL_H__)
+
+#define __CLI_POOL_H__
+
+#include "../cli.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+    /*
+     *  Work-stealing thread pool, to run command handlers off the input
+     *  thread : see cli_set_executor().
+     *
+     *  Each worker has a deque of jobs. A worker takes the newest job from
+     *  its own deque, and when that is empty steals the oldest from the
+     *  others, so one slow job only holds up its own worker. Jobs submitted
+     *  from a worker go on its own deque, others are spread round the workers.
+     */
+
+typedef struct CliPool CliPool;
+
+CliPool *cli_pool_create(int threads);
+void cli_pool_delete(CliPool *pool);
+
+void cli_pool_submit(CliPool *pool, void (*fn)(void *arg), void *arg);
+bool cli_pool_help(CliPool *pool);
+void cli_pool_wait(CliPool *pool);
+
+CliExecutor *cli_pool_executor(CliPool *pool);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif  //  __CLI_POOL_H__
+
+//  FIN
@@ -0,0 +1,65 @@
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <cli_debug.h>
+#include "cli_script.h"
+
+#if defined(CLI_NS)
+using namespace CLI_NS;
+#endif
+
+    /**
+     * @brief run the commands in the file \a path
+     */
+
+int cli_run_script(CLI *cli, const char *path, unsigned flags)
+{
+    ASSERT(cli);
+    ASSERT(path);
+
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+
+    if ((fd < 0) || (fstat(fd, & st) < 0))
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        cli_print(cli, "error opening file '%s'%s", path, cli->eol);
+        cli_set_status(cli, 1);
+        return -1;
+    }
+
+    const size_t size = (size_t) st.st_size;
+    if (!size)
+    {
+        close(fd);
+        cli_set_status(cli, 0);
+        return 0;
+    }
+
+    void *map = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping holds its own reference to the file
+    close(fd);
+
+    if (map == MAP_FAILED)
+    {
+        // eg. a pipe
+        cli_print(cli, "error mapping file '%s'%s", path, cli->eol);
+        cli_set_status(cli, 1);
+        return -1;
+    }
+
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    const int failed = cli_run_lines(cli, path, (const char*) map, size, flags);
+
+    munmap(map, size);
+    return failed;
+}
+
+//  FIN
@@ -0,0 +1,25 @@
+#if !defined(__CLI_SCRIPT_H__)
+
+#define __CLI_SCRIPT_H__
+
+#include "../cli.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+    /*
+     *  Run a file of commands, mapped into memory and passed to
+     *  cli_run_lines() : see there for the flags and the return value.
+     *  Returns -1 if the file can't be read.
+     */
+
+int cli_run_script(CLI *cli, const char *path, unsigned flags);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif  //  __CLI_SCRIPT_H__
+
+//  FIN
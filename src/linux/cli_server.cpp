@@ -0,0 +1,794 @@
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <cli_debug.h>
+#include "../list2.h"
+#include "../list_stack.h"
+#include "cli_server.h"
+
+#if defined(CLI_NS)
+using namespace CLI_NS;
+#endif
+
+    /*
+     *  Everything registered with epoll starts with an Endpoint
+     */
+
+typedef enum { LISTENER, SESSION, WAKE } Kind;
+
+typedef struct
+{
+    int fd;
+    Kind kind;
+}   Endpoint;
+
+typedef struct Session
+{
+    Endpoint ep;
+    struct Session *next;
+    struct Session *prev;
+    struct Session *ready_next; // on CliServer.ready
+    int queued;                 // on CliServer.ready
+    CliServer *server;
+    CLI cli;
+    CliOutput out;
+    char *wbuf;         // output not yet sent
+    size_t wsize;
+    size_t wused;
+    size_t wsent;
+    bool polling_out;   // waiting for EPOLLOUT
+    bool hangup;        // close once the output has gone
+    bool dead;          // closed : freed at the end of the pass
+}   Session;
+
+#define MAX_LISTEN 8
+#define MAX_EVENTS 256
+#define READ_SIZE 4096
+
+struct CliServer
+{
+    CliServerConfig config;
+    int epfd;
+    Endpoint wake;
+    Endpoint listeners[MAX_LISTEN];
+    int nlisten;
+    char *unix_paths[MAX_LISTEN];
+    Session *sessions;
+    Session *dead;      // closed this pass, linked through next
+    Session *parked;    // closed, with handlers still to finish
+    ListStack ready;    // output from the executor waiting
+    CliExecutor executor;
+    int count;
+    bool stop;
+    bool paused;        // out of fds : the listeners are off till a session closes
+    char rbuf[READ_SIZE];
+};
+
+static Session **session_next(Session *s)
+{
+    return & s->next;
+}
+
+static Session **session_prev(Session *s)
+{
+    return & s->prev;
+}
+
+static Session **session_ready_next(Session *s)
+{
+    return & s->ready_next;
+}
+
+static int set_events(CliServer *server, Endpoint *ep, uint32_t events, int op)
+{
+    struct epoll_event ev;
+    memset(& ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = ep;
+    return epoll_ctl(server->epfd, op, ep->fd, & ev);
+}
+
+    /*
+     *  Session output : append to the write buffer
+     */
+
+static bool reserve(Session *s, size_t len)
+{
+    const size_t need = s->wused + len;
+    if (need > s->server->config.out_limit)
+    {
+        // the client isn't reading : drop it
+        s->hangup = true;
+        s->wused = s->wsent;
+        return false;
+    }
+
+    if (need > s->wsize)
+    {
+        size_t size = s->wsize ? s->wsize : 256;
+        while (size < need)
+        {
+            size *= 2;
+        }
+        s->wbuf = (char*) realloc(s->wbuf, size);
+        ASSERT(s->wbuf);
+        s->wsize = size;
+    }
+    return true;
+}
+
+static int session_write(void *ctx, const void *data, size_t len)
+{
+    Session *s = (Session*) ctx;
+
+    // len 0 : wbuf may not be allocated yet
+    if (s->hangup || !len || !reserve(s, len))
+    {
+        return 0;
+    }
+
+    memcpy(& s->wbuf[s->wused], data, len);
+    s->wused += len;
+    return (int) len;
+}
+
+static int session_writev(void *ctx, const struct iovec *iov, int count)
+{
+    int total = 0;
+    for (int i = 0; i < count; i++)
+    {
+        total += session_write(ctx, iov[i].iov_base, iov[i].iov_len);
+    }
+    return total;
+}
+
+static int session_fprintf(void *ctx, const char *fmt, va_list va)
+{
+    Session *s = (Session*) ctx;
+
+    va_list copy;
+    va_copy(copy, va);
+    const int n = vsnprintf(0, 0, fmt, copy);
+    va_end(copy);
+
+    if ((n <= 0) || s->hangup || !reserve(s, (size_t) n + 1))
+    {
+        return 0;
+    }
+
+    vsnprintf(& s->wbuf[s->wused], (size_t) n + 1, fmt, va);
+    s->wused += (size_t) n;
+    return n;
+}
+
+    /*
+     *  Session lifetime
+     */
+
+static void listen_events(CliServer *server, uint32_t events)
+{
+    for (int i = 0; i < server->nlisten; i++)
+    {
+        set_events(server, & server->listeners[i], events, EPOLL_CTL_MOD);
+    }
+}
+
+static void session_close(Session *s)
+{
+    if (s->dead)
+    {
+        return;
+    }
+
+    CliServer *server = s->server;
+    if (server->config.on_close)
+    {
+        server->config.on_close(& s->cli, server->config.arg);
+    }
+
+    epoll_ctl(server->epfd, EPOLL_CTL_DEL, s->ep.fd, 0);
+    close(s->ep.fd);
+    s->ep.fd = -1;
+    s->dead = true;
+
+    if (server->paused)
+    {
+        // an fd is free : accept again
+        listen_events(server, EPOLLIN);
+        server->paused = false;
+    }
+
+    list2_remove((pList*) & server->sessions, (pList) s, (pnext) session_next, (pnext) session_prev, 0);
+    server->count -= 1;
+
+    // events for it may still be pending in this pass
+    s->next = server->dead;
+    server->dead = s;
+}
+
+static void session_free(Session *s)
+{
+    free(s->wbuf);
+    free(s);
+}
+
+static void session_flush(Session *s)
+{
+    while (s->wsent < s->wused)
+    {
+        const ssize_t n = send(s->ep.fd, & s->wbuf[s->wsent], s->wused - s->wsent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            {
+                if (!s->polling_out)
+                {
+                    set_events(s->server, & s->ep, EPOLLIN | EPOLLOUT | EPOLLRDHUP, EPOLL_CTL_MOD);
+                    s->polling_out = true;
+                }
+                return;
+            }
+            session_close(s);
+            return;
+        }
+        s->wsent += (size_t) n;
+    }
+
+    s->wused = s->wsent = 0;
+
+    if (s->polling_out)
+    {
+        set_events(s->server, & s->ep, EPOLLIN | EPOLLRDHUP, EPOLL_CTL_MOD);
+        s->polling_out = false;
+    }
+
+    if (s->hangup)
+    {
+        session_close(s);
+    }
+}
+
+static void session_open(CliServer *server, int fd)
+{
+    Session *s = (Session*) calloc(1, sizeof(Session));
+    ASSERT(s);
+
+    s->ep.fd = fd;
+    s->ep.kind = SESSION;
+    s->server = server;
+
+    s->out.fprintf = session_fprintf;
+    s->out.ctx = s;
+    s->out.write = session_write;
+    s->out.writev = session_writev;
+
+    CliServerConfig *config = & server->config;
+    s->cli.output = & s->out;
+    // no prompt from cli_init() : on_open may set machine mode
+    s->cli.prompt = "";
+    s->cli.eol = config->eol;
+    cli_init(& s->cli, config->line_size, 0);
+    s->cli.prompt = config->prompt;
+    s->cli.echo = config->echo;
+    s->cli.head = config->head;
+    cli_set_table(& s->cli, config->table);
+    if (config->executor)
+    {
+        cli_set_executor(& s->cli, & server->executor);
+    }
+
+    list2_push((pList*) & server->sessions, (pList) s, (pnext) session_next, (pnext) session_prev, 0);
+    server->count += 1;
+
+    if (set_events(server, & s->ep, EPOLLIN | EPOLLRDHUP, EPOLL_CTL_ADD) < 0)
+    {
+        session_close(s);
+        return;
+    }
+
+    if (config->on_open)
+    {
+        config->on_open(& s->cli, config->arg);
+    }
+
+    if (!s->cli.marker)
+    {
+        cli_puts(& s->cli, s->cli.prompt);
+    }
+    session_flush(s);
+}
+
+    /*
+     *  The executor : the config one, with a ready callback that wakes
+     *  the event loop
+     */
+
+static void executor_submit(void *ctx, void (*fn)(void *arg), void *arg)
+{
+    CliExecutor *executor = ((CliServer*) ctx)->config.executor;
+    executor->submit(executor->ctx, fn, arg);
+}
+
+static void executor_yield(void *ctx)
+{
+    CliExecutor *executor = ((CliServer*) ctx)->config.executor;
+    if (executor->yield)
+    {
+        executor->yield(executor->ctx);
+    }
+}
+
+static void wake(CliServer *server)
+{
+    const uint64_t one = 1;
+    ssize_t n = write(server->wake.fd, & one, sizeof(one));
+    UNUSED(n);
+}
+
+static void executor_ready(void *ctx, CLI *cli)
+{
+    // called on a worker thread
+    CliServer *server = (CliServer*) ctx;
+    // not cli->output : the input thread can swap that
+    Session *s = (Session*) ((char*) cli - offsetof(Session, cli));
+
+    if (!__atomic_exchange_n(& s->queued, 1, __ATOMIC_ACQ_REL))
+    {
+        list_stack_push(& server->ready, (pList) s, (pnext) session_ready_next);
+        wake(server);
+    }
+}
+
+static void run_ready(CliServer *server)
+{
+    Session *s = (Session*) list_stack_pop_all(& server->ready);
+    while (s)
+    {
+        Session *next = s->ready_next;
+        // clear it first : more output may follow
+        __atomic_store_n(& s->queued, 0, __ATOMIC_RELEASE);
+        if (!s->dead)
+        {
+            cli_poll(& s->cli);
+            session_flush(s);
+        }
+        s = next;
+    }
+}
+
+static void session_read(Session *s)
+{
+    CliServer *server = s->server;
+
+    while (!s->dead && !s->hangup)
+    {
+        const ssize_t n = read(s->ep.fd, server->rbuf, sizeof(server->rbuf));
+        if (n > 0)
+        {
+            cli_process_buffer(& s->cli, server->rbuf, (size_t) n);
+            if ((size_t) n < sizeof(server->rbuf))
+            {
+                // probably all there is
+                break;
+            }
+            continue;
+        }
+        if ((n < 0) && (errno == EINTR))
+        {
+            continue;
+        }
+        if ((n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+        {
+            break;
+        }
+        // closed by the client
+        session_close(s);
+        return;
+    }
+
+    session_flush(s);
+}
+
+static void accept_all(CliServer *server, Endpoint *ep)
+{
+    while (true)
+    {
+        const int fd = accept4(ep->fd, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if ((errno == EMFILE) || (errno == ENFILE))
+            {
+                // the connection stays in the backlog, so the listener
+                // would fire again at once : wait for a session to close
+                listen_events(server, 0);
+                server->paused = true;
+            }
+            return;
+        }
+        session_open(server, fd);
+    }
+}
+
+    /**
+     * @brief create a server : add listeners with cli_server_listen_*()
+     */
+
+CliServer *cli_server_create(const CliServerConfig *config)
+{
+    ASSERT(config);
+
+    CliServer *server = (CliServer*) calloc(1, sizeof(CliServer));
+    ASSERT(server);
+
+    server->config = *config;
+    if (!server->config.prompt)
+    {
+        server->config.prompt = "> ";
+    }
+    if (!server->config.eol)
+    {
+        server->config.eol = "\r\n";
+    }
+    if (!server->config.line_size)
+    {
+        server->config.line_size = 128;
+    }
+    if (!server->config.out_limit)
+    {
+        server->config.out_limit = 64 * 1024;
+    }
+
+    server->epfd = epoll_create1(EPOLL_CLOEXEC);
+    ASSERT(server->epfd >= 0);
+
+    server->wake.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ASSERT(server->wake.fd >= 0);
+    server->wake.kind = WAKE;
+    set_events(server, & server->wake, EPOLLIN, EPOLL_CTL_ADD);
+
+    server->executor.submit = executor_submit;
+    server->executor.ready = executor_ready;
+    server->executor.yield = executor_yield;
+    server->executor.ctx = server;
+
+    return server;
+}
+
+    /*
+     *  Free the closed sessions. One with handlers still running is parked
+     *  until they finish, unless \a wait is set : the last one's ready call
+     *  wakes the loop to try again. Waiting here would hold up the others.
+     */
+
+static void reap(CliServer *server, bool wait)
+{
+    if (!server->dead && !server->parked)
+    {
+        return;
+    }
+
+    Session *closing = 0;
+    Session *parked = 0;
+    Session *lists[] = { server->dead, server->parked };
+    server->dead = 0;
+    server->parked = 0;
+
+    for (int i = 0; i < 2; i++)
+    {
+        Session *s = lists[i];
+        while (s)
+        {
+            Session *next = s->next;
+            cli_poll(& s->cli);
+            if (!wait && cli_pending(& s->cli))
+            {
+                s->next = parked;
+                parked = s;
+            }
+            else
+            {
+                // at most the ready calls are left to wait for
+                cli_close(& s->cli);
+                s->next = closing;
+                closing = s;
+            }
+            s = next;
+        }
+    }
+    server->parked = parked;
+
+    if (!closing)
+    {
+        return;
+    }
+
+    // so nothing more can be added to the ready list
+    run_ready(server);
+
+    while (closing)
+    {
+        Session *s = closing;
+        closing = s->next;
+        session_free(s);
+    }
+}
+
+    /**
+     * @brief close all the sessions and listeners, and free the server
+     */
+
+void cli_server_delete(CliServer *server)
+{
+    if (!server)
+    {
+        return;
+    }
+
+    while (server->sessions)
+    {
+        session_close(server->sessions);
+    }
+    reap(server, true);
+
+    for (int i = 0; i < server->nlisten; i++)
+    {
+        close(server->listeners[i].fd);
+        if (server->unix_paths[i])
+        {
+            unlink(server->unix_paths[i]);
+            free(server->unix_paths[i]);
+        }
+    }
+
+    close(server->wake.fd);
+    close(server->epfd);
+    free(server);
+}
+
+static int add_listener(CliServer *server, int fd, const char *path)
+{
+    if ((server->nlisten >= MAX_LISTEN) || (listen(fd, SOMAXCONN) < 0))
+    {
+        close(fd);
+        return -1;
+    }
+
+    Endpoint *ep = & server->listeners[server->nlisten];
+    ep->fd = fd;
+    ep->kind = LISTENER;
+    if (set_events(server, ep, EPOLLIN, EPOLL_CTL_ADD) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    server->unix_paths[server->nlisten] = path ? strdup(path) : 0;
+    server->nlisten += 1;
+    return 0;
+}
+
+    /**
+     * @brief listen on the Unix socket at \a path, replacing any old socket file
+     *
+     * @return 0, or -1 on error (see errno)
+     */
+
+int cli_server_listen_unix(CliServer *server, const char *path)
+{
+    ASSERT(server);
+    ASSERT(path);
+
+    struct sockaddr_un addr;
+    memset(& addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    unlink(path);
+    if (bind(fd, (struct sockaddr*) & addr, sizeof(addr)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return add_listener(server, fd, path);
+}
+
+    /**
+     * @brief listen on TCP \a port of the loopback interface
+     *
+     * @return the port (useful if \a port is 0), or -1 on error (see errno)
+     */
+
+int cli_server_listen_tcp(CliServer *server, int port)
+{
+    ASSERT(server);
+
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    const int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, & on, sizeof(on));
+
+    struct sockaddr_in addr;
+    memset(& addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((uint16_t) port);
+
+    socklen_t len = sizeof(addr);
+    if ((bind(fd, (struct sockaddr*) & addr, len) < 0) ||
+        (getsockname(fd, (struct sockaddr*) & addr, & len) < 0))
+    {
+        close(fd);
+        return -1;
+    }
+
+    if (add_listener(server, fd, 0) < 0)
+    {
+        return -1;
+    }
+    return ntohs(addr.sin_port);
+}
+
+    /**
+     * @brief wait up to \a timeout_ms for events (-1 : forever), and handle them
+     *
+     * @return the number of events, or -1 on error
+     */
+
+int cli_server_run(CliServer *server, int timeout_ms)
+{
+    ASSERT(server);
+
+    struct epoll_event events[MAX_EVENTS];
+    const int n = epoll_wait(server->epfd, events, MAX_EVENTS, timeout_ms);
+    if (n < 0)
+    {
+        return (errno == EINTR) ? 0 : -1;
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        Endpoint *ep = (Endpoint*) events[i].data.ptr;
+        const uint32_t ev = events[i].events;
+
+        switch (ep->kind)
+        {
+            case LISTENER :
+            {
+                accept_all(server, ep);
+                break;
+            }
+            case WAKE :
+            {
+                uint64_t count;
+                while (read(ep->fd, & count, sizeof(count)) > 0)
+                    ;
+                run_ready(server);
+                break;
+            }
+            case SESSION :
+            {
+                Session *s = (Session*) ep;
+                if (s->dead)
+                {
+                    break;
+                }
+                if (ev & EPOLLIN)
+                {
+                    session_read(s);
+                }
+                if ((ev & EPOLLOUT) && !s->dead)
+                {
+                    session_flush(s);
+                }
+                if ((ev & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) && !s->dead && !(ev & EPOLLIN))
+                {
+                    session_close(s);
+                }
+                break;
+            }
+            default :
+            {
+                ASSERT(0);
+            }
+        }
+    }
+
+    reap(server, false);
+    return n;
+}
+
+    /**
+     * @brief run until cli_server_stop() is called
+     */
+
+void cli_server_loop(CliServer *server)
+{
+    ASSERT(server);
+
+    while (!__atomic_load_n(& server->stop, __ATOMIC_ACQUIRE))
+    {
+        if (cli_server_run(server, -1) < 0)
+        {
+            break;
+        }
+    }
+    __atomic_store_n(& server->stop, false, __ATOMIC_RELEASE);
+}
+
+    /**
+     * @brief make cli_server_loop() return : can be called from any thread
+     */
+
+void cli_server_stop(CliServer *server)
+{
+    ASSERT(server);
+
+    __atomic_store_n(& server->stop, true, __ATOMIC_RELEASE);
+    wake(server);
+}
+
+    /**
+     * @brief the number of open sessions
+     */
+
+int cli_server_sessions(CliServer *server)
+{
+    ASSERT(server);
+    return server->count;
+}
+
+    /**
+     * @brief close the session running \a cli, once its output has been sent
+     *
+     * For use in command handlers : set CLI_INLINE on the command if the
+     * server has an executor.
+     */
+
+void cli_server_hangup(CLI *cli)
+{
+    ASSERT(cli);
+    ASSERT(cli->output && (cli->output->fprintf == session_fprintf));
+
+    Session *s = (Session*) cli->output->ctx;
+    s->hangup = true;
+}
+
+//  FIN
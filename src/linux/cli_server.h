@@ -0,0 +1,75 @@
+#if !defined(__CLI_SERVER_H__)
+
+#define __CLI_SERVER_H__
+
+#include "../cli.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+    /*
+     *  Multi-session CLI server : one epoll event loop, listening on Unix
+     *  sockets and / or TCP loopback ports.
+     *
+     *  Each connection gets its own CLI, with a CliOutput that collects
+     *  the output in a per-session buffer. Input is fed to the CLI a read()
+     *  at a time, then the output is sent with non-blocking writes; any
+     *  left over is sent when the socket can take it. A session whose
+     *  buffer grows past out_limit is dropped.
+     *
+     *  The sessions share the command tree at head, as in TEST(CLI, Two).
+     *  cli.head is copied when a session starts, so to change the tree
+     *  for open sessions change the lists below a fixed first command.
+     *
+     *  With an executor, handlers run off the event loop (see
+     *  cli_set_executor()) and a slow one no longer holds up the other
+     *  sessions. The loop is woken to send their output. A session closed
+     *  while its handlers run is freed once they have finished.
+     *
+     *  Out of fds, the listeners stop accepting till a session closes : new
+     *  connections wait in the backlog.
+     *
+     *  Not thread safe, other than cli_server_stop() : run it from one thread.
+     */
+
+typedef struct CliServer CliServer;
+
+typedef struct
+{
+    CliCommand *head;       // the shared commands
+    const CliTable *table;  // optional, see cli_set_table()
+    const char *prompt;
+    const char *eol;
+    bool echo;
+    size_t line_size;       // CLI line buffer : default 128
+    size_t out_limit;       // max output held for a session : default 64k
+    // optional : called as each session starts, eg. to set CLI.ctx or
+    // cli_set_machine(). The first prompt is written after it
+    void (*on_open)(CLI *cli, void *arg);
+    void (*on_close)(CLI *cli, void *arg);
+    void *arg;
+    // optional : run the handlers on this, eg. cli_pool_executor()
+    CliExecutor *executor;
+}   CliServerConfig;
+
+CliServer *cli_server_create(const CliServerConfig *config);
+void cli_server_delete(CliServer *server);
+
+int cli_server_listen_unix(CliServer *server, const char *path);
+int cli_server_listen_tcp(CliServer *server, int port);
+
+int cli_server_run(CliServer *server, int timeout_ms);
+void cli_server_loop(CliServer *server);
+void cli_server_stop(CliServer *server);
+
+int cli_server_sessions(CliServer *server);
+void cli_server_hangup(CLI *cli);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif  //  __CLI_SERVER_H__
+
+//  FIN
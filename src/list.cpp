@@ -12,6 +12,22 @@ namespace CLI_NS {
   #define __has_attribute(x) 0  
 #endif
 
+    /*
+     *  Links are read with acquire and written with release semantics,
+     *  so the lists can be traversed without a lock (see cli_rcu.h)
+     *  while a writer holds one.
+     */
+
+static inline pList load(pList *link)
+{
+    return __atomic_load_n(link, __ATOMIC_ACQUIRE);
+}
+
+static inline void publish(pList *link, pList w)
+{
+    __atomic_store_n(link, w, __ATOMIC_RELEASE);
+}
+
 static void _list_insert(pList* head, pList w, pList *next)
 {
     ASSERT(head);
@@ -19,7 +35,7 @@ static void _list_insert(pList* head, pList w, pList *next)
     ASSERT(next);
 
     *next = *head;
-    *head = w;
+    publish(head, w);
 }
 
     /**
@@ -39,9 +55,9 @@ int list_size(pList *head, pnext next_fn, Mutex *mutex)
 
     int count = 0;
 
-    Lock lock(mutex);
+    SharedLock lock(mutex);
 
-    for (; *head; head = next_fn(*head))
+    for (pList w = load(head); w; w = load(next_fn(w)))
     {
         count += 1;
     }
@@ -94,6 +110,37 @@ void list_append(pList *head, pList w, pnext next_fn, Mutex *mutex)
     _list_insert(head, w, next_fn(w));
 }
 
+/**
+ * @brief insert item at the end of the list, looking for the end from \a from
+ *
+ * @param head pointer to the head of the list
+ * @param from an item on the list, or null to start at the head
+ * @param w item to add
+ * @param next_fn
+ * @param mutex optional
+ */
+
+void list_append_from(pList *head, pList from, pList w, pnext next_fn, Mutex *mutex)
+{
+    ASSERT(head);
+    ASSERT(w);
+    ASSERT(next_fn);
+
+    Lock lock(mutex);
+
+    if (from)
+    {
+        head = next_fn(from);
+    }
+
+    for (; *head; head = next_fn(*head))
+    {
+        ;
+    }
+
+    _list_insert(head, w, next_fn(w));
+}
+
 /**
  * @brief insert item into a sorted list
  *
@@ -144,7 +191,7 @@ pList list_pop(pList *head, pnext next_fn, Mutex *mutex)
     if (w)
     {
         pList* next = next_fn(w);
-        *head = *next;
+        publish(head, *next);
         *next = 0;
     }
 
@@ -186,6 +233,40 @@ bool list_remove(pList *head, pList w, pnext next_fn, Mutex *mutex)
     return found;
 }
 
+/**
+ * @brief remove an item from the list, leaving its next pointer intact
+ *
+ * A reader that is on the item can still carry on down the list.
+ * Clear the next pointer once no reader can see the item.
+ *
+ * @param head pointer to the head of the list
+ * @param w item to remove
+ * @param next_fn
+ * @param mutex optional
+ *
+ * @return true if item was removed
+ */
+
+bool list_unlink(pList *head, pList w, pnext next_fn, Mutex *mutex)
+{
+    ASSERT(head);
+    ASSERT(w);
+    ASSERT(next_fn);
+
+    Lock lock(mutex);
+
+    for (; *head; head = next_fn(*head))
+    {
+        if (w == *head)
+        {
+            publish(head, *next_fn(w));
+            return true;
+        }
+    }
+
+    return false;
+}
+
 /**
  * @brief find an item in the list
  *
@@ -203,11 +284,11 @@ bool list_has(pList *head, pList w, pnext next_fn, Mutex *mutex)
     ASSERT(next_fn);
     ASSERT(w);
 
-    Lock lock(mutex);
+    SharedLock lock(mutex);
 
-    for (; *head; head = next_fn(*head))
+    for (pList item = load(head); item; item = load(next_fn(item)))
     {
-        if (w == *head)
+        if (w == item)
         {
             return true;
         }
@@ -234,20 +315,17 @@ pList list_find(pList *head, pnext next_fn, visitor fn, void *arg, Mutex *mutex)
     ASSERT(next_fn);
     ASSERT(fn);
 
-    pList item = 0;
+    SharedLock lock(mutex);
 
-    Lock lock(mutex);
-
-    for (; *head; head = next_fn(*head))
+    for (pList item = load(head); item; item = load(next_fn(item)))
     {
-        if (fn(*head, arg))
+        if (fn(item, arg))
         {
-            item = *head;
-            break;
+            return item;
         }
     }
 
-    return item;
+    return 0;
 }
 
 /**
@@ -265,6 +343,171 @@ void list_visit(pList *head, pnext next_fn, visitor fn, void *arg, Mutex *mutex)
     list_find(head, next_fn, fn, arg, mutex);
 }
 
+    /*
+     *  ListQueue : the tail is the last item, or null when the list is empty.
+     *  The count is changed under the lock, but can be read without it.
+     */
+
+static inline void counted(ListQueue *queue, int n)
+{
+    __atomic_store_n(& queue->count, queue->count + n, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief insert item at the head of the queue
+ *
+ * @param queue the queue
+ * @param w item to add
+ * @param next_fn
+ * @param mutex optional
+ */
+
+void list_queue_push(ListQueue *queue, pList w, pnext next_fn, Mutex *mutex)
+{
+    ASSERT(queue);
+    ASSERT(w);
+    ASSERT(next_fn);
+
+    Lock lock(mutex);
+
+    _list_insert(& queue->head, w, next_fn(w));
+    if (!queue->tail)
+    {
+        queue->tail = w;
+    }
+    counted(queue, 1);
+}
+
+/**
+ * @brief insert item at the end of the queue
+ *
+ * @param queue the queue
+ * @param w item to add
+ * @param next_fn
+ * @param mutex optional
+ */
+
+void list_queue_append(ListQueue *queue, pList w, pnext next_fn, Mutex *mutex)
+{
+    ASSERT(queue);
+    ASSERT(w);
+    ASSERT(next_fn);
+
+    Lock lock(mutex);
+
+    pList *link = queue->tail ? next_fn(queue->tail) : & queue->head;
+    ASSERT(!*link);
+    _list_insert(link, w, next_fn(w));
+    queue->tail = w;
+    counted(queue, 1);
+}
+
+/**
+ * @brief remove an item from the queue
+ *
+ * @param queue the queue
+ * @param w item to remove
+ * @param next_fn
+ * @param mutex optional
+ *
+ * @return true if item was removed
+ */
+
+bool list_queue_remove(ListQueue *queue, pList w, pnext next_fn, Mutex *mutex)
+{
+    ASSERT(queue);
+    ASSERT(w);
+    ASSERT(next_fn);
+
+    Lock lock(mutex);
+
+    pList prev = 0;
+    for (pList *link = & queue->head; *link; link = next_fn(*link))
+    {
+        if (w == *link)
+        {
+            if (queue->tail == w)
+            {
+                queue->tail = prev;
+            }
+            list_pop(link, next_fn, 0);
+            counted(queue, -1);
+            return true;
+        }
+        prev = *link;
+    }
+
+    return false;
+}
+
+/**
+ * @brief return the head item of the queue
+ *
+ * @param queue the queue
+ * @param next_fn
+ * @param mutex optional
+ */
+
+pList list_queue_pop(ListQueue *queue, pnext next_fn, Mutex *mutex)
+{
+    ASSERT(queue);
+    ASSERT(next_fn);
+
+    Lock lock(mutex);
+
+    pList w = list_pop(& queue->head, next_fn, 0);
+    if (!queue->head)
+    {
+        queue->tail = 0;
+    }
+    if (w)
+    {
+        counted(queue, -1);
+    }
+    return w;
+}
+
+/**
+ * @brief insert item into a sorted queue
+ *
+ * @param queue the queue
+ * @param w item to add
+ * @param next_fn
+ * @param cmp compare function
+ * @param mutex optional
+ */
+
+void list_queue_add_sorted(ListQueue *queue, pList w, pnext next_fn, cmp_fn cmp, Mutex *mutex)
+{
+    ASSERT(queue);
+    ASSERT(w);
+    ASSERT(next_fn);
+    ASSERT(cmp);
+
+    Lock lock(mutex);
+
+    list_add_sorted(& queue->head, w, next_fn, cmp, 0);
+    if (!*next_fn(w))
+    {
+        // went in at the end
+        queue->tail = w;
+    }
+    counted(queue, 1);
+}
+
+/**
+ * @brief return the number of items in the queue, without locking or walking it
+ *
+ * @param queue the queue
+ */
+
+int list_queue_size(ListQueue *queue)
+{
+    ASSERT(queue);
+
+    return __atomic_load_n(& queue->count, __ATOMIC_RELAXED);
+}
+
 #if defined(CLI_NS)
 } // namespace cli
 #endif
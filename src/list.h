@@ -4,11 +4,15 @@
 #define __LIST_H__
 
 #include <stdbool.h>
+#include <stdint.h>
 
+#include <cli_debug.h>
 #include <cli_mutex.h>
 
 #if defined(__cplusplus)
 
+#include <iterator>
+
 #if defined CLI_NS
 namespace CLI_NS {
 #else
@@ -31,7 +35,9 @@ typedef pList* (*pnext)(pList item);
 
 void list_push(pList *head, pList w, pnext next_fn, MUTEX *mutex);
 void list_append(pList *head, pList w, pnext next_fn, MUTEX *mutex);
+void list_append_from(pList *head, pList from, pList w, pnext next_fn, MUTEX *mutex);
 bool list_remove(pList *head, pList w, pnext next_fn, MUTEX *mutex);
+bool list_unlink(pList *head, pList w, pnext next_fn, MUTEX *mutex);
 int list_size(pList *head, pnext next_fn, MUTEX *mutex);
 
 pList list_pop(pList *head, pnext next_fn, MUTEX *mutex);
@@ -47,6 +53,25 @@ typedef int (*visitor)(pList w, void *arg);
 pList  list_find(pList *head, pnext next_fn, visitor fn, void *arg, MUTEX *mutex);
 void list_visit(pList *head, pnext next_fn, visitor fn, void *arg, MUTEX *mutex);
 
+    /*
+     *  List that also tracks its last item and its size, so append and
+     *  size are O(1). Change it only through the list_queue_*() calls.
+     *  Read it with the list calls on & queue->head.
+     */
+
+typedef struct {
+    pList head;
+    pList tail;
+    int count;
+}   ListQueue;
+
+void list_queue_push(ListQueue *queue, pList w, pnext next_fn, MUTEX *mutex);
+void list_queue_append(ListQueue *queue, pList w, pnext next_fn, MUTEX *mutex);
+bool list_queue_remove(ListQueue *queue, pList w, pnext next_fn, MUTEX *mutex);
+pList list_queue_pop(ListQueue *queue, pnext next_fn, MUTEX *mutex);
+void list_queue_add_sorted(ListQueue *queue, pList w, pnext next_fn, cmp_fn cmp, MUTEX *mutex);
+int list_queue_size(ListQueue *queue);
+
 #if defined(__cplusplus)
 #if !defined(CLI_NS)
 } // extern "C"
@@ -55,12 +80,247 @@ void list_visit(pList *head, pnext next_fn, visitor fn, void *arg, MUTEX *mutex)
 
 #if defined(__cplusplus)
 
+    /*
+     *  The next pointer of an item : its 'next' member by default,
+     *  another member, or a function known at compile time.
+     */
+
+template <class T>
+struct ListNext
+{
+    T *operator()(T item) const
+    {
+        return & item->next;
+    }
+};
+
+template <class I, I* I::*member>
+struct ListMember
+{
+    I **operator()(I *item) const
+    {
+        return & (item->*member);
+    }
+};
+
+template <class T, T* (*next_fn)(T item)>
+struct ListNextFn
+{
+    T *operator()(T item) const
+    {
+        return next_fn(item);
+    }
+};
+
+    /*
+     *  Forward iteration, inlined : for (Item *item : list_range(& head))
+     *
+     *  Links are read with acquire semantics, as in list.cpp, so a command
+     *  list can be walked in an RCU read section. Otherwise hold the lock.
+     */
+
+template <class T, class Next = ListNext<T> >
+class ListIterator
+{
+    T item;
+public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef T value_type;
+    typedef ptrdiff_t difference_type;
+    typedef const T* pointer;
+    typedef const T& reference;
+
+    ListIterator(T w) : item(w) { }
+
+    const T& operator*() const
+    {
+        return item;
+    }
+
+    ListIterator& operator++()
+    {
+        item = __atomic_load_n(Next()(item), __ATOMIC_ACQUIRE);
+        return *this;
+    }
+
+    ListIterator operator++(int)
+    {
+        ListIterator was = *this;
+        ++*this;
+        return was;
+    }
+
+    bool operator==(const ListIterator& other) const
+    {
+        return item == other.item;
+    }
+
+    bool operator!=(const ListIterator& other) const
+    {
+        return item != other.item;
+    }
+};
+
+template <class T, class Next = ListNext<T> >
+class ListRange
+{
+    T *head;
+public:
+    ListRange(T *h) : head(h) { }
+
+    ListIterator<T, Next> begin() const
+    {
+        return ListIterator<T, Next>(__atomic_load_n(head, __ATOMIC_ACQUIRE));
+    }
+
+    ListIterator<T, Next> end() const
+    {
+        return ListIterator<T, Next>(0);
+    }
+};
+
+template <class T>
+ListRange<T> list_range(T *head)
+{
+    return ListRange<T>(head);
+}
+
+template <class Next, class T>
+ListRange<T, Next> list_range(T *head)
+{
+    return ListRange<T, Next>(head);
+}
+
     /**
+     * @brief return the first item for which \a fn(item) is true, or null
      *
+     * \a fn can be any callable, eg. a lambda. The loop is inlined.
+     */
+
+template <class T, class Fn>
+T list_find_if(T *head, Fn fn)
+{
+    for (T item : list_range(head))
+    {
+        if (fn(item))
+        {
+            return item;
+        }
+    }
+    return 0;
+}
+
+template <class Next, class T, class Fn>
+T list_find_if(T *head, Fn fn)
+{
+    for (T item : list_range<Next>(head))
+    {
+        if (fn(item))
+        {
+            return item;
+        }
+    }
+    return 0;
+}
+
+    /**
+     *  Queue<T> : List<T> with O(1) append, using the ListQueue C API
      */
 
 template <class T>
-class List
+class Queue
+{
+public:
+    typedef T* (*fn)(T item);
+
+    ListQueue queue;
+    fn next_fn;
+
+    Queue(fn _fn) : next_fn(_fn)
+    {
+        queue.head = 0;
+        queue.tail = 0;
+        queue.count = 0;
+    }
+
+    T head()
+    {
+        return (T) queue.head;
+    }
+
+    T tail()
+    {
+        return (T) queue.tail;
+    }
+
+    void push(T w, Mutex *mutex)
+    {
+        list_queue_push(& queue, (pList) w, (pnext) next_fn, mutex);
+    }
+
+    void append(T w, Mutex *mutex)
+    {
+        list_queue_append(& queue, (pList) w, (pnext) next_fn, mutex);
+    }
+
+    bool remove(T w, Mutex *mutex)
+    {
+        return list_queue_remove(& queue, (pList) w, (pnext) next_fn, mutex);
+    }
+
+    // O(1) : no lock needed
+    int size(Mutex *mutex)
+    {
+        UNUSED(mutex);
+        return list_queue_size(& queue);
+    }
+
+    bool empty()
+    {
+        return !queue.head;
+    }
+
+    T pop(Mutex *mutex)
+    {
+        return (T) list_queue_pop(& queue, (pnext) next_fn, mutex);
+    }
+
+    void add_sorted(T w, int (*cmp)(T a, T b), Mutex *mutex)
+    {
+        list_queue_add_sorted(& queue, (pList) w, (pnext) next_fn, (cmp_fn) cmp, mutex);
+    }
+
+    T find(int (*fn)(T a, void *arg), void *arg, Mutex *mutex)
+    {
+        return (T) list_find(& queue.head, (pnext) next_fn, (visitor) fn, arg, mutex);
+    }
+
+    bool has(T w, Mutex *mutex)
+    {
+        return list_has(& queue.head, (pList) w, (pnext) next_fn, mutex);
+    }
+
+    void visit(int (*fn)(T a, void *arg), void *arg, Mutex *mutex)
+    {
+        list_visit(& queue.head, (pnext) next_fn, (visitor) fn, arg, mutex);
+    }
+};
+
+    /*
+     *  Use a runtime Mutex*, passed to each call : the original List
+     */
+
+class MutexLock;
+
+template <class T, class LockPolicy = MutexLock, class Next = ListNext<T> >
+class List;
+
+    /**
+     *  List<T> : calls the C API, with an optional Mutex* on each call
+     */
+
+template <class T, class Next>
+class List<T, MutexLock, Next>
 {
 public:
     typedef T* (*fn)(T item);
@@ -70,6 +330,17 @@ public:
 
     List(fn _fn) : head(0), next_fn(_fn) { }
 
+    // iteration follows Next, which must agree with next_fn
+    ListIterator<T, Next> begin() const
+    {
+        return ListRange<T, Next>(const_cast<T*>(& head)).begin();
+    }
+
+    ListIterator<T, Next> end() const
+    {
+        return ListIterator<T, Next>(0);
+    }
+
     void push(T w, Mutex *mutex)
     {
         list_push((pList*) & head, (pList) w, (pnext) next_fn, mutex);
@@ -121,6 +392,162 @@ public:
     }
 };
 
+    /**
+     *  List<T, LockPolicy> : traversal inlined here, the lock chosen at compile time
+     *
+     *  eg. List<Item*, NullLock> for a list used by one thread,
+     *  List<Item*, SpinLock> or List<Item*, PthreadLock> for a shared one.
+     */
+
+template <class T, class LockPolicy, class Next>
+class List : private LockPolicy
+{
+    typedef PolicyLock<LockPolicy> Guard;
+
+    static T *next(T item)
+    {
+        return Next()(item);
+    }
+
+    static void insert(T *link, T w)
+    {
+        *next(w) = *link;
+        *link = w;
+    }
+
+    void counted(int n)
+    {
+        __atomic_store_n(& count, count + n, __ATOMIC_RELAXED);
+    }
+
+public:
+    T head;
+    int count;
+
+    List() : head(0), count(0) { }
+
+    // iterate under the lock, or from the one thread using the list
+    ListIterator<T, Next> begin() const
+    {
+        return ListIterator<T, Next>(head);
+    }
+
+    ListIterator<T, Next> end() const
+    {
+        return ListIterator<T, Next>(0);
+    }
+
+    void push(T w)
+    {
+        ASSERT(w);
+        Guard lock(*this);
+        insert(& head, w);
+        counted(1);
+    }
+
+    void append(T w)
+    {
+        ASSERT(w);
+        Guard lock(*this);
+        T *link = & head;
+        for (; *link; link = next(*link))
+            ;
+        insert(link, w);
+        counted(1);
+    }
+
+    bool remove(T w)
+    {
+        ASSERT(w);
+        Guard lock(*this);
+        for (T *link = & head; *link; link = next(*link))
+        {
+            if (*link == w)
+            {
+                *link = *next(w);
+                *next(w) = 0;
+                counted(-1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // O(1) : no lock needed
+    int size()
+    {
+        return __atomic_load_n(& count, __ATOMIC_RELAXED);
+    }
+
+    bool empty()
+    {
+        return !head;
+    }
+
+    T pop()
+    {
+        Guard lock(*this);
+        T w = head;
+        if (w)
+        {
+            head = *next(w);
+            *next(w) = 0;
+            counted(-1);
+        }
+        return w;
+    }
+
+    template <class Cmp>
+    void add_sorted(T w, Cmp cmp)
+    {
+        ASSERT(w);
+        Guard lock(*this);
+        T *link = & head;
+        for (; *link; link = next(*link))
+        {
+            if (cmp(w, *link) >= 0)
+            {
+                break;
+            }
+        }
+        insert(link, w);
+        counted(1);
+    }
+
+    template <class Fn>
+    T find(Fn fn, void *arg)
+    {
+        Guard lock(*this);
+        for (T w = head; w; w = *next(w))
+        {
+            if (fn(w, arg))
+            {
+                return w;
+            }
+        }
+        return 0;
+    }
+
+    bool has(T w)
+    {
+        Guard lock(*this);
+        for (T item = head; item; item = *next(item))
+        {
+            if (item == w)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <class Fn>
+    void visit(Fn fn, void *arg)
+    {
+        find(fn, arg);
+    }
+};
+
 #if defined(CLI_NS)
 } // namespace cli 
 #endif
@@ -0,0 +1,198 @@
+#include <cli_debug.h>
+#include <cli_mutex.h>
+
+#include "list2.h"
+
+#if defined(CLI_NS)
+namespace CLI_NS {
+#endif
+
+    /*
+     *  The next links are published with release semantics, as in list.cpp,
+     *  so readers can walk forward without the lock. The prev links are
+     *  only used by writers, under the lock.
+     */
+
+static inline void publish(pList *link, pList w)
+{
+    __atomic_store_n(link, w, __ATOMIC_RELEASE);
+}
+
+static void _list2_insert(pList *link, pList prev, pList w, pnext next_fn, pnext prev_fn)
+{
+    ASSERT(link);
+    ASSERT(w);
+
+    pList next = *link;
+    *next_fn(w) = next;
+    *prev_fn(w) = prev;
+    if (next)
+    {
+        *prev_fn(next) = w;
+    }
+    publish(link, w);
+}
+
+static bool _list2_unlink(pList *head, pList w, pnext next_fn, pnext prev_fn)
+{
+    pList prev = *prev_fn(w);
+    pList *link = prev ? next_fn(prev) : head;
+
+    if (*link != w)
+    {
+        // not on this list
+        return false;
+    }
+
+    pList next = *next_fn(w);
+    if (next)
+    {
+        *prev_fn(next) = prev;
+    }
+    publish(link, next);
+
+    *next_fn(w) = 0;
+    *prev_fn(w) = 0;
+    return true;
+}
+
+/**
+ * @brief insert item at the head of the list
+ *
+ * @param head pointer to the head of the list
+ * @param w item to add
+ * @param next_fn
+ * @param prev_fn
+ * @param mutex optional
+ */
+
+void list2_push(pList *head, pList w, pnext next_fn, pnext prev_fn, Mutex *mutex)
+{
+    ASSERT(head);
+    ASSERT(w);
+    ASSERT(next_fn);
+    ASSERT(prev_fn);
+
+    Lock lock(mutex);
+
+    _list2_insert(head, 0, w, next_fn, prev_fn);
+}
+
+/**
+ * @brief insert item at the end of the list
+ *
+ * @param head pointer to the head of the list
+ * @param w item to add
+ * @param next_fn
+ * @param prev_fn
+ * @param mutex optional
+ */
+
+void list2_append(pList *head, pList w, pnext next_fn, pnext prev_fn, Mutex *mutex)
+{
+    ASSERT(head);
+    ASSERT(w);
+    ASSERT(next_fn);
+    ASSERT(prev_fn);
+
+    Lock lock(mutex);
+
+    pList prev = 0;
+    for (; *head; head = next_fn(*head))
+    {
+        prev = *head;
+    }
+
+    _list2_insert(head, prev, w, next_fn, prev_fn);
+}
+
+/**
+ * @brief insert item into a sorted list
+ *
+ * @param head pointer to the head of the list
+ * @param w item to add
+ * @param next_fn
+ * @param prev_fn
+ * @param cmp compare function
+ * @param mutex optional
+ */
+
+void list2_add_sorted(pList *head, pList w, pnext next_fn, pnext prev_fn, cmp_fn cmp, Mutex *mutex)
+{
+    ASSERT(head);
+    ASSERT(w);
+    ASSERT(next_fn);
+    ASSERT(prev_fn);
+    ASSERT(cmp);
+
+    Lock lock(mutex);
+
+    pList prev = 0;
+    for (; *head; head = next_fn(*head))
+    {
+        if (cmp(w, *head) >= 0)
+        {
+            break;
+        }
+        prev = *head;
+    }
+
+    _list2_insert(head, prev, w, next_fn, prev_fn);
+}
+
+/**
+ * @brief remove an item from the list, without searching for it
+ *
+ * @param head pointer to the head of the list
+ * @param w item to remove
+ * @param next_fn
+ * @param prev_fn
+ * @param mutex optional
+ *
+ * @return true if item was removed
+ */
+
+bool list2_remove(pList *head, pList w, pnext next_fn, pnext prev_fn, Mutex *mutex)
+{
+    ASSERT(head);
+    ASSERT(w);
+    ASSERT(next_fn);
+    ASSERT(prev_fn);
+
+    Lock lock(mutex);
+
+    return _list2_unlink(head, w, next_fn, prev_fn);
+}
+
+/**
+ * @brief return the head item of the list
+ *
+ * @param head pointer to the head of the list
+ * @param next_fn
+ * @param prev_fn
+ * @param mutex optional
+ */
+
+pList list2_pop(pList *head, pnext next_fn, pnext prev_fn, Mutex *mutex)
+{
+    ASSERT(head);
+    ASSERT(next_fn);
+    ASSERT(prev_fn);
+
+    Lock lock(mutex);
+
+    pList w = *head;
+
+    if (w)
+    {
+        _list2_unlink(head, w, next_fn, prev_fn);
+    }
+
+    return w;
+}
+
+#if defined(CLI_NS)
+} // namespace cli
+#endif
+
+//  FIN
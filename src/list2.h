@@ -0,0 +1,117 @@
+#if !defined(__LIST2_H__)
+
+#define __LIST2_H__
+
+#include "list.h"
+
+#if defined(__cplusplus)
+
+#if defined CLI_NS
+namespace CLI_NS {
+#else
+extern "C" {
+#endif
+
+#endif  // defined(__cplusplus)
+
+    /*
+     *  Doubly linked intrusive list : each item has a next and a prev pointer,
+     *  returned by next_fn and prev_fn, so a known item is unlinked in O(1).
+     *
+     *  The links of a removed or popped item are cleared. Only remove items
+     *  that are on the list, or whose links are clear.
+     *
+     *  The list_size(), list_has(), list_find() and list_visit() calls
+     *  work on the next links.
+     */
+
+void list2_push(pList *head, pList w, pnext next_fn, pnext prev_fn, MUTEX *mutex);
+void list2_append(pList *head, pList w, pnext next_fn, pnext prev_fn, MUTEX *mutex);
+bool list2_remove(pList *head, pList w, pnext next_fn, pnext prev_fn, MUTEX *mutex);
+pList list2_pop(pList *head, pnext next_fn, pnext prev_fn, MUTEX *mutex);
+void list2_add_sorted(pList *head, pList w, pnext next_fn, pnext prev_fn, cmp_fn cmp, MUTEX *mutex);
+
+#if defined(__cplusplus)
+#if !defined(CLI_NS)
+} // extern "C"
+#endif
+#endif
+
+#if defined(__cplusplus)
+
+    /**
+     *  List2<T> : doubly linked List<T>
+     */
+
+template <class T>
+class List2
+{
+public:
+    typedef T* (*fn)(T item);
+
+    T head;
+    fn next_fn;
+    fn prev_fn;
+
+    List2(fn _next, fn _prev) : head(0), next_fn(_next), prev_fn(_prev) { }
+
+    void push(T w, Mutex *mutex)
+    {
+        list2_push((pList*) & head, (pList) w, (pnext) next_fn, (pnext) prev_fn, mutex);
+    }
+
+    void append(T w, Mutex *mutex)
+    {
+        list2_append((pList*) & head, (pList) w, (pnext) next_fn, (pnext) prev_fn, mutex);
+    }
+
+    bool remove(T w, Mutex *mutex)
+    {
+        return list2_remove((pList*) & head, (pList) w, (pnext) next_fn, (pnext) prev_fn, mutex);
+    }
+
+    int size(Mutex *mutex)
+    {
+        return list_size((pList*) & head, (pnext) next_fn, mutex);
+    }
+
+    bool empty()
+    {
+        return !head;
+    }
+
+    T pop(Mutex *mutex)
+    {
+        return (T) list2_pop((pList*) & head, (pnext) next_fn, (pnext) prev_fn, mutex);
+    }
+
+    void add_sorted(T w, int (*cmp)(T a, T b), Mutex *mutex)
+    {
+        list2_add_sorted((pList*) & head, (pList) w, (pnext) next_fn, (pnext) prev_fn, (cmp_fn) cmp, mutex);
+    }
+
+    T find(int (*fn)(T a, void *arg), void *arg, Mutex *mutex)
+    {
+        return (T) list_find((pList*) & head, (pnext) next_fn, (visitor) fn, arg, mutex);
+    }
+
+    bool has(T w, Mutex *mutex)
+    {
+        return list_has((pList*) & head, (pList) w, (pnext) next_fn, mutex);
+    }
+
+    void visit(int (*fn)(T a, void *arg), void *arg, Mutex *mutex)
+    {
+        list_visit((pList*) & head, (pnext) next_fn, (visitor) fn, arg, mutex);
+    }
+};
+
+#if defined(CLI_NS)
+} // namespace cli
+#endif
+
+#endif // __cplusplus
+
+#endif // __LIST2_H__
+
+//  FIN
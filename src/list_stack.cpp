@@ -0,0 +1,144 @@
+#include <stdint.h>
+
+#include <cli_debug.h>
+
+#include "list_stack.h"
+
+#if defined(CLI_NS)
+namespace CLI_NS {
+#endif
+
+    /*
+     *  The low bits of the word hold the pointer, the high bits the tag
+     */
+
+#if defined(LIST_STACK_POP)
+
+#if UINTPTR_MAX > 0xffffffffUL
+#define STACK_PTR_BITS 48
+#else
+#define STACK_PTR_BITS 32
+#endif
+
+static const ListStackWord STACK_PTR = (((ListStackWord) 1) << STACK_PTR_BITS) - 1;
+static const ListStackWord STACK_TAG = ((ListStackWord) 1) << STACK_PTR_BITS;
+
+#else
+
+// no tag
+static const ListStackWord STACK_PTR = ~((ListStackWord) 0);
+static const ListStackWord STACK_TAG = 0;
+
+#endif
+
+static inline pList stack_item(ListStackWord word)
+{
+    return (pList) (uintptr_t) (word & STACK_PTR);
+}
+
+/**
+ * @brief push an item onto a lock-free stack
+ *
+ * @param stack the stack
+ * @param w item to add
+ * @param next_fn
+ */
+
+void list_stack_push(ListStack *stack, pList w, pnext next_fn)
+{
+    ASSERT(stack);
+    ASSERT(w);
+    ASSERT(next_fn);
+    ASSERT((((ListStackWord) (uintptr_t) w) & ~STACK_PTR) == 0);
+
+    pList *next = next_fn(w);
+    ListStackWord old = __atomic_load_n(& stack->word, __ATOMIC_RELAXED);
+    ListStackWord word;
+
+    do {
+        // stale pops may be reading the link
+        __atomic_store_n(next, stack_item(old), __ATOMIC_RELAXED);
+        word = ((ListStackWord) (uintptr_t) w) | ((old & ~STACK_PTR) + STACK_TAG);
+    } while (!__atomic_compare_exchange_n(& stack->word, & old, word, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+#if defined(LIST_STACK_POP)
+
+/**
+ * @brief pop the top item from a lock-free stack
+ *
+ * @param stack the stack
+ * @param next_fn
+ *
+ * @return the item or null if the stack is empty
+ */
+
+pList list_stack_pop(ListStack *stack, pnext next_fn)
+{
+    ASSERT(stack);
+    ASSERT(next_fn);
+
+    ListStackWord old = __atomic_load_n(& stack->word, __ATOMIC_ACQUIRE);
+
+    while (true)
+    {
+        pList w = stack_item(old);
+        if (!w)
+        {
+            return 0;
+        }
+
+        // w may already have been popped by another thread : then the CAS fails
+        pList *next = next_fn(w);
+        const ListStackWord word = ((ListStackWord) (uintptr_t) __atomic_load_n(next, __ATOMIC_RELAXED)) | (old & ~STACK_PTR);
+
+        if (__atomic_compare_exchange_n(& stack->word, & old, word, true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+        {
+            __atomic_store_n(next, (pList) 0, __ATOMIC_RELAXED);
+            return w;
+        }
+    }
+}
+
+#endif  //  LIST_STACK_POP
+
+/**
+ * @brief detach every item from a lock-free stack, with one atomic exchange
+ *
+ * The tag is moved on by half its range, as the exchange can't increment it.
+ *
+ * @param stack the stack
+ *
+ * @return the top item, or null : the rest follow through next_fn
+ */
+
+pList list_stack_pop_all(ListStack *stack)
+{
+    ASSERT(stack);
+
+    const ListStackWord tag = __atomic_load_n(& stack->word, __ATOMIC_RELAXED) & ~STACK_PTR;
+    // the top bit of the tag, if there is one
+    const ListStackWord half = ~STACK_PTR & ~(~STACK_PTR >> 1);
+    const ListStackWord old = __atomic_exchange_n(& stack->word, (tag + half) & ~STACK_PTR, __ATOMIC_ACQUIRE);
+
+    return stack_item(old);
+}
+
+/**
+ * @brief check if a lock-free stack is empty
+ *
+ * @param stack the stack
+ */
+
+bool list_stack_empty(ListStack *stack)
+{
+    ASSERT(stack);
+
+    return !stack_item(__atomic_load_n(& stack->word, __ATOMIC_ACQUIRE));
+}
+
+#if defined(CLI_NS)
+} // namespace cli
+#endif
+
+//  FIN
@@ -0,0 +1,115 @@
+#if !defined(__LIST_STACK_H__)
+
+#define __LIST_STACK_H__
+
+#include "list.h"
+
+#if defined(__cplusplus)
+
+#if defined CLI_NS
+namespace CLI_NS {
+#else
+extern "C" {
+#endif
+
+#endif  // defined(__cplusplus)
+
+    /*
+     *  Lock-free stack (Treiber) : the head pointer and a tag share one
+     *  64-bit word, so push and pop are a single CAS each.
+     *
+     *  The tag changes on every push, so a pop that read a stale head
+     *  fails its CAS even if the same item is back on top (ABA).
+     *  Popped items can be reused, but must not be unmapped while
+     *  another thread may still be popping.
+     *
+     *  The tag needs the pointer in the low 48 bits of the word on 64-bit
+     *  targets, or a 64-bit CAS on 32-bit ones. Elsewhere the word is just
+     *  the pointer : push, pop_all and empty need no tag, but there is no
+     *  pop, and LIST_STACK_POP is not defined.
+     */
+
+#if UINTPTR_MAX > 0xffffffffUL
+#if defined(__x86_64__) || defined(__aarch64__)
+#define LIST_STACK_POP
+#endif
+#elif defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_8)
+#define LIST_STACK_POP
+#endif
+
+#if defined(LIST_STACK_POP)
+typedef uint64_t ListStackWord;
+#else
+typedef uintptr_t ListStackWord;
+#endif
+
+typedef struct {
+    ListStackWord word;
+}   ListStack;
+
+void list_stack_push(ListStack *stack, pList w, pnext next_fn);
+#if defined(LIST_STACK_POP)
+pList list_stack_pop(ListStack *stack, pnext next_fn);
+#endif
+pList list_stack_pop_all(ListStack *stack);
+bool list_stack_empty(ListStack *stack);
+
+#if defined(__cplusplus)
+#if !defined(CLI_NS)
+} // extern "C"
+#endif
+#endif
+
+#if defined(__cplusplus)
+
+    /**
+     *  Stack<T> : lock-free push / pop, using the ListStack C API
+     */
+
+template <class T>
+class Stack
+{
+public:
+    typedef T* (*fn)(T item);
+
+    ListStack stack;
+    fn next_fn;
+
+    Stack(fn _fn) : next_fn(_fn)
+    {
+        stack.word = 0;
+    }
+
+    void push(T w)
+    {
+        list_stack_push(& stack, (pList) w, (pnext) next_fn);
+    }
+
+#if defined(LIST_STACK_POP)
+    T pop()
+    {
+        return (T) list_stack_pop(& stack, (pnext) next_fn);
+    }
+#endif
+
+    // detach the whole stack : the items are linked through next_fn
+    T pop_all()
+    {
+        return (T) list_stack_pop_all(& stack);
+    }
+
+    bool empty()
+    {
+        return list_stack_empty(& stack);
+    }
+};
+
+#if defined(CLI_NS)
+} // namespace cli
+#endif
+
+#endif // __cplusplus
+
+#endif // __LIST_STACK_H__
+
+//  FIN
@@ -0,0 +1,394 @@
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <cli_debug.h>
+#include <cli_mutex.h>
+
+#include "cli_rcu.h"
+#include "skiplist.h"
+
+#if defined(CLI_NS)
+namespace CLI_NS {
+#endif
+
+    /*
+     *  Each node has a tower of 1 to MAX_HEIGHT links, a quarter of the
+     *  nodes reaching each level above the one below.
+     *
+     *  Links are written with release and read with acquire semantics.
+     *  A node is linked bottom up, so a reader that can see it at any
+     *  level can see it at level 0, and unlinked top down.
+     */
+
+#define MAX_HEIGHT 16
+
+// removed nodes are freed in batches of at least this many
+#define RETIRE_BATCH 64
+
+typedef struct SkipNode
+{
+    pList item;
+    int height;
+    struct SkipNode *next[1];   // height links
+}   SkipNode;
+
+struct SkipList
+{
+    SkipNode *head;     // MAX_HEIGHT links, no item
+    int height;         // tallest node in use
+    int count;
+    uint32_t seed;
+    cmp_fn cmp;
+    Mutex *mutex;
+
+    SkipNode **retired; // unlinked, not yet freed : see retire()
+    int retired_count;
+    int retired_size;
+    int waiting;        // the first ones, freed once grace period target has passed
+    unsigned long target;
+};
+
+static inline SkipNode *load(SkipNode **link)
+{
+    return __atomic_load_n(link, __ATOMIC_ACQUIRE);
+}
+
+static inline void publish(SkipNode **link, SkipNode *node)
+{
+    __atomic_store_n(link, node, __ATOMIC_RELEASE);
+}
+
+static SkipNode *node_create(pList item, int height)
+{
+    const size_t size = offsetof(SkipNode, next) + (sizeof(SkipNode*) * (size_t) height);
+    SkipNode *node = (SkipNode*) malloc(size);
+    ASSERT(node);
+
+    node->item = item;
+    node->height = height;
+    for (int i = 0; i < height; i++)
+    {
+        node->next[i] = 0;
+    }
+    return node;
+}
+
+static int random_height(SkipList *list)
+{
+    // xorshift32
+    uint32_t x = list->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    list->seed = x;
+
+    int height = 1;
+    for (; (height < MAX_HEIGHT) && !(x & 3); x >>= 2)
+    {
+        height += 1;
+    }
+    return height;
+}
+
+    /*
+     *  Find the last node at each level that goes ahead of \a w :
+     *  the same test as list_add_sorted().
+     */
+
+static void search(SkipList *list, pList w, SkipNode **preds)
+{
+    SkipNode *pred = list->head;
+    const int height = __atomic_load_n(& list->height, __ATOMIC_ACQUIRE);
+
+    for (int level = MAX_HEIGHT - 1; level >= 0; level--)
+    {
+        if (level < height)
+        {
+            for (SkipNode *next = load(& pred->next[level]); next; next = load(& pred->next[level]))
+            {
+                if (list->cmp(w, next->item) >= 0)
+                {
+                    break;
+                }
+                pred = next;
+            }
+        }
+        preds[level] = pred;
+    }
+}
+
+    /**
+     * @brief create a skip list ordered by \a cmp, with writers guarded by \a mutex
+     */
+
+SkipList *skiplist_create(cmp_fn cmp, Mutex *mutex)
+{
+    ASSERT(cmp);
+
+    SkipList *list = (SkipList*) malloc(sizeof(SkipList));
+    ASSERT(list);
+
+    list->head = node_create(0, MAX_HEIGHT);
+    list->height = 1;
+    list->count = 0;
+    list->seed = 0x2545f491;
+    list->cmp = cmp;
+    list->mutex = mutex;
+    list->retired = 0;
+    list->retired_count = 0;
+    list->retired_size = 0;
+    list->waiting = 0;
+    list->target = 0;
+    return list;
+}
+
+    /**
+     * @brief free the list : the items are not touched
+     */
+
+void skiplist_delete(SkipList *list)
+{
+    if (!list)
+    {
+        return;
+    }
+
+    rcu_synchronize();
+
+    for (int i = 0; i < list->retired_count; i++)
+    {
+        free(list->retired[i]);
+    }
+    free(list->retired);
+
+    SkipNode *node = list->head;
+    while (node)
+    {
+        SkipNode *next = node->next[0];
+        free(node);
+        node = next;
+    }
+    free(list);
+}
+
+    /**
+     * @brief insert \a w, ahead of any equal items
+     */
+
+void skiplist_add(SkipList *list, pList w)
+{
+    ASSERT(list);
+    ASSERT(w);
+
+    SkipNode *preds[MAX_HEIGHT];
+    Lock lock(list->mutex);
+
+    search(list, w, preds);
+
+    const int height = random_height(list);
+    SkipNode *node = node_create(w, height);
+
+    for (int level = 0; level < height; level++)
+    {
+        node->next[level] = preds[level]->next[level];
+        publish(& preds[level]->next[level], node);
+    }
+
+    if (height > list->height)
+    {
+        __atomic_store_n(& list->height, height, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(& list->count, list->count + 1, __ATOMIC_RELAXED);
+}
+
+static void node_unlink(SkipList *list, SkipNode *node, SkipNode **preds)
+{
+    for (int level = node->height - 1; level >= 0; level--)
+    {
+        // skip any equal items ahead of it
+        SkipNode *pred = preds[level];
+        while (pred->next[level] != node)
+        {
+            pred = pred->next[level];
+            ASSERT(pred);
+        }
+        publish(& pred->next[level], node->next[level]);
+    }
+
+    __atomic_store_n(& list->count, list->count - 1, __ATOMIC_RELAXED);
+}
+
+    /*
+     *  Free \a node once no reader can be on it. Nodes are collected, and a
+     *  batch is freed after a single grace period, so writers never wait.
+     *  Call with the mutex held.
+     */
+
+static void retire(SkipList *list, SkipNode *node)
+{
+    if (list->waiting && rcu_passed(list->target))
+    {
+        for (int i = 0; i < list->waiting; i++)
+        {
+            free(list->retired[i]);
+        }
+        list->retired_count -= list->waiting;
+        memmove(list->retired, & list->retired[list->waiting], sizeof(SkipNode*) * (size_t) list->retired_count);
+        list->waiting = 0;
+    }
+
+    if (list->retired_count == list->retired_size)
+    {
+        list->retired_size = list->retired_size ? (list->retired_size * 2) : RETIRE_BATCH;
+        list->retired = (SkipNode**) realloc(list->retired, sizeof(SkipNode*) * (size_t) list->retired_size);
+        ASSERT(list->retired);
+    }
+    list->retired[list->retired_count++] = node;
+
+    if ((!list->waiting) && (list->retired_count >= RETIRE_BATCH))
+    {
+        list->target = rcu_start();
+        list->waiting = list->retired_count;
+    }
+}
+
+    /**
+     * @brief remove \a w from the list
+     *
+     * @return true if it was found
+     */
+
+bool skiplist_remove(SkipList *list, pList w)
+{
+    ASSERT(list);
+    ASSERT(w);
+
+    SkipNode *preds[MAX_HEIGHT];
+    Lock lock(list->mutex);
+
+    search(list, w, preds);
+
+    // w is one of the run of equal items
+    SkipNode *node;
+    for (node = preds[0]->next[0]; node; node = node->next[0])
+    {
+        if ((node->item == w) || (list->cmp(w, node->item) != 0))
+        {
+            break;
+        }
+    }
+
+    if (!(node && (node->item == w)))
+    {
+        return false;
+    }
+
+    node_unlink(list, node, preds);
+    retire(list, node);
+    return true;
+}
+
+    /**
+     * @brief remove and return the first item, or null if the list is empty
+     */
+
+pList skiplist_pop(SkipList *list)
+{
+    ASSERT(list);
+
+    SkipNode *preds[MAX_HEIGHT];
+    Lock lock(list->mutex);
+
+    SkipNode *node = list->head->next[0];
+    if (!node)
+    {
+        return 0;
+    }
+
+    for (int level = 0; level < MAX_HEIGHT; level++)
+    {
+        preds[level] = list->head;
+    }
+
+    pList w = node->item;
+    node_unlink(list, node, preds);
+    retire(list, node);
+    return w;
+}
+
+    /**
+     * @brief return the first item equal to \a key, or null
+     */
+
+pList skiplist_find(SkipList *list, pList key)
+{
+    ASSERT(list);
+    ASSERT(key);
+
+    SkipNode *preds[MAX_HEIGHT];
+    ReadLock rcu;
+
+    search(list, key, preds);
+
+    SkipNode *node = load(& preds[0]->next[0]);
+    if (node && (list->cmp(key, node->item) == 0))
+    {
+        return node->item;
+    }
+    return 0;
+}
+
+    /**
+     * @brief return the first item, or null if the list is empty
+     */
+
+pList skiplist_first(SkipList *list)
+{
+    ASSERT(list);
+
+    ReadLock rcu;
+    SkipNode *node = load(& list->head->next[0]);
+    return node ? node->item : 0;
+}
+
+    /**
+     * @brief visit the items in order, stopping if \a fn returns non-zero
+     *
+     * @return the item \a fn stopped at, or null
+     */
+
+pList skiplist_visit(SkipList *list, visitor fn, void *arg)
+{
+    ASSERT(list);
+    ASSERT(fn);
+
+    ReadLock rcu;
+
+    for (SkipNode *node = load(& list->head->next[0]); node; node = load(& node->next[0]))
+    {
+        if (fn(node->item, arg))
+        {
+            return node->item;
+        }
+    }
+    return 0;
+}
+
+    /**
+     * @brief return the number of items in the list : O(1)
+     */
+
+int skiplist_size(SkipList *list)
+{
+    ASSERT(list);
+
+    return __atomic_load_n(& list->count, __ATOMIC_RELAXED);
+}
+
+#if defined(CLI_NS)
+} // namespace cli
+#endif
+
+//  FIN
@@ -0,0 +1,124 @@
+#if !defined(__SKIPLIST_H__)
+
+#define __SKIPLIST_H__
+
+#include "list.h"
+
+#if defined(__cplusplus)
+
+#if defined CLI_NS
+namespace CLI_NS {
+#else
+extern "C" {
+#endif
+
+#endif  // defined(__cplusplus)
+
+    /*
+     *  Skip list of items kept in cmp_fn order, for large ordered sets
+     *  such as timer and priority queues. Insert, remove and find are
+     *  O(log n).
+     *
+     *  The order is the same as list_add_sorted() : an item goes in ahead
+     *  of the first one for which cmp(item, other) >= 0, so ahead of any
+     *  equal ones.
+     *
+     *  Readers take no lock : they run in an RCU read section (cli_rcu.h).
+     *  Writers serialise on the mutex given to skiplist_create(), which can
+     *  be null if the list is only used by one thread. Removed nodes are
+     *  freed in batches, once no reader can see them, so don't change the
+     *  list from inside a skiplist_visit() callback.
+     */
+
+typedef struct SkipList SkipList;
+
+SkipList *skiplist_create(cmp_fn cmp, MUTEX *mutex);
+void skiplist_delete(SkipList *list);
+
+void skiplist_add(SkipList *list, pList w);
+bool skiplist_remove(SkipList *list, pList w);
+pList skiplist_pop(SkipList *list);
+
+pList skiplist_find(SkipList *list, pList key);
+pList skiplist_first(SkipList *list);
+pList skiplist_visit(SkipList *list, visitor fn, void *arg);
+int skiplist_size(SkipList *list);
+
+#if defined(__cplusplus)
+#if !defined(CLI_NS)
+} // extern "C"
+#endif
+#endif
+
+#if defined(__cplusplus)
+
+    /**
+     *  SortedList<T> : typed wrapper for the SkipList C API
+     */
+
+template <class T>
+class SortedList
+{
+public:
+    SkipList *list;
+
+    SortedList(int (*cmp)(T a, T b), Mutex *mutex)
+    {
+        list = skiplist_create((cmp_fn) cmp, mutex);
+    }
+
+    ~SortedList()
+    {
+        skiplist_delete(list);
+    }
+
+    void add(T w)
+    {
+        skiplist_add(list, (pList) w);
+    }
+
+    bool remove(T w)
+    {
+        return skiplist_remove(list, (pList) w);
+    }
+
+    T pop()
+    {
+        return (T) skiplist_pop(list);
+    }
+
+    T find(T key)
+    {
+        return (T) skiplist_find(list, (pList) key);
+    }
+
+    T first()
+    {
+        return (T) skiplist_first(list);
+    }
+
+    T visit(int (*fn)(T a, void *arg), void *arg)
+    {
+        return (T) skiplist_visit(list, (visitor) fn, arg);
+    }
+
+    int size()
+    {
+        return skiplist_size(list);
+    }
+
+    bool empty()
+    {
+        return !first();
+    }
+};
+
+#if defined(CLI_NS)
+} // namespace cli
+#endif
+
+#endif // __cplusplus
+
+#endif // __SKIPLIST_H__
+
+//  FIN
@@ -0,0 +1,890 @@
+
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <cli_debug.h>
+#include <cli_mutex.h>
+#include "../src/cli.h"
+#include "../src/list.h"
+#include "../src/list_stack.h"
+#include "../src/skiplist.h"
+#include "../src/linux/cli_pool.h"
+
+#if defined(CLI_NS)
+using namespace CLI_NS;
+#endif
+
+    /*
+     *  Benchmarks : sizes are kept small so they run as part of the tests.
+     *  They print their timings, but only check what is deterministic, such
+     *  as results and write counts : the timings depend on the machine.
+     */
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, & ts);
+    return (double) ts.tv_sec + ((double) ts.tv_nsec / 1e9);
+}
+
+    /*
+     *  Output to /dev/null, counting the write() syscalls
+     */
+
+typedef struct {
+    int fd;
+    int writes;
+}   NullOut;
+
+static int null_fprintf(void *ctx, const char *fmt, va_list va)
+{
+    NullOut *out = (NullOut*) ctx;
+    out->writes += 1;
+    return vdprintf(out->fd, fmt, va);
+}
+
+static void bench_nowt(CLI *cli, CliCommand *cmd)
+{
+    UNUSED(cmd);
+    cli_print(cli, "ok%s", cli->eol);
+}
+
+static int output_run(size_t buffer, const char **chunks, double *t)
+{
+    NullOut null = { open("/dev/null", O_WRONLY), 0 };
+    CliOutput out = { null_fprintf, & null };
+
+    CliCommand a0 = {
+        .cmd = "hello",
+        .handler = bench_nowt,
+    };
+
+    CLI cli = {
+        .output = & out,
+        .prompt = "> ",
+        .eol = "\r\n",
+    };
+
+    cli_init(& cli, 64, 0);
+    cli_register(& cli, & a0);
+    cli_set_output_buffer(& cli, buffer, 0);
+    null.writes = 0;
+
+    const double start = now();
+    for (int i = 0; i < 1000; i++)
+    {
+        for (const char **s = chunks; *s; s++)
+        {
+            cli_process_buffer(& cli, *s, strlen(*s));
+        }
+    }
+    *t = now() - start;
+
+    cli_close(& cli);
+    close(null.fd);
+    return null.writes;
+}
+
+TEST(Bench, OutputBuffer)
+{
+    // chunks as they might arrive from a socket read()
+    const char *chunks[] = {
+        "hel", "lo wor", "ld 1234\r\n", "hello again\r\n", "\r\n", 0,
+    };
+    const int nchunks = 1000 * 5;
+
+    double t0, t1;
+    const int before = output_run(0, chunks, & t0);
+    const int after = output_run(256, chunks, & t1);
+
+    printf("output : %d chunks, unbuffered %d writes %.3fms, buffered %d writes %.3fms\n",
+            nchunks, before, t0 * 1e3, after, t1 * 1e3);
+
+    EXPECT_LE(after, nchunks);
+    EXPECT_LT(after, before);
+}
+
+    /*
+     *  Command lookup : linear list vs hash index
+     */
+
+static double lookup_run(int width, bool index, const char *fmt)
+{
+    NullOut null = { open("/dev/null", O_WRONLY), 0 };
+    CliOutput out = { null_fprintf, & null };
+
+    CLI cli = {
+        .output = & out,
+        .prompt = "",
+        .eol = "",
+    };
+
+    CliCommand *cmds = new CliCommand[width];
+    char (*names)[16] = new char[width][16];
+
+    cli_init(& cli, 64, 0);
+    cli_set_index(& cli, index ? 16 : 0);
+    for (int i = 0; i < width; i++)
+    {
+        snprintf(names[i], sizeof(names[i]), "cmd%d", i);
+        memset(& cmds[i], 0, sizeof(CliCommand));
+        cmds[i].cmd = names[i];
+        cli_register(& cli, & cmds[i]);
+    }
+    cli.echo = false;
+
+    // keep the total work roughly constant
+    const int lookups = (width > 1000) ? 200 : 2000;
+    char line[32];
+
+    // build the index before timing
+    int n = snprintf(line, sizeof(line), fmt, 0);
+    cli_process_buffer(& cli, line, (size_t) n);
+
+    const double start = now();
+    for (int i = 0; i < lookups; i++)
+    {
+        n = snprintf(line, sizeof(line), fmt, (i * 7919) % width);
+        cli_process_buffer(& cli, line, (size_t) n);
+    }
+    const double t = (now() - start) / lookups;
+
+    cli_close(& cli);
+    close(null.fd);
+    delete[] names;
+    delete[] cmds;
+    return t;
+}
+
+TEST(Bench, Lookup)
+{
+    for (int width = 10; width <= 100000; width *= 10)
+    {
+        const double linear = lookup_run(width, false, "cmd%d\n");
+        const double hashed = lookup_run(width, true, "cmd%d\n");
+
+        printf("lookup : %6d commands, list %9.3fus, index %9.3fus\n",
+                width, linear * 1e6, hashed * 1e6);
+    }
+}
+
+TEST(Bench, Autocomplete)
+{
+    // complete the words then run the command
+    for (int width = 10; width <= 100000; width *= 10)
+    {
+        const double linear = lookup_run(width, false, "cmd%d \t\n");
+        const double trie = lookup_run(width, true, "cmd%d \t\n");
+
+        printf("complete : %6d commands, list %9.3fus, trie %9.3fus\n",
+                width, linear * 1e6, trie * 1e6);
+    }
+}
+
+    /*
+     *  Start-up : registering many commands in order
+     */
+
+static double register_run(int width, bool tail)
+{
+    NullOut null = { open("/dev/null", O_WRONLY), 0 };
+    CliOutput out = { null_fprintf, & null };
+    CLI cli = {
+        .output = & out,
+        .prompt = "",
+        .eol = "",
+    };
+
+    CliCommand *cmds = new CliCommand[width];
+    char (*names)[16] = new char[width][16];
+
+    cli_init(& cli, 64, 0);
+    for (int i = 0; i < width; i++)
+    {
+        snprintf(names[i], sizeof(names[i]), "cmd%d", i);
+        memset(& cmds[i], 0, sizeof(CliCommand));
+        cmds[i].cmd = names[i];
+    }
+
+    const double start = now();
+    for (int i = 0; i < width; i++)
+    {
+        if (tail)
+        {
+            cli_append(& cli, & cmds[i]);
+        }
+        else
+        {
+            // walk the list each time, as cli_append used to
+            CliCommand **end = & cli.head;
+            for (; *end; end = & (*end)->next)
+                ;
+            cli_insert(& cli, end, & cmds[i]);
+        }
+    }
+    const double t = now() - start;
+
+    cli_close(& cli);
+    close(null.fd);
+    delete[] names;
+    delete[] cmds;
+    return t;
+}
+
+TEST(Bench, Register)
+{
+    for (int width = 1000; width <= 100000; width *= 10)
+    {
+        const double t1 = register_run(width, true);
+
+        // the walk is O(N^2) : too slow to run at 100k
+        if (width <= 10000)
+        {
+            const double t0 = register_run(width, false);
+            printf("register : %6d commands, walk %9.3fms, tail %9.3fms\n", width, t0 * 1e3, t1 * 1e3);
+        }
+        else
+        {
+            printf("register : %6d commands, tail %9.3fms\n", width, t1 * 1e3);
+        }
+    }
+}
+
+    /*
+     *  List traversal : runtime Mutex* vs compile time lock policy
+     */
+
+typedef struct BenchItem
+{
+    struct BenchItem *next;
+    int value;
+}   BenchItem;
+
+static BenchItem **bench_next(BenchItem *item)
+{
+    return & item->next;
+}
+
+static int bench_match(BenchItem *item, void *arg)
+{
+    return item->value == *(int*) arg;
+}
+
+static const int list_items = 100;
+static const int list_finds = 20000;
+
+static double list_run(Mutex *mutex)
+{
+    List<BenchItem*> list(bench_next);
+    BenchItem items[list_items];
+
+    for (int i = 0; i < list_items; i++)
+    {
+        items[i].value = i;
+        list.push(& items[i], mutex);
+    }
+
+    const double start = now();
+    for (int i = 0; i < list_finds; i++)
+    {
+        int match = i % list_items;
+        EXPECT_TRUE(list.find(bench_match, & match, mutex));
+    }
+    return now() - start;
+}
+
+template <class Policy>
+static double list_run()
+{
+    List<BenchItem*, Policy> list;
+    BenchItem items[list_items];
+
+    for (int i = 0; i < list_items; i++)
+    {
+        items[i].value = i;
+        list.push(& items[i]);
+    }
+
+    const double start = now();
+    for (int i = 0; i < list_finds; i++)
+    {
+        int match = i % list_items;
+        EXPECT_TRUE(list.find(bench_match, & match));
+    }
+    return now() - start;
+}
+
+TEST(Bench, ListSize)
+{
+    const int size = 10000;
+    BenchItem *items = new BenchItem[size];
+    List<BenchItem*> list(bench_next);
+    Queue<BenchItem*> queue(bench_next);
+
+    for (int i = 0; i < size; i++)
+    {
+        list.push(& items[i], 0);
+    }
+    const double start = now();
+    for (int i = 0; i < 100; i++)
+    {
+        EXPECT_EQ(size, list.size(0));
+    }
+    const double t0 = now() - start;
+
+    list.head = 0;
+    for (int i = 0; i < size; i++)
+    {
+        queue.append(& items[i], 0);
+    }
+    const double mid = now();
+    for (int i = 0; i < 100; i++)
+    {
+        EXPECT_EQ(size, queue.size(0));
+    }
+    const double t1 = now() - mid;
+
+    printf("list size : %d items, walked %.3fus, counted %.3fus\n", size, t0 * 1e4, t1 * 1e4);
+
+    delete[] items;
+}
+
+    /*
+     *  Ordered sets : list_add_sorted vs skip list
+     */
+
+static int bench_cmp(BenchItem *a, BenchItem *b)
+{
+    return b->value - a->value;
+}
+
+static double sorted_run(int size, bool skip, double *drain)
+{
+    BenchItem *items = new BenchItem[size];
+    List<BenchItem*> list(bench_next);
+    SortedList<BenchItem*> sorted(bench_cmp, 0);
+
+    for (int i = 0; i < size; i++)
+    {
+        items[i].value = (int) ((i * 7919L) % size);
+    }
+
+    const double start = now();
+    for (int i = 0; i < size; i++)
+    {
+        if (skip)
+        {
+            sorted.add(& items[i]);
+        }
+        else
+        {
+            list.add_sorted(& items[i], bench_cmp, 0);
+        }
+    }
+    const double t = now() - start;
+
+    // as a priority queue
+    const double mid = now();
+    int last = -1;
+    for (int i = 0; i < size; i++)
+    {
+        BenchItem *item = skip ? sorted.pop() : list.pop(0);
+        EXPECT_LE(last, item->value);
+        last = item->value;
+    }
+    *drain = now() - mid;
+
+    delete[] items;
+    return t;
+}
+
+TEST(Bench, SkipList)
+{
+    for (int size = 100; size <= 10000; size *= 10)
+    {
+        double d0, d1;
+        const double t0 = sorted_run(size, false, & d0);
+        const double t1 = sorted_run(size, true, & d1);
+
+        printf("sorted : %5d items, add_sorted %9.3fms, skip list %9.3fms : pop all %7.3fms, %7.3fms\n",
+                size, t0 * 1e3, t1 * 1e3, d0 * 1e3, d1 * 1e3);
+    }
+}
+
+TEST(Bench, ListIterate)
+{
+    List<BenchItem*> list(bench_next);
+    BenchItem items[list_items];
+
+    for (int i = 0; i < list_items; i++)
+    {
+        items[i].value = i;
+        list.push(& items[i], 0);
+    }
+
+    // callbacks through list.cpp
+    double start = now();
+    for (int i = 0; i < list_finds; i++)
+    {
+        int match = i % list_items;
+        EXPECT_TRUE(list.find(bench_match, & match, 0));
+    }
+    const double t0 = now() - start;
+
+    // inlined loop and lambda
+    start = now();
+    for (int i = 0; i < list_finds; i++)
+    {
+        const int match = i % list_items;
+        EXPECT_TRUE(list_find_if(& list.head, [match](BenchItem *item) { return item->value == match; }));
+    }
+    const double t1 = now() - start;
+
+    printf("list iterate : callback %.3fms, inlined %.3fms\n", t0 * 1e3, t1 * 1e3);
+}
+
+TEST(Bench, ListPolicy)
+{
+    Mutex *mutex = Mutex::create();
+
+    const double t0 = list_run(0);
+    const double t1 = list_run(mutex);
+    const double t2 = list_run<NullLock>();
+    const double t3 = list_run<SpinLock>();
+    const double t4 = list_run<PthreadLock>();
+
+    printf("list find : Mutex* null %.3fms, LinuxMutex %.3fms, NullLock %.3fms, SpinLock %.3fms, PthreadLock %.3fms\n",
+            t0 * 1e3, t1 * 1e3, t2 * 1e3, t3 * 1e3, t4 * 1e3);
+
+    delete mutex;
+}
+
+    /*
+     *  Push / pop throughput : list_push / list_pop with a mutex vs the lock-free stack
+     */
+
+static const int pool_size = 64;
+static const int pool_ops = 64000;
+
+typedef struct {
+    pthread_t thread;
+    List<BenchItem*> *list;
+    Stack<BenchItem*> *stack;
+    Mutex *mutex;
+    int n;
+}   PoolInfo;
+
+static void *pool_thread(void *arg)
+{
+    PoolInfo *pi = (PoolInfo*) arg;
+
+    for (int i = 0; i < pi->n; i++)
+    {
+        if (pi->stack)
+        {
+            BenchItem *item = pi->stack->pop();
+            if (item)
+            {
+                pi->stack->push(item);
+            }
+        }
+        else
+        {
+            BenchItem *item = pi->list->pop(pi->mutex);
+            if (item)
+            {
+                pi->list->push(item, pi->mutex);
+            }
+        }
+    }
+    return 0;
+}
+
+static double pool_run(Mutex *mutex, bool lock_free, int threads)
+{
+    List<BenchItem*> list(bench_next);
+    Stack<BenchItem*> stack(bench_next);
+    BenchItem items[pool_size];
+    PoolInfo *info = new PoolInfo[threads];
+
+    for (int i = 0; i < pool_size; i++)
+    {
+        if (lock_free)
+        {
+            stack.push(& items[i]);
+        }
+        else
+        {
+            list.push(& items[i], mutex);
+        }
+    }
+
+    const double start = now();
+    for (int i = 0; i < threads; i++)
+    {
+        info[i].list = & list;
+        info[i].stack = lock_free ? & stack : 0;
+        info[i].mutex = mutex;
+        info[i].n = pool_ops / threads;
+        pthread_create(& info[i].thread, 0, pool_thread, & info[i]);
+    }
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_join(info[i].thread, 0);
+    }
+    const double t = now() - start;
+
+    // nothing lost
+    int count = 0;
+    if (lock_free)
+    {
+        for (BenchItem *item = stack.pop_all(); item; item = item->next)
+        {
+            count += 1;
+        }
+    }
+    else
+    {
+        count = list.size(mutex);
+    }
+    EXPECT_EQ(pool_size, count);
+
+    delete[] info;
+    return t;
+}
+
+TEST(Bench, Stack)
+{
+    Mutex *mutex = Mutex::create();
+
+    for (int threads = 1; threads <= 16; threads *= 4)
+    {
+        const double t0 = pool_run(mutex, false, threads);
+        const double t1 = pool_run(0, true, threads);
+
+        printf("pop / push : %2d threads, %d pairs, mutex %8.3fms (%.1fM/s), lock-free %8.3fms (%.1fM/s)\n",
+                threads, pool_ops, t0 * 1e3, pool_ops / t0 / 1e6, t1 * 1e3, pool_ops / t1 / 1e6);
+    }
+
+    delete mutex;
+}
+
+    /*
+     *  Short critical sections : pthread mutex vs spin-then-futex
+     */
+
+typedef struct {
+    pthread_t thread;
+    Mutex *mutex;
+    int n;
+    long *counter;
+}   LockInfo;
+
+static void *lock_thread(void *arg)
+{
+    LockInfo *li = (LockInfo*) arg;
+
+    for (int i = 0; i < li->n; i++)
+    {
+        Lock lock(li->mutex);
+        *li->counter += 1;
+    }
+
+    return 0;
+}
+
+static double lock_run(Mutex *mutex, int threads)
+{
+    const int total = 256000;
+    LockInfo *info = new LockInfo[threads];
+    long counter = 0;
+
+    const double start = now();
+    for (int i = 0; i < threads; i++)
+    {
+        info[i].mutex = mutex;
+        info[i].n = total / threads;
+        info[i].counter = & counter;
+        pthread_create(& info[i].thread, 0, lock_thread, & info[i]);
+    }
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_join(info[i].thread, 0);
+    }
+    const double t = now() - start;
+
+    EXPECT_EQ(total, counter);
+    delete[] info;
+    return t;
+}
+
+TEST(Bench, CriticalSection)
+{
+    Mutex *mutex = Mutex::create();
+    Mutex *cs = Mutex::create_critical_section();
+
+    for (int threads = 1; threads <= 64; threads *= 4)
+    {
+        const double t0 = lock_run(mutex, threads);
+        const double t1 = lock_run(cs, threads);
+
+        printf("lock : %2d threads, 256000 locks, mutex %8.3fms, critical section %8.3fms\n",
+                threads, t0 * 1e3, t1 * 1e3);
+    }
+
+    delete cs;
+    delete mutex;
+}
+
+    /*
+     *  Mixed fast and slow commands from several sessions : inline, or on
+     *  the work-stealing pool. The slow ones either wait (eg. on I/O) or
+     *  use the CPU. All the input arrives at once : latency is from then
+     *  to the end of the handler.
+     */
+
+static const int exec_sessions = 8;
+static const int exec_lines = 50;   // per session, 1 in 10 slow
+
+static double exec_done[exec_sessions * exec_lines];
+static bool exec_spin = false;
+
+static void exec_fast(CLI *cli, CliCommand *cmd)
+{
+    UNUSED(cmd);
+    exec_done[atoi(cli_get_arg(cli, 0))] = now();
+    cli_print(cli, "ok%s", cli->eol);
+}
+
+static void exec_slow(CLI *cli, CliCommand *cmd)
+{
+    UNUSED(cmd);
+    if (exec_spin)
+    {
+        for (const double end = now() + 0.0005; now() < end; )
+            ;
+    }
+    else
+    {
+        usleep(1000);
+    }
+    exec_done[atoi(cli_get_arg(cli, 0))] = now();
+    cli_print(cli, "ok%s", cli->eol);
+}
+
+static double exec_run(int threads, bool fast_inline, double *p99)
+{
+    NullOut null = { open("/dev/null", O_WRONLY), 0 };
+    CliOutput out = { null_fprintf, & null };
+
+    CliCommand fast = { .cmd = "fast", .handler = exec_fast, };
+    CliCommand slow = { .cmd = "slow", .handler = exec_slow, };
+    if (fast_inline)
+    {
+        fast.flags = CLI_INLINE;
+    }
+
+    CliPool *pool = threads ? cli_pool_create(threads) : 0;
+
+    CLI clis[exec_sessions];
+    for (int i = 0; i < exec_sessions; i++)
+    {
+        CLI *cli = & clis[i];
+        memset(cli, 0, sizeof(CLI));
+        cli->output = & out;
+        cli->prompt = "> ";
+        cli->eol = "\r\n";
+        cli_init(cli, 64, 0);
+        cli->echo = false;
+        cli_register(cli, & fast);
+        cli_register(cli, & slow);
+        if (pool)
+        {
+            cli_set_executor(cli, cli_pool_executor(pool));
+        }
+    }
+
+    const double start = now();
+    for (int line = 0; line < exec_lines; line++)
+    {
+        for (int i = 0; i < exec_sessions; i++)
+        {
+            const int idx = (line * exec_sessions) + i;
+            char text[32];
+            const int n = snprintf(text, sizeof(text), "%s %d\n", ((idx % 10) == 3) ? "slow" : "fast", idx);
+            cli_process_buffer(& clis[i], text, (size_t) n);
+        }
+    }
+    if (pool)
+    {
+        cli_pool_wait(pool);
+    }
+    for (int i = 0; i < exec_sessions; i++)
+    {
+        cli_poll(& clis[i]);
+    }
+    const double t = now() - start;
+
+    std::vector<double> latency;
+    for (int idx = 0; idx < (exec_sessions * exec_lines); idx++)
+    {
+        if ((idx % 10) != 3)
+        {
+            latency.push_back(exec_done[idx] - start);
+        }
+    }
+    std::sort(latency.begin(), latency.end());
+    *p99 = latency[(latency.size() * 99) / 100];
+
+    for (int i = 0; i < exec_sessions; i++)
+    {
+        cli_close(& clis[i]);
+    }
+    cli_pool_delete(pool);
+    close(null.fd);
+    return t;
+}
+
+TEST(Bench, Executor)
+{
+    for (int spin = 0; spin < 2; spin++)
+    {
+        exec_spin = spin;
+        const char *kind = spin ? "cpu" : "wait";
+
+        double p99;
+        const double t = exec_run(0, false, & p99);
+        printf("executor : %-4s slow, inline            : %7.3fms, fast p99 %7.3fms\n", kind, t * 1e3, p99 * 1e3);
+
+        for (int threads = 1; threads <= 8; threads *= 2)
+        {
+            const double t0 = exec_run(threads, false, & p99);
+            printf("executor : %-4s slow, %d threads         : %7.3fms, fast p99 %7.3fms\n", kind, threads, t0 * 1e3, p99 * 1e3);
+            const double t1 = exec_run(threads, true, & p99);
+            printf("executor : %-4s slow, %d threads, inline : %7.3fms, fast p99 %7.3fms\n", kind, threads, t1 * 1e3, p99 * 1e3);
+        }
+    }
+}
+
+    /*
+     *  Scripts : each char through cli_process(), as the 'file' command in
+     *  cli_test.cpp does, vs cli_run_lines()
+     */
+
+static double script_run(bool lines, const std::string &script)
+{
+    NullOut null = { open("/dev/null", O_WRONLY), 0 };
+    CliOutput out = { null_fprintf, & null };
+
+    CliCommand a0 = {
+        .cmd = "hello",
+        .handler = cli_nowt,
+    };
+
+    CLI cli = {
+        .output = & out,
+        .prompt = "> ",
+        .eol = "\r\n",
+    };
+
+    cli_init(& cli, 64, 0);
+    cli_register(& cli, & a0);
+
+    const double start = now();
+    if (lines)
+    {
+        EXPECT_EQ(0, cli_run_lines(& cli, 0, script.data(), script.size(), 0));
+    }
+    else
+    {
+        for (size_t i = 0; i < script.size(); i++)
+        {
+            cli_process(& cli, script[i]);
+        }
+    }
+    const double t = now() - start;
+
+    cli_close(& cli);
+    close(null.fd);
+    return t;
+}
+
+TEST(Bench, Script)
+{
+    const int size = 20000;
+    std::string script;
+    for (int i = 0; i < size; i++)
+    {
+        script += "hello world 1234 5678\n";
+    }
+
+    const double t0 = script_run(false, script);
+    const double t1 = script_run(true, script);
+    printf("script : %d lines, cli_process %.3fms, cli_run_lines %.3fms\n", size, t0 * 1e3, t1 * 1e3);
+}
+
+    /*
+     *  Machine mode vs interactive : lines / s, fed in socket sized chunks
+     */
+
+static double machine_run(const char *marker, bool echo, const std::string &input)
+{
+    NullOut null = { open("/dev/null", O_WRONLY), 0 };
+    CliOutput out = { null_fprintf, & null };
+
+    CliCommand a0 = {
+        .cmd = "hello",
+        .handler = bench_nowt,
+    };
+
+    CLI cli = {
+        .output = & out,
+        .prompt = "> ",
+        .eol = "\r\n",
+    };
+
+    cli_init(& cli, 64, 0);
+    cli_register(& cli, & a0);
+    cli_set_output_buffer(& cli, 4096, 0);
+    cli.echo = echo;
+    cli_set_machine(& cli, marker);
+
+    const size_t chunk = 4096;
+    const double start = now();
+    for (size_t i = 0; i < input.size(); i += chunk)
+    {
+        const size_t n = ((input.size() - i) < chunk) ? (input.size() - i) : chunk;
+        cli_process_buffer(& cli, & input[i], n);
+    }
+    const double t = now() - start;
+
+    cli_close(& cli);
+    close(null.fd);
+    return t;
+}
+
+TEST(Bench, Machine)
+{
+    const int size = 100000;
+    std::string input;
+    for (int i = 0; i < size; i++)
+    {
+        input += "hello world 1234 5678\r\n";
+    }
+
+    const double t0 = machine_run(0, true, input);
+    const double t1 = machine_run(0, false, input);
+    const double t2 = machine_run(".", false, input);
+    printf("lines : %d, interactive %.0f/s, no echo %.0f/s, machine %.0f/s\n",
+            size, size / t0, size / t1, size / t2);
+}
+
+//  FIN
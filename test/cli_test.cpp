@@ -11,14 +11,53 @@
      *
      */
 
+static void cli_send_buffer(CLI *cli, const char* s)
+{
+    cli_process_buffer(cli, s, strlen(s));
+}
+
+static bool bulk = false;
+
 static void cli_send(CLI *cli, const char* s)
 {
+    if (bulk)
+    {
+        cli_send_buffer(cli, s);
+        return;
+    }
+
     for (; *s; s++)
     {
         cli_process(cli, *s);
     }
 }
 
+    /*
+     *  The tests that type input run twice : char by char through
+     *  cli_process(), then through cli_process_buffer()
+     */
+
+class CliInput : public ::testing::TestWithParam<bool>
+{
+protected:
+    virtual void SetUp()
+    {
+        bulk = GetParam();
+    }
+
+    virtual void TearDown()
+    {
+        bulk = false;
+    }
+};
+
+static std::string input_name(const ::testing::TestParamInfo<bool> &info)
+{
+    return info.param ? "Buffer" : "Chars";
+}
+
+INSTANTIATE_TEST_SUITE_P(CLI, CliInput, ::testing::Values(false, true), input_name);
+
     /*
      *
      */
@@ -42,7 +81,7 @@ static void action_handler(CLI *cli, CliCommand *cmd)
     got_action = true;
 }
 
-TEST(CLI, Create)
+TEST_P(CliInput, Create)
 {
     CliCommand action = {
         .cmd = "help",
@@ -62,7 +101,7 @@ TEST(CLI, Create)
     cli_close(& cli);
 }
 
-TEST(CLI, Close)
+TEST_P(CliInput, Close)
 {
     CliCommand action = {
         .cmd = "help",
@@ -97,7 +136,7 @@ static void cli_die(CLI *cli, CliCommand *cmd)
     ASSERT(false);
 }
 
-TEST(CLI, Help)
+TEST_P(CliInput, Help)
 {
 #define HELP0 "one line of text" 
 #define HELP1 "another help line"
@@ -153,7 +192,7 @@ TEST(CLI, Help)
     cli_close(& cli);
 }
 
-TEST(CLI, HelpSub)
+TEST_P(CliInput, HelpSub)
 {
     CliCommand a2 = {
         .cmd = "another",
@@ -197,7 +236,7 @@ TEST(CLI, HelpSub)
     cli_close(& cli);
 }
 
-TEST(CLI, Backspace)
+TEST_P(CliInput, Backspace)
 {
     CliCommand a0 = {
         .cmd = "help",
@@ -256,7 +295,7 @@ void check_ctx(CLI *cli, CliCommand *cmd)
     EXPECT_EQ(cli->ctx, ctx_text);
 }
 
-TEST(CLI, Context)
+TEST_P(CliInput, Context)
 {
     CliCommand a0 = {
         .cmd = "help",
@@ -277,7 +316,7 @@ TEST(CLI, Context)
     cli_close(& cli);
 }
 
-TEST(CLI, EmptyLine)
+TEST_P(CliInput, EmptyLine)
 {
     CliCommand a0 = {
         .cmd = "help",
@@ -295,7 +334,7 @@ TEST(CLI, EmptyLine)
     cli_close(& cli);
 }
 
-TEST(CLI, OverflowLine)
+TEST_P(CliInput, OverflowLine)
 {
     CliCommand a0 = {
         .cmd = "help",
@@ -371,7 +410,7 @@ static void dev_power(CLI *cli, CliCommand *cmd)
      *
      */
 
-TEST(CLI, Power)
+TEST_P(CliInput, Power)
 {
     CliCommand s0 = {
         .cmd = "laser",
@@ -440,7 +479,7 @@ static void bye(CLI *cli, CliCommand *cmd)
     ctx->done = true;
 }
 
-TEST(CLI, Input)
+TEST_P(CliInput, Input)
 {
     CliCommand a0 = {
         .cmd = "hello",
@@ -485,7 +524,7 @@ TEST(CLI, Input)
      *
      */
 
-TEST(CLI, AutoComplete)
+static void autocomplete_test(size_t index)
 {
     CliCommand s2 = {
         .cmd = "three",
@@ -539,6 +578,7 @@ TEST(CLI, AutoComplete)
     };
 
     cli_init(& cli, 64, 0);
+    cli_set_index(& cli, index);
     cli_register(& cli, & a4);
     cli_register(& cli, & a3);
     cli_register(& cli, & a2);
@@ -640,6 +680,100 @@ TEST(CLI, AutoComplete)
     cli_close(& cli);
 }
 
+TEST_P(CliInput, AutoComplete)
+{
+    autocomplete_test(0);
+}
+
+TEST_P(CliInput, AutoCompleteIndex)
+{
+    // same output using the radix trie
+    autocomplete_test(16);
+}
+
+TEST_P(CliInput, AutoCompleteMidLine)
+{
+    CliCommand s0 = {
+        .cmd = "one",
+        .handler = cli_nowt,
+    };
+    CliCommand a0 = {
+        .cmd = "hello",
+        .handler = cli_nowt,
+        .subcommand = & s0,
+    };
+    CliCommand a1 = {
+        .cmd = "byte",
+        .handler = cli_nowt,
+    };
+    CliCommand a2 = {
+        .cmd = "bye",
+        .handler = cli_nowt,
+    };
+
+    for (size_t index = 0; index <= 16; index += 16)
+    {
+        cli_init(& cli, 64, 0);
+        cli_set_index(& cli, index);
+        cli_register(& cli, & a2);
+        cli_register(& cli, & a1);
+        cli_register(& cli, & a0);
+
+        // complete the text before the cursor, in one write
+        cli_send(& cli, "he 123\eD\eD\eD\eD");
+        io.reset();
+        cli_send(& cli, "\t");
+        EXPECT_STREQ("llo  123\b\b\b\b", io.get());
+        EXPECT_STREQ("hello  123", cli.buff);
+        EXPECT_EQ(6, cli.cursor);
+
+        cli_send(& cli, "o");
+        io.reset();
+        cli_send(& cli, "\t");
+        EXPECT_STREQ("ne  123\b\b\b\b", io.get());
+        EXPECT_STREQ("hello one  123", cli.buff);
+        EXPECT_EQ(10, cli.cursor);
+        cli_send(& cli, "\n");
+
+        // list the candidates, then put the cursor back
+        cli_send(& cli, "by 1\eD\eD");
+        io.reset();
+        cli_send(& cli, "\t");
+        EXPECT_STREQ("\r\nbyte\r\nbye\r\n> by 1\b\b", io.get());
+        EXPECT_EQ(2, cli.cursor);
+        cli_send(& cli, "\n");
+
+        // ANSI terminal : a single insert
+        cli.ansi = true;
+        cli_send(& cli, "he 123\eD\eD\eD\eD");
+        io.reset();
+        cli_send(& cli, "\t");
+        EXPECT_STREQ("\e[4@llo ", io.get());
+        EXPECT_STREQ("hello  123", cli.buff);
+        cli_send(& cli, "\n");
+
+        cli_send(& cli, "by 1\eD\eD");
+        io.reset();
+        cli_send(& cli, "\t");
+        EXPECT_STREQ("\r\nbyte\r\nbye\r\n> by 1\b\b", io.get());
+        cli_send(& cli, "\n");
+
+        // no room for the completion
+        cli.ansi = false;
+        cli_close(& cli);
+        cli_init(& cli, 8, 0);
+        cli_set_index(& cli, index);
+        cli_register(& cli, & a0);
+        cli_send(& cli, "hello o");
+        io.reset();
+        cli_send(& cli, "\t");
+        EXPECT_STREQ("\r\n> ", io.get());
+        EXPECT_STREQ("", cli.buff);
+
+        cli_close(& cli);
+    }
+}
+
     /*
      *
      */
@@ -653,7 +787,7 @@ static void sub(CLI *cli, CliCommand *cmd)
     cli_print(cli, "got %s '%s' %d\r\n", cmd->cmd, s, v);
 }
 
-TEST(CLI, Subcommand)
+TEST_P(CliInput, Subcommand)
 {
     int i0 = 3;
     CliCommand a0 = {
@@ -724,6 +858,87 @@ TEST(CLI, Subcommand)
     cli_close(& cli);
 }
 
+    /*
+     *
+     */
+
+static void show_args(CLI *cli, CliCommand *cmd)
+{
+    cli_print(cli, "%s %d", cmd->cmd, cli_argc(cli));
+    for (int i = 0; i < cli_argc(cli); i++)
+    {
+        const char *s = cli_get_arg(cli, i);
+        EXPECT_EQ(strlen(s), cli_get_arg_len(cli, i));
+        cli_print(cli, " [%s]", s);
+    }
+    cli_print(cli, "%s", cli->eol);
+}
+
+TEST_P(CliInput, Args)
+{
+    CliCommand s0 = {
+        .cmd = "sub",
+        .handler = show_args,
+    };
+    CliCommand a0 = {
+        .cmd = "args",
+        .handler = show_args,
+        .subcommand = & s0,
+    };
+
+    cli_init(& cli, 128, 0);
+    cli_register(& cli, & a0);
+    cli.echo = false;
+
+    io.reset();
+    cli_send(& cli, "args\n");
+    EXPECT_STREQ("args 0\r\n> ", io.get());
+    EXPECT_EQ(0, cli_get_arg(& cli, 0));
+    EXPECT_EQ(0, cli_get_arg_len(& cli, 0));
+
+    io.reset();
+    cli_send(& cli, "  args   one  two \n");
+    EXPECT_STREQ("args 2 [one] [two]\r\n> ", io.get());
+
+    // more than CLI_MAX_ARGS
+    io.reset();
+    cli_send(& cli, "args 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17\n");
+    EXPECT_STREQ("args 17 [1] [2] [3] [4] [5] [6] [7] [8] [9] [10] [11] [12] [13] [14] [15] [16] [17]\r\n> ", io.get());
+
+    // quotes and escapes
+    io.reset();
+    cli_send(& cli, "args \"hello world\" 'a \\b' x\\ y \"q\\\"\" \"\" ab'cd'\"ef\"\n");
+    EXPECT_STREQ("args 6 [hello world] [a \\b] [x y] [q\"] [] [abcdef]\r\n> ", io.get());
+
+    // the command name can be quoted too
+    io.reset();
+    cli_send(& cli, "'args' \"sub\" x\n");
+    EXPECT_STREQ("sub 1 [x]\r\n> ", io.get());
+
+    // cli_argc() counts from after the subcommand
+    io.reset();
+    cli_send(& cli, "args sub\n");
+    EXPECT_STREQ("sub 0\r\n> ", io.get());
+
+    io.reset();
+    cli_send(& cli, "args 'sub x\n");
+    EXPECT_STREQ("unterminated quote\r\n> ", io.get());
+
+    // caller supplied storage does not grow
+    CliArg storage[3];
+    cli_set_arg_storage(& cli, storage, 3);
+
+    io.reset();
+    cli_send(& cli, "args a b\n");
+    EXPECT_STREQ("args 2 [a] [b]\r\n> ", io.get());
+
+    io.reset();
+    cli_send(& cli, "args a b c\n");
+    EXPECT_STREQ("too many args\r\n> ", io.get());
+
+    cli_close(& cli);
+}
+
 static void cli_source(CLI *cli, CliCommand *cmd)
 {
     UNUSED(cmd);
@@ -782,7 +997,7 @@ static void echo(CLI *cli, CliCommand *cmd)
     cli_print(cli, "%s", cli->eol);
 }
 
-TEST(CLI, File)
+TEST_P(CliInput, File)
 {
     CliCommand a0 = {
         .cmd = "three",
@@ -842,7 +1057,7 @@ TEST(CLI, File)
     cli_close(& cli);
 }
 
-TEST(CLI, Two)
+TEST_P(CliInput, Two)
 {
     CliCommand a0 = {
         .cmd = "three",
@@ -907,7 +1122,7 @@ TEST(CLI, Two)
      *
      */
 
-TEST(CLI, Edit)
+TEST_P(CliInput, Edit)
 {
     CliCommand a0 = {
         .cmd = "nowt",
@@ -1072,6 +1287,88 @@ TEST(CLI, Edit)
     EXPECT_EQ(3, cli.end);
     EXPECT_EQ(2, cli.cursor);
 
+    cli_close(& cli);
+}
+
+    /*
+     *  Edit using ANSI escape sequences
+     */
+
+TEST_P(CliInput, EditAnsi)
+{
+    CliCommand a0 = {
+        .cmd = "nowt",
+        .handler = cli_nowt,
+    };
+
+    cli_init(& cli, 64, 0);
+    cli_register(& cli, & a0);
+    cli.ansi = true;
+
+    // typing at the end of the line is just echoed
+    io.reset();
+    cli_send(& cli, "help");
+    EXPECT_STREQ("help", io.get());
+    EXPECT_STREQ("help", cli.buff);
+
+    // single moves are a backspace / overtype
+    io.reset();
+    cli_send(& cli, "\eD\eD");
+    EXPECT_STREQ("\b\b", io.get());
+    EXPECT_EQ(2, cli.cursor);
+
+    // insert char
+    io.reset();
+    cli_send(& cli, "X");
+    EXPECT_STREQ("heXlp", cli.buff);
+    EXPECT_STREQ("\e[@X", io.get());
+    EXPECT_EQ(3, cli.cursor);
+
+    // delete char
+    io.reset();
+    cli_send(& cli, "\b");
+    EXPECT_STREQ("help", cli.buff);
+    EXPECT_STREQ("\b\e[P", io.get());
+    EXPECT_EQ(2, cli.cursor);
+
+    io.reset();
+    cli_send(& cli, "\eC");
+    EXPECT_STREQ("l", io.get());
+    EXPECT_EQ(3, cli.cursor);
+
+    // delete at the end of the line
+    cli_send(& cli, "\eC");
+    io.reset();
+    cli_send(& cli, "\b");
+    EXPECT_STREQ("hel", cli.buff);
+    EXPECT_STREQ("\b\e[P", io.get());
+    cli_send(& cli, "\n");
+
+    // edits at the start of a long line cost the same as at the end
+    const char *text = "0123456789012345678901234567890123456789";
+    cli_send(& cli, text);
+    for (size_t i = 0; i < strlen(text); i++)
+    {
+        cli_send(& cli, "\eD");
+    }
+    EXPECT_EQ(0, cli.cursor);
+
+    io.reset();
+    cli_send(& cli, "Z");
+    EXPECT_STREQ("\e[@Z", io.get());
+    EXPECT_EQ(1, cli.cursor);
+
+    io.reset();
+    cli_send(& cli, "\b");
+    EXPECT_STREQ("\b\e[P", io.get());
+    EXPECT_STREQ(text, cli.buff);
+    EXPECT_EQ(0, cli.cursor);
+
+    // same as the dumb terminal
+    io.reset();
+    cli_send(& cli, "\n");
+    EXPECT_STREQ("\n'0123456789012345678901234567890123456789' not found\r\n> ", io.get());
+
     cli_close(& cli);
 }
 
@@ -1144,7 +1441,7 @@ public:
     }
 };
 
-TEST(CLI, GPIO)
+static void gpio_test(size_t index)
 {
     GpioCmd g0("PD5", & pd5);
     GpioCmd g1("PB2", & pb2);
@@ -1156,6 +1453,7 @@ TEST(CLI, GPIO)
     };
 
     cli_init(& cli, 64, 0);
+    cli_set_index(& cli, index);
     cli_register(& cli, & a0);
     g0.add(& cli, & a0);
     g1.add(& cli, & a0);
@@ -1233,6 +1531,16 @@ TEST(CLI, GPIO)
     cli_close(& cli);
 }
 
+TEST_P(CliInput, GPIO)
+{
+    gpio_test(0);
+}
+
+TEST_P(CliInput, GPIOIndex)
+{
+    gpio_test(16);
+}
+
     /*
      *
      */
@@ -1448,7 +1756,7 @@ static void echo_cmd(CLI *cli, CliCommand *cmd)
     cli_print(cli, "%s", cli->eol);
 }
 
-TEST(CLI, Echo)
+TEST_P(CliInput, Echo)
 {
     io.reset();
 
@@ -1501,4 +1809,507 @@ TEST(CLI, Echo)
     cli_close(& cli);
 }
 
+    /*
+     *  Check that cli_process_buffer() matches the char by char path
+     */
+
+struct BufferResult
+{
+    char *out;
+    char *buff;
+    size_t end;
+    size_t cursor;
+};
+
+static void buffer_run(BufferResult *r, size_t size, bool ansi, const char *s, size_t chunk)
+{
+    CliCommand a0 = {
+        .cmd = "hello",
+        .handler = echo_cmd,
+    };
+    CliCommand a1 = {
+        .cmd = "help",
+        .handler = cli_help,
+    };
+    CliCommand a2 = {
+        .cmd = "helper",
+        .handler = echo_cmd,
+    };
+
+    io.reset();
+    cli_init(& cli, size, 0);
+    cli_register(& cli, & a2);
+    cli_register(& cli, & a1);
+    cli_register(& cli, & a0);
+    cli.ansi = ansi;
+
+    if (!chunk)
+    {
+        cli_send(& cli, s);
+    }
+    else
+    {
+        for (size_t len = strlen(s); len; )
+        {
+            const size_t n = (len < chunk) ? len : chunk;
+            cli_process_buffer(& cli, s, n);
+            s += n;
+            len -= n;
+        }
+    }
+
+    r->out = strdup(io.get());
+    r->buff = strdup(cli.buff);
+    r->end = cli.end;
+    r->cursor = cli.cursor;
+
+    cli_close(& cli);
+}
+
+TEST(CLI, ProcessBuffer)
+{
+    const char *inputs[] = {
+        "",
+        "hello world\r\n",
+        "help\r\nhelp hello\r\nnowt\r\n",
+        "heldx\b\bp\r\n",
+        "\b\b\bhello\n",
+        "help\eD\eDXY\eD\b\eC\bmore text\eA\eBend\n",
+        "abc\eD\eD\eDxyz\r\n",
+        "h\t\r\nhel\tp\t\r\n  \t\r\n",
+        "hello   lots   of    spaces \r\n",
+        "this line is far too long for the buffer to hold at all\r\nhelp\n",
+        "0123456789abcdef0123456789abcdef\n",
+        "\x7f\xc2\xa3 high \x01\x02 bytes\n",
+        "hello\eD\eD\e",
+        0,
+    };
+
+    const size_t sizes[] = { 64, 16, 8 };
+    const size_t chunks[] = { 1, 2, 3, 5, 7, 16, 1000 };
+
+    for (const char **s = inputs; *s; s++)
+    {
+        for (int i = 0; i < 6; i++)
+        {
+            const size_t size = sizes[i % 3];
+            const bool ansi = i >= 3;
+            BufferResult ref;
+            buffer_run(& ref, size, ansi, *s, 0);
+
+            for (size_t chunk : chunks)
+            {
+                BufferResult r;
+                buffer_run(& r, size, ansi, *s, chunk);
+
+                EXPECT_STREQ(ref.out, r.out) << "input '" << *s << "' size " << size << " chunk " << chunk << " ansi " << ansi;
+                EXPECT_STREQ(ref.buff, r.buff);
+                EXPECT_EQ(ref.end, r.end);
+                EXPECT_EQ(ref.cursor, r.cursor);
+
+                free(r.out);
+                free(r.buff);
+            }
+
+            free(ref.out);
+            free(ref.buff);
+        }
+    }
+}
+
+    /*
+     *  Output staging buffer
+     */
+
+static int out_writes;
+
+static int count_fprintf(void *ctx, const char *fmt, va_list va)
+{
+    CliOutput *out = (CliOutput*) ctx;
+    out_writes += 1;
+    return out->fprintf(out->ctx, fmt, va);
+}
+
+static void lines(CLI *cli, CliCommand *cmd)
+{
+    UNUSED(cmd);
+    for (int i = 0; i < 10; i++)
+    {
+        cli_print(cli, "line %d%s", i, cli->eol);
+    }
+}
+
+TEST(CLI, OutputBuffer)
+{
+    CliCommand a0 = {
+        .cmd = "hello",
+        .handler = echo_cmd,
+    };
+    CliCommand a1 = {
+        .cmd = "lines",
+        .handler = lines,
+    };
+
+    CliOutput *io_out = cli.output;
+    CliOutput counter = { count_fprintf, io_out };
+    cli.output = & counter;
+
+    cli_init(& cli, 64, 0);
+    cli_register(& cli, & a0);
+    cli_register(& cli, & a1);
+    cli_set_output_buffer(& cli, 256, 0);
+
+    // one write per chunk
+    io.reset();
+    out_writes = 0;
+    cli_send_buffer(& cli, "hello world\r\n");
+    EXPECT_STREQ("hello world\r\nhello world\r\n> ", io.get());
+    EXPECT_EQ(1, out_writes);
+
+    // two commands in one chunk : one write per command
+    io.reset();
+    out_writes = 0;
+    cli_send_buffer(& cli, "hello a\nhello b\n");
+    EXPECT_STREQ("hello a\nhello a\r\n> hello b\nhello b\r\n> ", io.get());
+    EXPECT_EQ(2, out_writes);
+
+    // char by char : one write per char
+    io.reset();
+    out_writes = 0;
+    cli_send(& cli, "abc");
+    EXPECT_STREQ("abc", io.get());
+    EXPECT_EQ(3, out_writes);
+    cli_send(& cli, "\b\b\b");
+
+    // output is held until flushed
+    io.reset();
+    out_writes = 0;
+    cli_print(& cli, "held");
+    EXPECT_STREQ("", io.get());
+    EXPECT_EQ(0, out_writes);
+    cli_flush(& cli);
+    EXPECT_STREQ("held", io.get());
+    EXPECT_EQ(1, out_writes);
+
+    // flush on the high water mark
+    cli_set_output_buffer(& cli, 32, 16);
+    io.reset();
+    out_writes = 0;
+    cli_send_buffer(& cli, "lines\n");
+    EXPECT_STREQ("lines\nline 0\r\nline 1\r\nline 2\r\nline 3\r\nline 4\r\n"
+                 "line 5\r\nline 6\r\nline 7\r\nline 8\r\nline 9\r\n> ", io.get());
+    EXPECT_EQ(6, out_writes);
+
+    // output bigger than the buffer goes straight out
+    io.reset();
+    out_writes = 0;
+    cli_print(& cli, "%s", "0123456789abcdef0123456789abcdef0123456789abcdef");
+    EXPECT_STREQ("0123456789abcdef0123456789abcdef0123456789abcdef", io.get());
+    EXPECT_EQ(1, out_writes);
+
+    cli_close(& cli);
+    cli.output = io_out;
+}
+
+    /*
+     *  Backends with write() / writev()
+     */
+
+static int out_fprintfs;
+static int out_writevs;
+
+static int slot_fprintf(void *ctx, const char *fmt, va_list va)
+{
+    out_fprintfs += 1;
+    return vfprintf((FILE*) ctx, fmt, va);
+}
+
+static int slot_write(void *ctx, const void *data, size_t len)
+{
+    out_writes += 1;
+    return (int) fwrite(data, 1, len, (FILE*) ctx);
+}
+
+static int slot_writev(void *ctx, const struct iovec *iov, int count)
+{
+    out_writevs += 1;
+    int n = 0;
+    for (int i = 0; i < count; i++)
+    {
+        n += (int) fwrite(iov[i].iov_base, 1, iov[i].iov_len, (FILE*) ctx);
+    }
+    return n;
+}
+
+TEST(CLI, OutputWrite)
+{
+    CliCommand a0 = {
+        .cmd = "help",
+        .handler = cli_help,
+        .help = "help text",
+    };
+
+    CliOutput *io_out = cli.output;
+    CliOutput with_write = { slot_fprintf, io_out->ctx, slot_write, 0 };
+    CliOutput with_writev = { slot_fprintf, io_out->ctx, slot_write, slot_writev };
+
+    CliOutput *outputs[] = { & with_write, & with_writev, 0 };
+
+    for (CliOutput **out = outputs; *out; out++)
+    {
+        cli.output = *out;
+        io.reset();
+        out_fprintfs = out_writes = out_writevs = 0;
+
+        cli_init(& cli, 64, 0);
+        cli_register(& cli, & a0);
+
+        cli_send(& cli, "help\r\n");
+        cli_send(& cli, "helq\b\eDx\n");
+        cli_send(& cli, "h\t\n");
+
+        EXPECT_STREQ("> help\r\nhelp : help text\r\n> "
+                     "helq\b \b\bxl\b\n'hexl' not found\r\n> "
+                     "help \nhelp : help text\r\n> ", io.get());
+
+        // no formatting needed
+        EXPECT_EQ(0, out_fprintfs);
+        EXPECT_NE(0, out_writes);
+        if ((*out)->writev)
+        {
+            EXPECT_NE(0, out_writevs);
+        }
+
+        cli_close(& cli);
+    }
+
+    cli.output = io_out;
+}
+
+    /*
+     *  cli_append() keeps a tail hint, which must survive cli_remove(),
+     *  and a change of list
+     */
+
+TEST(CLI, Append)
+{
+    CliCommand cmds[6];
+    const char *names[] = { "help", "a", "b", "c", "d", "e", };
+    for (int i = 0; i < 6; i++)
+    {
+        memset(& cmds[i], 0, sizeof(CliCommand));
+        cmds[i].cmd = names[i];
+        cmds[i].handler = i ? cli_nowt : cli_help;
+    }
+
+    cli_init(& cli, 64, 0);
+    cli.echo = false;
+
+    cli_append(& cli, & cmds[0]);
+    cli_append(& cli, & cmds[1]);
+    cli_append(& cli, & cmds[2]);
+    cli_append(& cli, & cmds[3]);
+    EXPECT_EQ(& cmds[3], cli.tail);
+
+    // remove the tail, then append
+    EXPECT_TRUE(cli_remove(& cli.head, & cmds[3]));
+    cli_append(& cli, & cmds[4]);
+
+    io.reset();
+    cli_process_buffer(& cli, "help\n", 5);
+    EXPECT_STREQ("help : \r\na : \r\nb : \r\nd : \r\n> ", io.get());
+
+    // registered at the head, then appended
+    EXPECT_TRUE(cli_remove(& cli.head, & cmds[2]));
+    cli_register(& cli, & cmds[3]);
+    cli_append(& cli, & cmds[5]);
+
+    io.reset();
+    cli_process_buffer(& cli, "help\n", 5);
+    EXPECT_STREQ("c : \r\nhelp : \r\na : \r\nd : \r\ne : \r\n> ", io.get());
+
+    // another list : the hint is not in it
+    CliCommand *old = cli.head;
+    CliCommand f = { .cmd = "f", };
+    cmds[2].next = 0;
+    cli.head = & cmds[2];
+    cli_append(& cli, & f);
+    EXPECT_EQ(& f, cmds[2].next);
+    EXPECT_EQ(0, cmds[5].next);
+
+    cli.head = old;
+    cli_close(& cli);
+    EXPECT_EQ(0, cli.tail);
+}
+
+    /*
+     *  ';', '&&' and '|'
+     */
+
+static void fail_cmd(CLI *cli, CliCommand *cmd)
+{
+    UNUSED(cmd);
+    cli_print(cli, "fail%s", cli->eol);
+    cli_set_status(cli, 1);
+}
+
+static void many_cmd(CLI *cli, CliCommand *cmd)
+{
+    UNUSED(cmd);
+    for (int i = 0; i < 100000; i++)
+    {
+        cli_print(cli, "%d%s", i, cli->eol);
+    }
+}
+
+static void long_cmd(CLI *cli, CliCommand *cmd)
+{
+    UNUSED(cmd);
+    char text[1000];
+    memset(text, 'x', sizeof(text));
+    cli_write(cli, text, sizeof(text));
+    cli_print(cli, "%s", cli->eol);
+}
+
+TEST(CLI, Compound)
+{
+    CliCommand cmds[] = {
+        { .cmd = "echo", .handler = echo_cmd, },
+        { .cmd = "lines", .handler = lines, },
+        { .cmd = "fail", .handler = fail_cmd, },
+        { .cmd = "many", .handler = many_cmd, },
+        { .cmd = "long", .handler = long_cmd, },
+    };
+
+    for (int buffered = 0; buffered < 2; buffered++)
+    {
+        cli_init(& cli, 128, 0);
+        cli.echo = false;
+        if (buffered)
+        {
+            cli_set_output_buffer(& cli, 64, 48);
+        }
+        for (size_t i = 0; i < (sizeof(cmds) / sizeof(cmds[0])); i++)
+        {
+            cmds[i].next = 0;
+            cli_append(& cli, & cmds[i]);
+        }
+
+        struct { const char *line; const char *out; int status; } tests[] = {
+            { "echo a ; echo b\n", "echo a\r\necho b\r\n> ", 0 },
+            { "echo a;echo b;\n", "echo a\r\necho b\r\n> ", 0 },
+            { "echo a && echo b\n", "echo a\r\necho b\r\n> ", 0 },
+            { "fail && echo b\n", "fail\r\n> ", 1 },
+            { "fail && echo b ; echo c\n", "fail\r\necho c\r\n> ", 0 },
+            { "fail ; echo c && echo d\n", "fail\r\necho c\r\necho d\r\n> ", 0 },
+            { "nope && echo b\n", "'nope' not found\r\n> ", 1 },
+            // quoted or escaped, they are just text
+            { "echo 'a;b' \"c|d\" e\\&&f\n", "echo a;b c|d e&&f\r\n> ", 0 },
+            { "echo a&b\n", "echo a&b\r\n> ", 0 },
+            // pipes
+            { "lines | grep 3\n", "line 3\r\n> ", 0 },
+            { "lines|grep -v line\n", "> ", 1 },
+            { "lines | head 2\n", "line 0\r\nline 1\r\n> ", 0 },
+            { "lines | grep -v 5 | head 3 | count\n", "3\r\n> ", 0 },
+            { "lines | grep x && echo b\n", "> ", 1 },
+            { "lines | grep 9 && echo b\n", "line 9\r\necho b\r\n> ", 0 },
+            { "many | count\n", "100000\r\n> ", 0 },
+            { "many | grep 9999 | head 2\n", "9999\r\n19999\r\n> ", 0 },
+            // longer than CLI_PIPE_SIZE : passed on in parts
+            { "long | count\n", "4\r\n> ", 0 },
+            // errors
+            { "lines | sort\n", "'sort' not found\r\n> ", 1 },
+            { "nope | count\n", "'nope' not found\r\n> ", 1 },
+            { "lines | head x\n", "usage : head [<lines>]\r\n> ", 1 },
+            { "lines |\n", "missing command\r\n> ", 1 },
+            { "&& echo a\n", "missing command\r\n> ", 1 },
+            { "echo | | count\n", "missing command\r\n> ", 1 },
+        };
+
+        for (size_t i = 0; i < (sizeof(tests) / sizeof(tests[0])); i++)
+        {
+            io.reset();
+            cli_process_buffer(& cli, tests[i].line, strlen(tests[i].line));
+            EXPECT_STREQ(tests[i].out, io.get()) << tests[i].line;
+            EXPECT_EQ(tests[i].status, cli.status) << tests[i].line;
+        }
+
+        // the args are back as they were
+        io.reset();
+        cli_process_buffer(& cli, "echo a b c\n", 11);
+        EXPECT_STREQ("echo a b c\r\n> ", io.get());
+
+        cli_close(& cli);
+    }
+}
+
+    /*
+     *  Machine mode
+     */
+
+TEST(CLI, Machine)
+{
+    CliCommand cmds[] = {
+        { .cmd = "echo", .handler = echo_cmd, },
+        { .cmd = "fail", .handler = fail_cmd, },
+        { .cmd = "help", .handler = cli_help, },
+    };
+
+    // no prompt before the first response
+    const char *prompt = cli.prompt;
+    cli.prompt = "";
+    io.reset();
+    cli_init(& cli, 32, 0);
+    EXPECT_STREQ("", io.get());
+
+    for (size_t i = 0; i < (sizeof(cmds) / sizeof(cmds[0])); i++)
+    {
+        cmds[i].next = 0;
+        cli_append(& cli, & cmds[i]);
+    }
+    cli_set_machine(& cli, "END");
+
+    struct { const char *in; const char *out; } tests[] = {
+        { "echo a b\n", "echo a b\r\nEND 0\r\n" },
+        { "echo a\r\necho b\r\n", "echo a\r\nEND 0\r\necho b\r\nEND 0\r\n" },
+        { "fail\n", "fail\r\nEND 1\r\n" },
+        { "nope\n", "'nope' not found\r\nEND 1\r\n" },
+        { "\n  \n", "END 0\r\nEND 0\r\n" },
+        { "echo a && fail ; echo c\n", "echo a\r\nfail\r\necho c\r\nEND 0\r\n" },
+        // no editing or completion : the chars are part of the line
+        { "echo x\by h\t\n", "echo x\by h\t\r\nEND 0\r\n" },
+        { "echo \x1b[D\n", "echo \x1b[D\r\nEND 0\r\n" },
+        // a line too long is dropped, up to the '\n'
+        { "echo 01234567890123456789012345678901234567890123456789\necho ok\n",
+          "line too long\r\nEND 1\r\necho ok\r\nEND 0\r\n" },
+        // nothing until the line is complete
+        { "echo par", "" },
+        { "tial\n", "echo partial\r\nEND 0\r\n" },
+    };
+
+    for (size_t i = 0; i < (sizeof(tests) / sizeof(tests[0])); i++)
+    {
+        io.reset();
+        cli_process_buffer(& cli, tests[i].in, strlen(tests[i].in));
+        EXPECT_STREQ(tests[i].out, io.get()) << i;
+    }
+
+    // the same a char at a time
+    io.reset();
+    for (const char *s = "echo 1 2\r\nfail\n"; *s; s++)
+    {
+        cli_process(& cli, *s);
+    }
+    EXPECT_STREQ("echo 1 2\r\nEND 0\r\nfail\r\nEND 1\r\n", io.get());
+
+    // and back again
+    cli.prompt = prompt;
+    cli_set_machine(& cli, 0);
+    io.reset();
+    cli_process_buffer(& cli, "echo z\n", 7);
+    EXPECT_STREQ("echo z\necho z\r\n> ", io.get());
+
+    cli_close(& cli);
+}
+
 //  FIN
@@ -0,0 +1,298 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include <cli_debug.h>
+#include "../src/cli.h"
+#include "../src/cli_coro.h"
+#include "../src/linux/cli_epoll.h"
+#include "test_io.h"
+
+#if defined(CLI_NS)
+using namespace CLI_NS;
+#endif
+
+    /*
+     *  Built with -std=c++20 : see SConscript
+     */
+
+static CliEvents *events = 0;
+
+// gcc warns about the switch it generates for each coroutine
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wswitch-default"
+#endif
+
+static CliCoro wait_cmd(CLI *cli, CliCommand *cmd)
+{
+    UNUSED(cmd);
+    const int ms = atoi(cli_get_arg(cli, 0));
+    co_await cli_sleep(events, (unsigned) ms);
+    cli_print(cli, "woke %d%s", ms, cli->eol);
+}
+
+static CliCoro read_cmd(CLI *cli, CliCommand *cmd)
+{
+    const int fd = *(int*) cmd->ctx;
+    co_await cli_readable(events, fd);
+
+    char buf[32];
+    const ssize_t n = read(fd, buf, sizeof(buf));
+    cli_print(cli, "read %.*s%s", (int) n, buf, cli->eol);
+}
+
+static CliCoro twice(CLI *cli, int ms)
+{
+    co_await cli_sleep(events, (unsigned) ms);
+    cli_print(cli, "one ");
+    co_await cli_sleep(events, (unsigned) ms);
+    cli_print(cli, "two ");
+}
+
+static CliCoro nested_cmd(CLI *cli, CliCommand *cmd)
+{
+    UNUSED(cmd);
+    co_await twice(cli, 5);
+    co_await twice(cli, 0);
+    cli_print(cli, "done%s", cli->eol);
+}
+
+static CliCoro now_cmd(CLI *cli, CliCommand *cmd)
+{
+    UNUSED(cmd);
+    // never suspends
+    cli_print(cli, "now%s", cli->eol);
+    co_return;
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+static void say(CLI *cli, CliCommand *cmd)
+{
+    UNUSED(cmd);
+    cli_print(cli, "%s%s", cli_get_arg(cli, 0), cli->eol);
+}
+
+static int pipe_fds[2];
+
+static CliCommand commands[] = {
+    { .cmd = "wait", .handler = cli_async<wait_cmd>, },
+    { .cmd = "read", .handler = cli_async<read_cmd>, .help = 0, .subcommand = 0, .ctx = & pipe_fds[0], },
+    { .cmd = "nested", .handler = cli_async<nested_cmd>, },
+    { .cmd = "now", .handler = cli_async<now_cmd>, },
+    { .cmd = "say", .handler = say, },
+};
+
+static const size_t num_commands = sizeof(commands) / sizeof(commands[0]);
+
+static void send(CLI *cli, const char *s)
+{
+    cli_process_buffer(cli, s, strlen(s));
+}
+
+static void run_all(CliEpoll *loop)
+{
+    while (cli_epoll_pending(loop))
+    {
+        cli_epoll_run(loop, 1000);
+    }
+}
+
+TEST(Coro, Sleep)
+{
+    CliEpoll *loop = cli_epoll_create();
+    events = cli_epoll_events(loop);
+
+    std::string text;
+    CliOutput out = { capture_fprintf, & text };
+    CLI cli;
+    session_init(& cli, & out, 64, commands, num_commands);
+    text.clear();
+
+    // the input is kept while the command waits
+    send(& cli, "wait 20\nsay hello\n");
+    EXPECT_STREQ("", text.c_str());
+    EXPECT_EQ(1, cli_epoll_pending(loop));
+
+    send(& cli, "say again\n");
+    EXPECT_STREQ("", text.c_str());
+
+    run_all(loop);
+    EXPECT_STREQ("woke 20\r\n> hello\r\n> again\r\n> ", text.c_str());
+
+    // finished before the handler returned
+    text.clear();
+    send(& cli, "now\n");
+    EXPECT_STREQ("now\r\n> ", text.c_str());
+
+    // several in a row, each held in turn
+    text.clear();
+    send(& cli, "wait 1\nwait 0\nsay end\n");
+    run_all(loop);
+    EXPECT_STREQ("woke 1\r\n> woke 0\r\n> end\r\n> ", text.c_str());
+
+    cli_close(& cli);
+    cli_epoll_delete(loop);
+}
+
+TEST(Coro, Await)
+{
+    CliEpoll *loop = cli_epoll_create();
+    events = cli_epoll_events(loop);
+
+    std::string text;
+    CliOutput out = { capture_fprintf, & text };
+    CLI cli;
+    session_init(& cli, & out, 64, commands, num_commands);
+    text.clear();
+
+    // wait for the fd
+    EXPECT_EQ(0, pipe(pipe_fds));
+    send(& cli, "read\n");
+    EXPECT_EQ(0, cli_epoll_run(loop, 10));
+    EXPECT_STREQ("", text.c_str());
+    EXPECT_EQ(4, write(pipe_fds[1], "data", 4));
+    run_all(loop);
+    EXPECT_STREQ("read data\r\n> ", text.c_str());
+
+    // co_await other coroutines
+    text.clear();
+    send(& cli, "nested\n");
+    run_all(loop);
+    EXPECT_STREQ("one two one two done\r\n> ", text.c_str());
+
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    cli_close(& cli);
+    cli_epoll_delete(loop);
+}
+
+    /*
+     *  A timer added by a callback waits for the next run
+     */
+
+static int fired = 0;
+
+static void on_timer(void *arg)
+{
+    UNUSED(arg);
+    fired += 1;
+}
+
+static void on_read(void *arg)
+{
+    CliEvents *ev = (CliEvents*) arg;
+    char c;
+    EXPECT_EQ(1, read(pipe_fds[0], & c, 1));
+    ev->after(ev->ctx, 0, on_timer, 0);
+}
+
+TEST(Coro, Added)
+{
+    CliEpoll *loop = cli_epoll_create();
+    CliEvents *ev = cli_epoll_events(loop);
+    fired = 0;
+
+    EXPECT_EQ(0, pipe(pipe_fds));
+    EXPECT_EQ(1, write(pipe_fds[1], "x", 1));
+    ev->watch(ev->ctx, pipe_fds[0], CLI_EV_READ, on_read, ev);
+
+    // the fd callback only
+    EXPECT_EQ(1, cli_epoll_run(loop, 10));
+    EXPECT_EQ(0, fired);
+    EXPECT_EQ(1, cli_epoll_run(loop, 10));
+    EXPECT_EQ(1, fired);
+
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    cli_epoll_delete(loop);
+}
+
+    /*
+     *  Thousands of commands suspended at once
+     */
+
+static int count_lines(void *ctx, const char *fmt, va_list va)
+{
+    char buf[256];
+    const int n = vsnprintf(buf, sizeof(buf), fmt, va);
+    for (const char *s = buf; *s; s++)
+    {
+        *(int*) ctx += (*s == '\n') ? 1 : 0;
+    }
+    return n;
+}
+
+TEST(Coro, Many)
+{
+    CliEpoll *loop = cli_epoll_create();
+    events = cli_epoll_events(loop);
+
+    const int num = 5000;
+    const int readers = 1000;
+    int lines = 0;
+    CliOutput out = { count_lines, & lines };
+
+    CLI *clis = new CLI[num];
+    int (*pipes)[2] = new int[readers][2];
+    CliCommand *reads = new CliCommand[readers];
+
+    for (int i = 0; i < num; i++)
+    {
+        session_init(& clis[i], & out, 64, commands, num_commands);
+
+        if (i < readers)
+        {
+            // a read command on its own pipe
+            EXPECT_EQ(0, pipe(pipes[i]));
+            memset(& reads[i], 0, sizeof(CliCommand));
+            reads[i].cmd = "read";
+            reads[i].handler = cli_async<read_cmd>;
+            reads[i].ctx = & pipes[i][0];
+            cli_register(& clis[i], & reads[i]);
+            send(& clis[i], "read\nsay x\n");
+        }
+        else
+        {
+            char line[32];
+            snprintf(line, sizeof(line), "wait %d\nsay x\n", i % 20);
+            send(& clis[i], line);
+        }
+    }
+
+    EXPECT_EQ(num, cli_epoll_pending(loop));
+    lines = 0;
+
+    for (int i = 0; i < readers; i++)
+    {
+        EXPECT_EQ(1, write(pipes[i][1], "z", 1));
+    }
+    run_all(loop);
+
+    // the command, then the held line
+    EXPECT_EQ(num * 2, lines);
+
+    for (int i = 0; i < num; i++)
+    {
+        EXPECT_EQ(0, clis[i].held);
+        cli_close(& clis[i]);
+    }
+    for (int i = 0; i < readers; i++)
+    {
+        close(pipes[i][0]);
+        close(pipes[i][1]);
+    }
+
+    delete[] reads;
+    delete[] pipes;
+    delete[] clis;
+    cli_epoll_delete(loop);
+}
+
+//  FIN
@@ -0,0 +1,259 @@
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <cli_debug.h>
+#include "../src/cli.h"
+#include "../src/linux/cli_pool.h"
+#include "test_io.h"
+
+#if defined(CLI_NS)
+using namespace CLI_NS;
+#endif
+
+extern CLI cli;
+
+    /*
+     *  The pool on its own
+     */
+
+typedef struct {
+    CliPool *pool;
+    int count;
+}   Counter;
+
+static void count_job(void *arg)
+{
+    Counter *c = (Counter*) arg;
+    __atomic_add_fetch(& c->count, 1, __ATOMIC_RELAXED);
+}
+
+static void spawn_job(void *arg)
+{
+    Counter *c = (Counter*) arg;
+    __atomic_add_fetch(& c->count, 1, __ATOMIC_RELAXED);
+
+    // submitted from a worker : goes on its own deque
+    for (int i = 0; i < 10; i++)
+    {
+        cli_pool_submit(c->pool, count_job, c);
+    }
+}
+
+TEST(Exec, Pool)
+{
+    CliPool *pool = cli_pool_create(4);
+    Counter c = { pool, 0 };
+
+    for (int i = 0; i < 1000; i++)
+    {
+        cli_pool_submit(pool, (i % 10) ? count_job : spawn_job, & c);
+    }
+    cli_pool_wait(pool);
+    EXPECT_EQ(1000 + (100 * 10), c.count);
+
+    // the caller can run jobs too
+    while (cli_pool_help(pool))
+        ;
+    cli_pool_submit(pool, count_job, & c);
+    cli_pool_wait(pool);
+    EXPECT_EQ(2001, c.count);
+
+    // runs anything still queued
+    for (int i = 0; i < 100; i++)
+    {
+        cli_pool_submit(pool, count_job, & c);
+    }
+    cli_pool_delete(pool);
+    EXPECT_EQ(2101, c.count);
+}
+
+    /*
+     *  Deferred commands : output in the order the lines were entered
+     */
+
+static void cmd_slow(CLI *cli, CliCommand *cmd)
+{
+    UNUSED(cmd);
+    const char *ms = cli_get_arg(cli, 0);
+    usleep((useconds_t) (1000 * atoi(ms)));
+    cli_print(cli, "slow %s%s", ms, cli->eol);
+}
+
+static void cmd_fast(CLI *cli, CliCommand *cmd)
+{
+    UNUSED(cmd);
+    cli_print(cli, "fast%s", cli->eol);
+}
+
+static int ready_calls = 0;
+
+static void on_ready(void *ctx, CLI *cli)
+{
+    UNUSED(ctx);
+    UNUSED(cli);
+    __atomic_add_fetch(& ready_calls, 1, __ATOMIC_RELAXED);
+}
+
+TEST(Exec, Order)
+{
+    CliPool *pool = cli_pool_create(4);
+    CliExecutor executor = *cli_pool_executor(pool);
+    executor.ready = on_ready;
+
+    CliCommand slow = { .cmd = "slow", .handler = cmd_slow, };
+    CliCommand fast = { .cmd = "fast", .handler = cmd_fast, };
+    CliCommand now = {
+        .cmd = "now",
+        .handler = cmd_fast,
+        .help = 0,
+        .subcommand = 0,
+        .ctx = 0,
+        .next = 0,
+        .flags = CLI_INLINE,
+    };
+
+    CLI c = {
+        .output = cli.output,
+        .prompt = "> ",
+        .eol = "\r\n",
+    };
+    cli_init(& c, 64, 0);
+    c.echo = false;
+    cli_register(& c, & slow);
+    cli_register(& c, & fast);
+    cli_register(& c, & now);
+    cli_set_executor(& c, & executor);
+    ready_calls = 0;
+
+    io.reset();
+    const char *lines = "slow 40\nfast\nslow 10\nfast\n";
+    cli_process_buffer(& c, lines, strlen(lines));
+
+    // run at once, but the output waits its turn, as do errors
+    cli_process_buffer(& c, "now\nnope\n", 9);
+    EXPECT_STREQ("", io.get());
+
+    while (__atomic_load_n(& ready_calls, __ATOMIC_RELAXED) < 4)
+    {
+        usleep(1000);
+    }
+    cli_poll(& c);
+    EXPECT_STREQ("slow 40\r\n> fast\r\n> slow 10\r\n> fast\r\n> fast\r\n> 'nope' not found\r\n> ", io.get());
+
+    // nothing waiting : written at once
+    io.reset();
+    cli_process_buffer(& c, "now\n", 4);
+    EXPECT_STREQ("fast\r\n> ", io.get());
+
+    // cli_close() waits for the handlers
+    cli_process_buffer(& c, "slow 10\n", 8);
+    io.reset();
+    cli_close(& c);
+    EXPECT_STREQ("slow 10\r\n> ", io.get());
+    EXPECT_EQ(0, c.tasks);
+
+    cli_pool_delete(pool);
+}
+
+static void cmd_fail(CLI *cli, CliCommand *cmd)
+{
+    UNUSED(cmd);
+    cli_set_status(cli, 2);
+}
+
+TEST(Exec, Machine)
+{
+    CliPool *pool = cli_pool_create(4);
+    CliExecutor executor = *cli_pool_executor(pool);
+    executor.ready = on_ready;
+
+    CliCommand slow = { .cmd = "slow", .handler = cmd_slow, };
+    CliCommand fail = { .cmd = "fail", .handler = cmd_fail, };
+
+    CLI c = {
+        .output = cli.output,
+        .prompt = "> ",
+        .eol = "\r\n",
+    };
+    cli_init(& c, 64, 0);
+    cli_register(& c, & slow);
+    cli_register(& c, & fail);
+    cli_set_executor(& c, & executor);
+    cli_set_machine(& c, ".");
+    ready_calls = 0;
+
+    // the marker follows the deferred output, with its status
+    io.reset();
+    const char *lines = "slow 20\nfail\nslow 0\nbogus\n";
+    cli_process_buffer(& c, lines, strlen(lines));
+    while (__atomic_load_n(& ready_calls, __ATOMIC_RELAXED) < 3)
+    {
+        usleep(1000);
+    }
+    cli_poll(& c);
+    EXPECT_STREQ("slow 20\r\n. 0\r\n. 2\r\nslow 0\r\n. 0\r\n'bogus' not found\r\n. 1\r\n", io.get());
+
+    cli_close(& c);
+    cli_pool_delete(pool);
+}
+
+    /*
+     *  Deferred lookups don't touch the index, which the input thread uses :
+     *  registering a command clears it, and the next lookup fills it again
+     */
+
+TEST(Exec, Index)
+{
+    CliPool *pool = cli_pool_create(4);
+    CliExecutor executor = *cli_pool_executor(pool);
+    executor.ready = on_ready;
+
+    CliCommand help = { .cmd = "help", .handler = cli_help, };
+    CliCommand fast = { .cmd = "fast", .handler = cmd_fast, };
+    static CliCommand names[200];
+    static char text[200][8];
+    for (int i = 0; i < 200; i++)
+    {
+        memset(& names[i], 0, sizeof(CliCommand));
+        snprintf(text[i], sizeof(text[i]), "cmd%d", i);
+        names[i].cmd = text[i];
+        names[i].handler = cmd_fast;
+    }
+
+    CLI c = {
+        .output = cli.output,
+        .prompt = "> ",
+        .eol = "\r\n",
+    };
+    cli_init(& c, 64, 0);
+    c.echo = false;
+    cli_set_index(& c, 8);
+    cli_register(& c, & help);
+    cli_register(& c, & fast);
+    cli_set_executor(& c, & executor);
+
+    io.reset();
+    for (int i = 0; i < 200; i++)
+    {
+        cli_process_buffer(& c, "help\n", 5);
+        // while help may still be running
+        cli_register(& c, & names[i]);
+        char line[32];
+        snprintf(line, sizeof(line), "cmd%d\nfast\n", i);
+        cli_process_buffer(& c, line, strlen(line));
+    }
+    cli_close(& c);
+
+    // help lists however many were registered when it ran
+    int replies = 0;
+    for (const char *s = io.get(); (s = strstr(s, "fast\r\n")); s++)
+    {
+        replies += 1;
+    }
+    EXPECT_EQ(400, replies);
+
+    cli_pool_delete(pool);
+}
+
+//  FIN
@@ -0,0 +1,325 @@
+
+#include <gtest/gtest.h>
+
+#include <cli_debug.h>
+#include "../src/cli.h"
+#include "../src/cli_index.h"
+#include "test_io.h"
+
+#if defined(CLI_NS)
+using namespace CLI_NS;
+#endif
+
+    /*
+     *
+     */
+
+TEST(Index, Find)
+{
+    CliCommand c0 = { .cmd = "zero", };
+    CliCommand c1 = { .cmd = "one", .next = & c0, };
+    CliCommand c2 = { .cmd = "two", .next = & c1, };
+    CliCommand *head = & c2;
+
+    CliIndex *index = index_create(0);
+
+    EXPECT_EQ(& c0, index_find(index, & head, "zero"));
+    EXPECT_EQ(& c1, index_find(index, & head, "one"));
+    EXPECT_EQ(& c2, index_find(index, & head, "two"));
+    EXPECT_EQ(0, index_find(index, & head, "three"));
+    EXPECT_EQ(0, index_find(index, & head, ""));
+    EXPECT_EQ(0, index_find(index, & head, "tw"));
+
+    // a different level
+    CliCommand s0 = { .cmd = "zero", };
+    CliCommand *sub = & s0;
+    EXPECT_EQ(& s0, index_find(index, & sub, "zero"));
+    EXPECT_EQ(0, index_find(index, & sub, "one"));
+    EXPECT_EQ(& c0, index_find(index, & head, "zero"));
+
+    index_delete(index);
+}
+
+TEST(Index, Changes)
+{
+    CliCommand c0 = { .cmd = "zero", };
+    CliCommand c1 = { .cmd = "one", .next = & c0, };
+    CliCommand *head = & c1;
+
+    CliIndex *index = index_create(0);
+    CliIndex *other = index_create(0);
+
+    EXPECT_EQ(& c0, index_find(index, & head, "zero"));
+    EXPECT_EQ(& c0, index_find(other, & head, "zero"));
+
+    // push a duplicate name : it wins
+    CliCommand c2 = { .cmd = "zero", .next = head, };
+    head = & c2;
+    index_add(index, & head, & c2, true);
+    EXPECT_EQ(& c2, index_find(index, & head, "zero"));
+    EXPECT_EQ(& c1, index_find(index, & head, "one"));
+    // the other index has been invalidated
+    EXPECT_EQ(& c2, index_find(other, & head, "zero"));
+
+    // append a duplicate name : it doesn't
+    CliCommand c3 = { .cmd = "one", };
+    c0.next = & c3;
+    index_add(index, & head, & c3, false);
+    EXPECT_EQ(& c1, index_find(index, & head, "one"));
+
+    // remove
+    c1.next = & c0;
+    head = & c1;
+    index_changed();
+    EXPECT_EQ(& c0, index_find(index, & head, "zero"));
+    EXPECT_EQ(& c0, index_find(other, & head, "zero"));
+
+    index_delete(index);
+    index_delete(other);
+}
+
+TEST(Index, Grow)
+{
+    const int num = 1000;
+    CliCommand *cmds = new CliCommand[num];
+    char (*names)[16] = new char[num][16];
+    CliCommand *head = 0;
+
+    for (int i = 0; i < num; i++)
+    {
+        snprintf(names[i], sizeof(names[i]), "cmd%d", i);
+        memset(& cmds[i], 0, sizeof(CliCommand));
+        cmds[i].cmd = names[i];
+        cmds[i].next = head;
+        head = & cmds[i];
+    }
+
+    CliIndex *index = index_create(4);
+
+    for (int i = 0; i < num; i++)
+    {
+        EXPECT_EQ(& cmds[i], index_find(index, & head, names[i]));
+    }
+    EXPECT_EQ(0, index_find(index, & head, "cmd"));
+
+    index_delete(index);
+    delete[] names;
+    delete[] cmds;
+}
+
+    /*
+     *  Prefix matching with the radix trie
+     */
+
+static int visit_names(CliCommand *cmd, void *arg)
+{
+    std::string *s = (std::string*) arg;
+    *s += cmd->cmd;
+    *s += " ";
+    return 0;
+}
+
+static std::string visit(CliIndex *index, CliCommand **head, const char *prefix, bool sorted)
+{
+    std::string s;
+    index_visit(index, head, prefix, strlen(prefix), sorted, visit_names, & s);
+    return s;
+}
+
+TEST(Index, Match)
+{
+    CliCommand c0 = { .cmd = "part", };
+    CliCommand c1 = { .cmd = "partial", .next = & c0, };
+    CliCommand c2 = { .cmd = "bye", .next = & c1, };
+    CliCommand c3 = { .cmd = "party", .next = & c2, };
+    CliCommand c4 = { .cmd = "part", .next = & c3, };
+    CliCommand *head = & c4;
+
+    CliIndex *index = index_create(0);
+    CliMatch m;
+
+    index_match(index, & head, "", 0, & m);
+    EXPECT_EQ(5, m.count);
+    EXPECT_EQ(& c4, m.first);
+    EXPECT_EQ(0, m.common);
+
+    index_match(index, & head, "pa", 2, & m);
+    EXPECT_EQ(4, m.count);
+    EXPECT_EQ(& c4, m.first);
+    EXPECT_EQ(4, m.common);
+
+    index_match(index, & head, "parti", 5, & m);
+    EXPECT_EQ(1, m.count);
+    EXPECT_EQ(& c1, m.first);
+    EXPECT_EQ(7, m.common);
+
+    index_match(index, & head, "party", 5, & m);
+    EXPECT_EQ(1, m.count);
+    EXPECT_EQ(& c3, m.first);
+    EXPECT_EQ(5, m.common);
+
+    index_match(index, & head, "partx", 5, & m);
+    EXPECT_EQ(0, m.count);
+    EXPECT_EQ(0, m.first);
+
+    index_match(index, & head, "byebye", 6, & m);
+    EXPECT_EQ(0, m.count);
+
+    // only the length given is used
+    index_match(index, & head, "b ", 1, & m);
+    EXPECT_EQ(1, m.count);
+    EXPECT_EQ(& c2, m.first);
+    EXPECT_EQ(3, m.common);
+
+    EXPECT_EQ("part party bye partial part ", visit(index, & head, "", false));
+    EXPECT_EQ("bye part part partial party ", visit(index, & head, "", true));
+    EXPECT_EQ("part party partial part ", visit(index, & head, "par", false));
+    EXPECT_EQ("part part partial party ", visit(index, & head, "par", true));
+    EXPECT_EQ("", visit(index, & head, "x", true));
+
+    // the trie is rebuilt after a change
+    CliCommand c5 = { .cmd = "parse", .next = head, };
+    head = & c5;
+    index_add(index, & head, & c5, true);
+    index_match(index, & head, "pa", 2, & m);
+    EXPECT_EQ(5, m.count);
+    EXPECT_EQ(& c5, m.first);
+    EXPECT_EQ(3, m.common);
+
+    // empty list
+    CliCommand *empty = 0;
+    index_match(index, & empty, "", 0, & m);
+    EXPECT_EQ(0, m.count);
+    EXPECT_EQ("", visit(index, & empty, "", false));
+
+    index_delete(index);
+}
+
+TEST(Index, MatchRandom)
+{
+    // compare with a linear search
+    const int num = 300;
+    CliCommand *cmds = new CliCommand[num];
+    char (*names)[8] = new char[num][8];
+    CliCommand *head = 0;
+
+    srand(1234);
+    for (int i = 0; i < num; i++)
+    {
+        const int len = 1 + (rand() % 5);
+        for (int j = 0; j < len; j++)
+        {
+            names[i][j] = (char) ('a' + (rand() % 3));
+        }
+        names[i][len] = '\0';
+        memset(& cmds[i], 0, sizeof(CliCommand));
+        cmds[i].cmd = names[i];
+        cmds[i].next = head;
+        head = & cmds[i];
+    }
+
+    CliIndex *index = index_create(0);
+
+    for (int i = 0; i < 500; i++)
+    {
+        char prefix[8];
+        const size_t len = (size_t) (rand() % 5);
+        for (size_t j = 0; j < len; j++)
+        {
+            prefix[j] = (char) ('a' + (rand() % 3));
+        }
+        prefix[len] = '\0';
+
+        int count = 0;
+        CliCommand *first = 0;
+        size_t common = 0;
+        std::string all;
+        for (CliCommand *cmd = head; cmd; cmd = cmd->next)
+        {
+            if (strncmp(cmd->cmd, prefix, len))
+            {
+                continue;
+            }
+            if (!first)
+            {
+                first = cmd;
+                common = strlen(cmd->cmd);
+            }
+            for (size_t j = 0; j < common; j++)
+            {
+                if (cmd->cmd[j] != first->cmd[j])
+                {
+                    common = j;
+                }
+            }
+            count += 1;
+            all += cmd->cmd;
+            all += " ";
+        }
+
+        CliMatch m;
+        index_match(index, & head, prefix, len, & m);
+        EXPECT_EQ(count, m.count);
+        EXPECT_EQ(first, m.first);
+        if (count)
+        {
+            EXPECT_EQ(common, m.common);
+        }
+        EXPECT_EQ(all, visit(index, & head, prefix, false));
+    }
+
+    index_delete(index);
+    delete[] names;
+    delete[] cmds;
+}
+
+    /*
+     *  CLI with an index
+     */
+
+extern CLI cli;
+
+static void index_echo(CLI *cli, CliCommand *cmd)
+{
+    cli_print(cli, "%s %s%s", cmd->cmd, (const char*) cmd->ctx, cli->eol);
+}
+
+TEST(Index, Cli)
+{
+    CliCommand s0 = { .cmd = "sub", .handler = index_echo, .ctx = (void*) "s0", };
+    CliCommand a0 = { .cmd = "one", .handler = index_echo, .ctx = (void*) "a0", };
+    CliCommand a1 = { .cmd = "two", .handler = index_echo, .ctx = (void*) "a1", };
+    CliCommand a2 = { .cmd = "one", .handler = index_echo, .ctx = (void*) "a2", };
+    CliCommand a3 = { .cmd = "three", .handler = index_echo, .ctx = (void*) "a3", };
+
+    cli_init(& cli, 64, 0);
+    cli_set_index(& cli, 8);
+    cli_register(& cli, & a0);
+    cli_register(& cli, & a1);
+    cli_insert(& cli, & a1.subcommand, & s0);
+
+    io.reset();
+    cli_process_buffer(& cli, "one\ntwo\ntwo sub\nthree\n", 22);
+    EXPECT_STREQ("one\none a0\r\n> two\ntwo a1\r\n> two sub\nsub s0\r\n> three\n'three' not found\r\n> ", io.get());
+
+    // appended duplicate is hidden, registered one is found
+    cli_append(& cli, & a2);
+    cli_append(& cli, & a3);
+    io.reset();
+    cli_process_buffer(& cli, "one\nthree\n", 10);
+    EXPECT_STREQ("one\none a0\r\n> three\nthree a3\r\n> ", io.get());
+
+    cli_remove(& cli.head, & a0);
+    io.reset();
+    cli_process_buffer(& cli, "one\n", 4);
+    EXPECT_STREQ("one\none a2\r\n> ", io.get());
+
+    cli_register(& cli, & a0);
+    io.reset();
+    cli_process_buffer(& cli, "one\n", 4);
+    EXPECT_STREQ("one\none a0\r\n> ", io.get());
+
+    cli_close(& cli);
+}
+
+//  FIN
@@ -1,5 +1,8 @@
 
 #include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 #include <cli_debug.h>
 #include <cli_mutex.h>
@@ -45,4 +48,140 @@ void LinuxMutex::unlock()
     ASSERT(err == 0);
 }
 
+    /*
+     *  Critical section : for locks held for a few instructions.
+     *
+     *  An atomic word, 0 unlocked, 1 locked, 2 locked with waiters.
+     *  The uncontended paths are a single atomic op. Contended lockers spin
+     *  for a while before sleeping on a futex, as the holder will usually
+     *  be done by then. (After Drepper, "Futexes Are Tricky".)
+     */
+
+class FutexMutex : public Mutex
+{
+    int state;
+
+    enum { SPIN = 100 };
+
+    static void pause()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+        __asm__ __volatile__("yield");
+#endif
+    }
+
+    void futex(int op, int value)
+    {
+        syscall(SYS_futex, & state, op | FUTEX_PRIVATE_FLAG, value, 0, 0, 0);
+    }
+
+public:
+    FutexMutex() : state(0) { }
+
+    virtual void lock();
+    virtual void unlock();
+};
+
+Mutex* Mutex::create_critical_section()
+{
+    return new FutexMutex();
+}
+
+void FutexMutex::lock()
+{
+    int c = 0;
+    if (__atomic_compare_exchange_n(& state, & c, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    {
+        return;
+    }
+
+    for (int i = 0; i < SPIN; i++)
+    {
+        pause();
+        c = 0;
+        if ((__atomic_load_n(& state, __ATOMIC_RELAXED) == 0) &&
+            __atomic_compare_exchange_n(& state, & c, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            return;
+        }
+    }
+
+    // mark the lock as contended, then sleep until it is free
+    c = __atomic_exchange_n(& state, 2, __ATOMIC_ACQUIRE);
+    while (c)
+    {
+        futex(FUTEX_WAIT, 2);
+        c = __atomic_exchange_n(& state, 2, __ATOMIC_ACQUIRE);
+    }
+}
+
+void FutexMutex::unlock()
+{
+    if (__atomic_exchange_n(& state, 0, __ATOMIC_RELEASE) == 2)
+    {
+        futex(FUTEX_WAKE, 1);
+    }
+}
+
+    /*
+     *  Reader-writer lock
+     */
+
+class LinuxSharedMutex : public SharedMutex
+{
+    pthread_rwlock_t rwlock;
+public:
+    ~LinuxSharedMutex();
+
+    LinuxSharedMutex();
+
+    virtual void lock();
+    virtual void unlock();
+    virtual void lock_shared();
+    virtual void unlock_shared();
+};
+
+SharedMutex* SharedMutex::create()
+{
+    return new LinuxSharedMutex();
+}
+
+LinuxSharedMutex::LinuxSharedMutex()
+{
+    const int err = pthread_rwlock_init(& rwlock, 0);
+    ASSERT(err == 0);
+}
+
+LinuxSharedMutex::~LinuxSharedMutex()
+{
+    const int err = pthread_rwlock_destroy(& rwlock);
+    ASSERT(err == 0);
+}
+
+void LinuxSharedMutex::lock()
+{
+    const int err = pthread_rwlock_wrlock(& rwlock);
+    ASSERT(err == 0);
+}
+
+void LinuxSharedMutex::unlock()
+{
+    const int err = pthread_rwlock_unlock(& rwlock);
+    ASSERT(err == 0);
+}
+
+void LinuxSharedMutex::lock_shared()
+{
+    const int err = pthread_rwlock_rdlock(& rwlock);
+    ASSERT(err == 0);
+}
+
+void LinuxSharedMutex::unlock_shared()
+{
+    const int err = pthread_rwlock_unlock(& rwlock);
+    ASSERT(err == 0);
+}
+
 //  FIN
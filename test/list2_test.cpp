@@ -0,0 +1,308 @@
+#include <pthread.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <cli_debug.h>
+#include <cli_mutex.h>
+
+#include "../src/list2.h"
+
+#if defined(CLI_NS)
+using namespace CLI_NS;
+#endif
+
+typedef struct Item2
+{
+    struct Item2 *next;
+    struct Item2 *prev;
+    int value;
+}   Item2;
+
+static Item2 ** item_next(Item2 *item)
+{
+    return & item->next;
+}
+
+static Item2 ** item_prev(Item2 *item)
+{
+    return & item->prev;
+}
+
+static int cmp(Item2* a, Item2* b)
+{
+    return b->value - a->value;
+}
+
+static int visit_match(Item2* a, void *arg)
+{
+    ASSERT(arg);
+    int *i = (int*) arg;
+    return a->value == *i;
+}
+
+    /*
+     *  Check the prev links agree with the next links
+     */
+
+static bool linked(List2<Item2*> *list)
+{
+    Item2 *prev = 0;
+    for (Item2 *item = list->head; item; item = item->next)
+    {
+        if (item->prev != prev)
+        {
+            return false;
+        }
+        prev = item;
+    }
+    return true;
+}
+
+    /*
+     *
+     */
+
+TEST(List2, AddRemove)
+{
+    List2<Item2*> list(item_next, item_prev);
+
+    EXPECT_EQ(0, list.size(0));
+    EXPECT_TRUE(list.empty());
+
+    // i1
+    Item2 i1 = { 0, 0, 1 };
+    EXPECT_FALSE(list.has(& i1, 0));
+    list.push(& i1, 0);
+    EXPECT_EQ(1, list.size(0));
+    EXPECT_FALSE(list.empty());
+    EXPECT_TRUE(list.has(& i1, 0));
+
+    // i2, i1
+    Item2 i2 = { 0, 0, 2 };
+    list.push(& i2, 0);
+    EXPECT_EQ(2, list.size(0));
+    EXPECT_TRUE(list.has(& i2, 0));
+
+    // i3, i2, i1
+    Item2 i3 = { 0, 0, 3 };
+    list.push(& i3, 0);
+    EXPECT_EQ(3, list.size(0));
+    EXPECT_TRUE(list.has(& i3, 0));
+
+    // i3, i2, i1, i4
+    Item2 i4 = { & i3, & i2, 4 }; // check bad data in the links doesn't cause harm
+    EXPECT_FALSE(list.has(& i4, 0));
+    list.append(& i4, 0);
+    EXPECT_EQ(4, list.size(0));
+    EXPECT_TRUE(list.has(& i4, 0));
+    EXPECT_TRUE(linked(& list));
+
+    Item2 *item;
+    bool okay;
+
+    // i2, i1, i4
+    item = list.pop(0);
+    EXPECT_EQ(& i3, item);
+    EXPECT_EQ(0, i3.next);
+    EXPECT_EQ(0, i3.prev);
+    EXPECT_EQ(3, list.size(0));
+    EXPECT_FALSE(list.has(& i3, 0));
+    EXPECT_TRUE(linked(& list));
+
+    // i1, i4
+    item = list.pop(0);
+    EXPECT_EQ(& i2, item);
+    EXPECT_EQ(2, list.size(0));
+    EXPECT_TRUE(linked(& list));
+
+    // i1
+    okay = list.remove(& i4, 0);
+    EXPECT_TRUE(okay);
+    EXPECT_EQ(1, list.size(0));
+    EXPECT_TRUE(list.has(& i1, 0));
+    EXPECT_FALSE(list.has(& i4, 0));
+    EXPECT_TRUE(linked(& list));
+
+    // empty
+    okay = list.remove(& i1, 0);
+    EXPECT_TRUE(okay);
+    EXPECT_EQ(0, list.size(0));
+    EXPECT_TRUE(list.empty());
+
+    Item2 i5 = { 0, 0, 5 };
+
+    // i1, i2, i3, i4, i5
+    list.push(& i5, 0);
+    list.push(& i4, 0);
+    list.push(& i3, 0);
+    list.push(& i2, 0);
+    list.push(& i1, 0);
+    EXPECT_EQ(5, list.size(0));
+    EXPECT_TRUE(linked(& list));
+
+    // remove head
+    // i2, i3, i4, i5
+    okay = list.remove(& i1, 0);
+    EXPECT_TRUE(okay);
+    EXPECT_EQ(4, list.size(0));
+    EXPECT_EQ(& i2, list.head);
+    EXPECT_TRUE(linked(& list));
+
+    // remove tail
+    // i2, i3, i4
+    okay = list.remove(& i5, 0);
+    EXPECT_TRUE(okay);
+    EXPECT_EQ(3, list.size(0));
+    EXPECT_TRUE(linked(& list));
+
+    // remove mid
+    // i2, i4
+    okay = list.remove(& i3, 0);
+    EXPECT_TRUE(okay);
+    EXPECT_EQ(2, list.size(0));
+    EXPECT_TRUE(linked(& list));
+
+    // try to remove items that have gone
+    // i2, i4
+    okay = list.remove(& i3, 0);
+    EXPECT_FALSE(okay);
+    okay = list.remove(& i1, 0);
+    EXPECT_FALSE(okay);
+    EXPECT_EQ(2, list.size(0));
+
+    // an item on another list
+    List2<Item2*> other(item_next, item_prev);
+    other.push(& i1, 0);
+    okay = list.remove(& i1, 0);
+    EXPECT_FALSE(okay);
+    EXPECT_EQ(2, list.size(0));
+    EXPECT_EQ(1, other.size(0));
+}
+
+TEST(List2, Sorted)
+{
+    List2<Item2*> list(item_next, item_prev);
+
+    Item2 items[5];
+    const int order[] = { 300, 200, 100, 500, 400, };
+    for (int i = 0; i < 5; i++)
+    {
+        items[i].value = order[i];
+        list.add_sorted(& items[i], cmp, 0);
+        EXPECT_TRUE(linked(& list));
+    }
+
+    int last = 0;
+    for (Item2 *item = list.head; item; item = item->next)
+    {
+        EXPECT_LT(last, item->value);
+        last = item->value;
+    }
+
+    int match = 500;
+    EXPECT_EQ(& items[3], list.find(visit_match, & match, 0));
+    EXPECT_TRUE(list.remove(& items[3], 0));
+    EXPECT_EQ(0, list.find(visit_match, & match, 0));
+    EXPECT_TRUE(linked(& list));
+}
+
+    /*
+     *  Writers adding and removing their own items, with readers searching the list.
+     */
+
+typedef struct {
+    pthread_t thread;
+    List2<Item2*> *list;
+    Mutex *mutex;
+    int n;
+}   PushInfo2;
+
+static void *writer_thread(void *arg)
+{
+    ASSERT(arg);
+    PushInfo2 *pi = (PushInfo2*) arg;
+    Item2 items[100];
+
+    for (int n = 0; n < pi->n; n++)
+    {
+        for (int i = 0; i < 100; i++)
+        {
+            items[i].value = i;
+            if (i & 1)
+            {
+                pi->list->push(& items[i], pi->mutex);
+            }
+            else
+            {
+                pi->list->add_sorted(& items[i], cmp, pi->mutex);
+            }
+        }
+
+        // no search needed to remove them
+        for (int i = 0; i < 100; i++)
+        {
+            const int j = (i * 37) % 100;
+            bool okay = pi->list->remove(& items[j], pi->mutex);
+            EXPECT_TRUE(okay);
+        }
+    }
+
+    return 0;
+}
+
+static void *reader_thread(void *arg)
+{
+    ASSERT(arg);
+    PushInfo2 *pi = (PushInfo2*) arg;
+
+    for (int i = 0; i < pi->n; i++)
+    {
+        int value = i % 100;
+        pi->list->find(visit_match, & value, pi->mutex);
+        pi->list->size(pi->mutex);
+    }
+
+    return 0;
+}
+
+TEST(List2, Thread)
+{
+    List2<Item2*> list(item_next, item_prev);
+    Mutex *mutex = Mutex::create();
+
+    const int num = 8;
+    PushInfo2 writers[num];
+    PushInfo2 readers[num];
+    int err;
+
+    for (int i = 0; i < num; i++)
+    {
+        PushInfo2 *pi = & writers[i];
+        pi->n = 20;
+        pi->mutex = mutex;
+        pi->list = & list;
+        err = pthread_create(& pi->thread, 0, writer_thread, pi);
+        EXPECT_EQ(0, err);
+
+        pi = & readers[i];
+        pi->n = 200;
+        pi->mutex = mutex;
+        pi->list = & list;
+        err = pthread_create(& pi->thread, 0, reader_thread, pi);
+        EXPECT_EQ(0, err);
+    }
+
+    for (int i = 0; i < num; i++)
+    {
+        err = pthread_join(writers[i].thread, 0);
+        EXPECT_EQ(0, err);
+        err = pthread_join(readers[i].thread, 0);
+        EXPECT_EQ(0, err);
+    }
+
+    EXPECT_TRUE(list.empty());
+    delete mutex;
+}
+
+//  FIN
@@ -1,5 +1,8 @@
 
 #include <pthread.h>
+#include <time.h>
+
+#include <algorithm>
 
 #include <gtest/gtest.h>
 
@@ -7,6 +10,7 @@
 #include <cli_mutex.h>
 
 #include "../src/list.h"
+#include "../src/list_stack.h"
 
 #if defined(CLI_NS)
 using namespace CLI_NS;
@@ -309,6 +313,460 @@ TEST(List, VisitFind)
     EXPECT_EQ(0, item);
 }
 
+    /*
+     *  Inlined iteration
+     */
+
+typedef struct Linked
+{
+    int value;
+    struct Linked *link;
+}   Linked;
+
+TEST(List, Iterate)
+{
+    List<Item*> list(item_next);
+    Item items[5];
+
+    for (int i = 0; i < 5; i++)
+    {
+        items[i].value = i;
+        list.append(& items[i], 0);
+    }
+
+    int n = 0;
+    for (auto *item : list)
+    {
+        EXPECT_EQ(& items[n], item);
+        n += 1;
+    }
+    EXPECT_EQ(5, n);
+
+    // a raw head
+    n = 0;
+    for (Item *item : list_range(& list.head))
+    {
+        EXPECT_EQ(n, item->value);
+        n += 1;
+    }
+    EXPECT_EQ(5, n);
+
+    EXPECT_EQ(& items[3], list_find_if(& list.head, [](Item *item) { return item->value == 3; }));
+    EXPECT_EQ(0, list_find_if(& list.head, [](Item *item) { return item->value == 10; }));
+
+    // with the standard algorithms
+    EXPECT_EQ(5, std::distance(list.begin(), list.end()));
+    EXPECT_EQ(& items[2], *std::find(list.begin(), list.end(), & items[2]));
+
+    // the policy list
+    List<Item*, NullLock> fast;
+    fast.push(& items[0]);
+    fast.push(& items[1]);
+    n = 0;
+    for (auto *item : fast)
+    {
+        EXPECT_EQ(& items[1 - n], item);
+        n += 1;
+    }
+    EXPECT_EQ(2, n);
+
+    // an empty list
+    Item *empty = 0;
+    for (Item *item : list_range(& empty))
+    {
+        EXPECT_FALSE(item);
+    }
+
+    // linked through another member
+    Linked l2 = { 2, 0 };
+    Linked l1 = { 1, & l2 };
+    Linked *head = & l1;
+    typedef ListMember<Linked, & Linked::link> Link;
+
+    n = 0;
+    for (Linked *l : list_range<Link>(& head))
+    {
+        n += l->value;
+    }
+    EXPECT_EQ(3, n);
+    EXPECT_EQ(& l2, list_find_if<Link>(& head, [](Linked *l) { return l->value == 2; }));
+
+    List<Linked*, NullLock, Link> linked;
+    linked.push(& l2);
+    linked.push(& l1);
+    EXPECT_EQ(2, linked.size());
+    EXPECT_EQ(& l2, linked.find([](Linked *l, void *) { return l->value == 2; }, 0));
+}
+
+    /*
+     *  List<T, LockPolicy>
+     */
+
+template <class L>
+static void policy_test(L & list)
+{
+    EXPECT_EQ(0, list.size());
+    EXPECT_TRUE(list.empty());
+    EXPECT_EQ(0, list.pop());
+
+    Item i1, i2, i3, i4;
+    i1.value = 100;
+    i2.value = 200;
+    i3.value = 300;
+    i4.value = 400;
+
+    list.push(& i2);
+    list.push(& i1);
+    list.append(& i3);
+    EXPECT_EQ(3, list.size());
+    EXPECT_TRUE(list.has(& i3));
+    EXPECT_FALSE(list.has(& i4));
+
+    int match = 200;
+    EXPECT_EQ(& i2, list.find(visit_match, & match));
+    match = 123;
+    EXPECT_EQ(0, list.find(visit_match, & match));
+
+    // a lambda can be inlined
+    int seen = 0;
+    list.visit([](Item *a, void *arg) { *(int*) arg += a->value; return 0; }, & seen);
+    EXPECT_EQ(600, seen);
+
+    EXPECT_TRUE(list.remove(& i2));
+    EXPECT_FALSE(list.remove(& i2));
+    EXPECT_EQ(0, i2.next);
+    EXPECT_EQ(& i1, list.pop());
+    EXPECT_EQ(& i3, list.pop());
+    EXPECT_EQ(0, list.pop());
+    EXPECT_TRUE(list.empty());
+
+    // i1, i2, i3, i4
+    list.add_sorted(& i3, cmp);
+    list.add_sorted(& i1, cmp);
+    list.add_sorted(& i4, cmp);
+    list.add_sorted(& i2, cmp);
+    EXPECT_EQ(& i1, list.pop());
+    EXPECT_EQ(& i2, list.pop());
+    EXPECT_EQ(& i3, list.pop());
+    EXPECT_EQ(& i4, list.pop());
+}
+
+TEST(List, Policy)
+{
+    List<Item*, NullLock> null_list;
+    policy_test(null_list);
+
+    List<Item*, SpinLock> spin_list;
+    policy_test(spin_list);
+
+    List<Item*, PthreadLock> pthread_list;
+    policy_test(pthread_list);
+
+    List<Item*, NullLock, ListNextFn<Item*, item_next> > fn_list;
+    policy_test(fn_list);
+}
+
+template <class L>
+static void *policy_thread(void *arg)
+{
+    L *list = (L*) arg;
+    Item items[100];
+
+    for (int n = 0; n < 100; n++)
+    {
+        for (int i = 0; i < 100; i++)
+        {
+            list->push(& items[i]);
+        }
+        for (int i = 0; i < 100; i++)
+        {
+            EXPECT_TRUE(list->remove(& items[i]));
+        }
+    }
+    return 0;
+}
+
+template <class L>
+static void policy_thread_test()
+{
+    L list;
+    pthread_t threads[4];
+
+    for (int i = 0; i < 4; i++)
+    {
+        pthread_create(& threads[i], 0, policy_thread<L>, & list);
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        pthread_join(threads[i], 0);
+    }
+
+    EXPECT_TRUE(list.empty());
+    EXPECT_EQ(0, list.size());
+}
+
+TEST(List, PolicyThread)
+{
+    policy_thread_test<List<Item*, SpinLock> >();
+    policy_thread_test<List<Item*, PthreadLock> >();
+}
+
+    /*
+     *  List with a tail
+     */
+
+TEST(List, Queue)
+{
+    Queue<Item*> queue(item_next);
+    Mutex *mutex = Mutex::create();
+
+    EXPECT_TRUE(queue.empty());
+    EXPECT_EQ(0, queue.tail());
+    EXPECT_EQ(0, queue.pop(mutex));
+
+    Item i1, i2, i3, i4, i5;
+    i1.value = 100;
+    i2.value = 200;
+    i3.value = 300;
+    i4.value = 400;
+    i5.value = 500;
+
+    // i1, i2, i3
+    queue.append(& i2, mutex);
+    EXPECT_EQ(& i2, queue.tail());
+    queue.push(& i1, mutex);
+    EXPECT_EQ(& i2, queue.tail());
+    queue.append(& i3, mutex);
+    EXPECT_EQ(& i3, queue.tail());
+    EXPECT_EQ(3, queue.size(mutex));
+
+    // remove the tail
+    EXPECT_TRUE(queue.remove(& i3, mutex));
+    EXPECT_EQ(& i2, queue.tail());
+    EXPECT_FALSE(queue.remove(& i3, mutex));
+
+    // i1, i2, i4
+    queue.append(& i4, mutex);
+    EXPECT_EQ(& i4, queue.tail());
+    EXPECT_EQ(0, i4.next);
+    EXPECT_EQ(& i4, i2.next);
+
+    // sorted : at the end, and in the middle
+    queue.add_sorted(& i5, cmp, mutex);
+    EXPECT_EQ(& i5, queue.tail());
+    queue.add_sorted(& i3, cmp, mutex);
+    EXPECT_EQ(& i5, queue.tail());
+    EXPECT_EQ(5, queue.size(mutex));
+    EXPECT_EQ(5, list_size((pList*) & queue.queue.head, (pnext) item_next, mutex));
+
+    int match = 300;
+    EXPECT_EQ(& i3, queue.find(visit_match, & match, mutex));
+    EXPECT_TRUE(queue.has(& i4, mutex));
+
+    EXPECT_EQ(& i1, queue.pop(mutex));
+    EXPECT_EQ(& i2, queue.pop(mutex));
+    EXPECT_EQ(& i3, queue.pop(mutex));
+    EXPECT_EQ(& i4, queue.pop(mutex));
+    EXPECT_EQ(& i5, queue.tail());
+    EXPECT_EQ(& i5, queue.pop(mutex));
+    EXPECT_EQ(0, queue.tail());
+    EXPECT_TRUE(queue.empty());
+    EXPECT_EQ(0, queue.pop(mutex));
+    EXPECT_EQ(0, queue.size(mutex));
+
+    // the only item
+    queue.push(& i1, mutex);
+    EXPECT_EQ(& i1, queue.tail());
+    EXPECT_TRUE(queue.remove(& i1, mutex));
+    EXPECT_EQ(0, queue.tail());
+    queue.append(& i2, mutex);
+    EXPECT_EQ(& i2, queue.head());
+    EXPECT_EQ(& i2, queue.tail());
+    EXPECT_EQ(1, queue.size(mutex));
+
+    delete mutex;
+}
+
+typedef struct {
+    Queue<Item*> *queue;
+    Mutex *mutex;
+    bool done;
+    int bad;
+}   CountInfo;
+
+static void *count_thread(void *arg)
+{
+    CountInfo *ci = (CountInfo*) arg;
+
+    // read the size while the list changes, without the lock
+    while (!__atomic_load_n(& ci->done, __ATOMIC_ACQUIRE))
+    {
+        const int n = ci->queue->size(0);
+        if ((n < 0) || (n > 100))
+        {
+            ci->bad += 1;
+        }
+    }
+    return 0;
+}
+
+TEST(List, QueueCount)
+{
+    Queue<Item*> queue(item_next);
+    Mutex *mutex = Mutex::create();
+    CountInfo ci = { & queue, mutex, false, 0 };
+    Item items[100];
+
+    pthread_t thread;
+    pthread_create(& thread, 0, count_thread, & ci);
+
+    for (int n = 0; n < 100; n++)
+    {
+        for (int i = 0; i < 100; i++)
+        {
+            items[i].value = i;
+            if (i & 1)
+            {
+                queue.append(& items[i], mutex);
+            }
+            else
+            {
+                queue.add_sorted(& items[i], cmp, mutex);
+            }
+        }
+        EXPECT_EQ(100, queue.size(mutex));
+        for (int i = 0; i < 50; i++)
+        {
+            EXPECT_TRUE(queue.remove(& items[i * 2], mutex));
+        }
+        EXPECT_EQ(50, queue.size(mutex));
+        while (queue.pop(mutex))
+            ;
+        EXPECT_EQ(0, queue.size(mutex));
+    }
+
+    __atomic_store_n(& ci.done, true, __ATOMIC_RELEASE);
+    pthread_join(thread, 0);
+    EXPECT_EQ(0, ci.bad);
+
+    delete mutex;
+}
+
+    /*
+     *  Lock-free stack
+     */
+
+TEST(List, Stack)
+{
+    Stack<Item*> stack(item_next);
+
+    EXPECT_TRUE(stack.empty());
+    EXPECT_EQ(0, stack.pop());
+    EXPECT_EQ(0, stack.pop_all());
+
+    Item i1, i2, i3;
+
+    stack.push(& i1);
+    stack.push(& i2);
+    stack.push(& i3);
+    EXPECT_FALSE(stack.empty());
+
+    EXPECT_EQ(& i3, stack.pop());
+    EXPECT_EQ(0, i3.next);
+    stack.push(& i3);
+
+    // the chain is detached intact
+    Item *chain = stack.pop_all();
+    EXPECT_TRUE(stack.empty());
+    EXPECT_EQ(& i3, chain);
+    EXPECT_EQ(& i2, i3.next);
+    EXPECT_EQ(& i1, i2.next);
+    EXPECT_EQ(0, i1.next);
+
+    // the tag moves on, even when the same item is pushed again
+    stack.push(& i1);
+    const uint64_t word = stack.stack.word;
+    EXPECT_EQ(& i1, stack.pop());
+    stack.push(& i1);
+    EXPECT_NE(word, stack.stack.word);
+    EXPECT_EQ(& i1, stack.pop());
+    EXPECT_EQ(0, stack.pop());
+}
+
+typedef struct {
+    pthread_t thread;
+    Stack<Item*> *stack;
+    int pops;
+}   StackInfo;
+
+static void *stack_thread(void *arg)
+{
+    StackInfo *si = (StackInfo*) arg;
+    Item *held[8];
+
+    // take a few items from the shared pool, then give them back
+    for (int n = 0; n < 1000; n++)
+    {
+        int count = 0;
+        for (; count < 8; count++)
+        {
+            held[count] = si->stack->pop();
+            if (!held[count])
+            {
+                break;
+            }
+            // nobody else has it
+            EXPECT_FALSE(held[count]->visited);
+            held[count]->visited = true;
+            si->pops += 1;
+        }
+        while (count--)
+        {
+            held[count]->visited = false;
+            si->stack->push(held[count]);
+        }
+    }
+    return 0;
+}
+
+TEST(List, StackThread)
+{
+    Stack<Item*> stack(item_next);
+    const int num = 4;
+    const int size = 20;
+    StackInfo info[num];
+    Item items[size];
+
+    for (int i = 0; i < size; i++)
+    {
+        items[i].value = i;
+        items[i].visited = false;
+        stack.push(& items[i]);
+    }
+
+    for (int t = 0; t < num; t++)
+    {
+        info[t].stack = & stack;
+        info[t].pops = 0;
+        pthread_create(& info[t].thread, 0, stack_thread, & info[t]);
+    }
+    for (int t = 0; t < num; t++)
+    {
+        pthread_join(info[t].thread, 0);
+        EXPECT_LT(0, info[t].pops);
+    }
+
+    // every item is back, once
+    int count = 0;
+    for (Item *item = stack.pop_all(); item; item = item->next)
+    {
+        EXPECT_FALSE(item->visited);
+        item->visited = true;
+        count += 1;
+    }
+    EXPECT_EQ(size, count);
+}
+
     /*
      *
      */
@@ -318,6 +776,7 @@ typedef struct {
     List<Item*> *list;
     Mutex *mutex;
     int n;
+    double time;
 }   PushInfo;
 
 static void *push_thread(void *arg)
@@ -372,21 +831,65 @@ static void *remove_thread(void *arg)
     return 0;
 }
 
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, & ts);
+    return (double) ts.tv_sec + ((double) ts.tv_nsec / 1e9);
+}
+
+static void *read_thread(void *arg)
+{
+    ASSERT(arg);
+    PushInfo *pi = (PushInfo*) arg;
+    List<Item*> *list = pi->list;
+
+    const double start = now();
+    for (int i = 0; i < pi->n; i++)
+    {
+        int value = i % 100;
+        list->find(visit_match, & value, pi->mutex);
+        list->size(pi->mutex);
+    }
+    pi->time = now() - start;
+
+    return 0;
+}
+
     /*
-     *
+     *  Writers adding and removing items, with many readers searching the list.
+     *  Returns the mean time taken by a reader.
      */
 
-TEST(List, Thread)
+static double thread_run(Mutex *mutex, int readers)
 {
     List<Item*> list(item_next);
-    Mutex *mutex = Mutex::create();
 
     const int num = 50;
     const int adds = 100;
     PushInfo push[num];
     PushInfo pop[num];
+    PushInfo *read = new PushInfo[readers];
     int err;
 
+    // give the readers something to search
+    Item fill[100];
+    for (int i = 0; i < 100; i++)
+    {
+        fill[i].value = -1;
+        list.push(& fill[i], 0);
+    }
+
+    for (int i = 0; i < readers; i++)
+    {
+        PushInfo *pi = & read[i];
+        pi->n = 2000;
+        pi->mutex = mutex;
+        pi->list = & list;
+        err = pthread_create(& pi->thread, 0, read_thread, pi);
+        EXPECT_EQ(0, err);
+    }
+
     for (int i = 0; i < num; i++)
     {
         PushInfo *pi = & push[i];
@@ -415,7 +918,97 @@ TEST(List, Thread)
         EXPECT_EQ(0, err);
     }
 
+    double t = 0;
+    for (int i = 0; i < readers; i++)
+    {
+        err = pthread_join(read[i].thread, 0);
+        EXPECT_EQ(0, err);
+        t += read[i].time / readers;
+    }
+
+    for (int i = 0; i < 100; i++)
+    {
+        list.remove(& fill[i], 0);
+    }
+
+    EXPECT_TRUE(list.empty());
+    delete[] read;
+    return t;
+}
+
+TEST(List, Thread)
+{
+    Mutex *mutex = Mutex::create();
+    SharedMutex *shared = SharedMutex::create();
+    Mutex *cs = Mutex::create_critical_section();
+
+    for (int readers = 1; readers <= 16; readers *= 4)
+    {
+        const double t0 = thread_run(mutex, readers);
+        const double t1 = thread_run(shared, readers);
+        const double t2 = thread_run(cs, readers);
+
+        printf("list : %2d readers, 2000 reads each : mutex %8.3fms, shared %8.3fms, critical section %8.3fms\n",
+                readers, t0 * 1e3, t1 * 1e3, t2 * 1e3);
+    }
+
+    delete cs;
+    delete shared;
+    delete mutex;
+}
+
+    /*
+     *
+     */
+
+typedef struct {
+    SharedMutex *mutex;
+    bool got;
+}   SharedInfo;
+
+static void *shared_thread(void *arg)
+{
+    SharedInfo *si = (SharedInfo*) arg;
+    SharedLock lock(si->mutex);
+    __atomic_store_n(& si->got, true, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static void *exclusive_thread(void *arg)
+{
+    SharedInfo *si = (SharedInfo*) arg;
+    Lock lock(si->mutex);
+    __atomic_store_n(& si->got, true, __ATOMIC_RELEASE);
+    return 0;
+}
+
+TEST(List, SharedMutex)
+{
+    SharedInfo si = { SharedMutex::create(), false };
+    pthread_t thread;
+
+    // readers share
+    si.mutex->lock_shared();
+    pthread_create(& thread, 0, shared_thread, & si);
+    pthread_join(thread, 0);
+    EXPECT_TRUE(si.got);
+
+    // a writer waits for the readers
+    si.got = false;
+    pthread_create(& thread, 0, exclusive_thread, & si);
+    usleep(10000);
+    EXPECT_FALSE(__atomic_load_n(& si.got, __ATOMIC_ACQUIRE));
+    si.mutex->unlock_shared();
+    pthread_join(thread, 0);
+    EXPECT_TRUE(si.got);
+
+    // a plain Mutex is exclusive for shared access too
+    Mutex *mutex = Mutex::create();
+    {
+        SharedLock lock(mutex);
+    }
     delete mutex;
+    delete si.mutex;
 }
 
 //  FIN
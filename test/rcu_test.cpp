@@ -0,0 +1,308 @@
+#include <pthread.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <cli_debug.h>
+#include "../src/cli.h"
+#include "../src/cli_rcu.h"
+
+#if defined(CLI_NS)
+using namespace CLI_NS;
+#endif
+
+    /*
+     *  rcu_synchronize() waits for readers in other threads
+     */
+
+typedef struct {
+    bool entered;
+    bool leave;
+    bool synced;
+}   SyncState;
+
+static void *sync_reader(void *arg)
+{
+    SyncState *state = (SyncState*) arg;
+
+    rcu_read_lock();
+    rcu_read_lock();
+    __atomic_store_n(& state->entered, true, __ATOMIC_RELEASE);
+    while (!__atomic_load_n(& state->leave, __ATOMIC_ACQUIRE))
+    {
+        usleep(100);
+    }
+    rcu_read_unlock();
+    // still in the outer section
+    usleep(10000);
+    EXPECT_FALSE(__atomic_load_n(& state->synced, __ATOMIC_ACQUIRE));
+    rcu_read_unlock();
+    return 0;
+}
+
+static void *sync_writer(void *arg)
+{
+    SyncState *state = (SyncState*) arg;
+    rcu_synchronize();
+    __atomic_store_n(& state->synced, true, __ATOMIC_RELEASE);
+    return 0;
+}
+
+TEST(Rcu, Synchronize)
+{
+    // no readers
+    rcu_synchronize();
+
+    // waiting for our own read section would deadlock
+    rcu_read_lock();
+    rcu_synchronize();
+    rcu_read_unlock();
+
+    SyncState state = { false, false, false };
+    pthread_t reader, writer;
+
+    pthread_create(& reader, 0, sync_reader, & state);
+    while (!__atomic_load_n(& state.entered, __ATOMIC_ACQUIRE))
+    {
+        usleep(100);
+    }
+
+    pthread_create(& writer, 0, sync_writer, & state);
+    usleep(10000);
+    EXPECT_FALSE(__atomic_load_n(& state.synced, __ATOMIC_ACQUIRE));
+
+    __atomic_store_n(& state.leave, true, __ATOMIC_RELEASE);
+    pthread_join(reader, 0);
+    pthread_join(writer, 0);
+    EXPECT_TRUE(state.synced);
+
+    // a new reader, once the thread record is reused
+    rcu_read_lock();
+    rcu_read_unlock();
+}
+
+    /*
+     *  Sessions running commands from a shared list while it is changed
+     */
+
+#define LIVE 0x1234
+#define DEAD 0xdead
+
+static int bad_calls;
+
+static int quiet(void *ctx, const char *fmt, va_list va)
+{
+    UNUSED(ctx);
+    UNUSED(fmt);
+    UNUSED(va);
+    return 0;
+}
+
+static void check_live(CLI *cli, CliCommand *cmd)
+{
+    UNUSED(cli);
+    int *state = (int*) cmd->ctx;
+    if (__atomic_load_n(state, __ATOMIC_RELAXED) != LIVE)
+    {
+        __atomic_add_fetch(& bad_calls, 1, __ATOMIC_RELAXED);
+    }
+}
+
+typedef struct {
+    CliCommand *head;
+    bool done;
+    int runs;
+}   Shared;
+
+static void *session(void *arg)
+{
+    Shared *shared = (Shared*) arg;
+    CliOutput out = { quiet, 0 };
+    CLI cli = {
+        .output = & out,
+        .prompt = "",
+        .eol = "",
+    };
+
+    cli_init(& cli, 64, 0);
+    cli.echo = false;
+    cli.head = shared->head;
+
+    while (!__atomic_load_n(& shared->done, __ATOMIC_ACQUIRE))
+    {
+        cli_process_buffer(& cli, "a\nb\nc\nd\nhelp\n", 14);
+        __atomic_add_fetch(& shared->runs, 1, __ATOMIC_RELAXED);
+    }
+
+    cli_close(& cli);
+    return 0;
+}
+
+TEST(Rcu, Cli)
+{
+    static const char *names[] = { "a", "b", "c", "d", };
+    CliCommand cmds[4];
+    int states[4];
+
+    CliOutput out = { quiet, 0 };
+    CLI writer = {
+        .output = & out,
+        .prompt = "",
+        .eol = "",
+    };
+    cli_init(& writer, 64, 0);
+
+    // the sessions share the list after the first command
+    CliCommand help = { .cmd = "help", .handler = cli_help, };
+    CliCommand **head = & help.next;
+
+    for (int i = 0; i < 4; i++)
+    {
+        memset(& cmds[i], 0, sizeof(CliCommand));
+        cmds[i].cmd = names[i];
+        cmds[i].handler = check_live;
+        cmds[i].ctx = & states[i];
+        states[i] = LIVE;
+        cli_insert(& writer, head, & cmds[i]);
+    }
+
+    bad_calls = 0;
+    Shared shared = { & help, false, 0 };
+    const int num = 2;
+    pthread_t threads[num];
+
+    for (int i = 0; i < num; i++)
+    {
+        pthread_create(& threads[i], 0, session, & shared);
+    }
+
+    // wait for the sessions to start
+    while (!__atomic_load_n(& shared.runs, __ATOMIC_ACQUIRE))
+    {
+        usleep(100);
+    }
+
+    for (int n = 0; n < 200; n++)
+    {
+        CliCommand *cmd = & cmds[n % 4];
+        int *state = (int*) cmd->ctx;
+
+        EXPECT_TRUE(cli_remove(head, cmd));
+        // the command is ours again : poison it
+        EXPECT_EQ(0, cmd->next);
+        __atomic_store_n(state, DEAD, __ATOMIC_RELAXED);
+        usleep(200);
+
+        __atomic_store_n(state, LIVE, __ATOMIC_RELAXED);
+        if (n & 1)
+        {
+            cli_insert(& writer, head, cmd);
+        }
+        else
+        {
+            // append
+            CliCommand **tail = head;
+            for (; *tail; tail = & (*tail)->next)
+                ;
+            cli_insert(& writer, tail, cmd);
+        }
+    }
+
+    __atomic_store_n(& shared.done, true, __ATOMIC_RELEASE);
+    for (int i = 0; i < num; i++)
+    {
+        pthread_join(threads[i], 0);
+    }
+
+    EXPECT_EQ(0, bad_calls);
+    EXPECT_LT(0, shared.runs);
+
+    cli_close(& writer);
+}
+
+    /*
+     *  cli_remove() waits for the handlers of the command removed, not others
+     */
+
+typedef struct {
+    CliCommand **head;
+    CliCommand *cmd;
+    bool entered;
+    bool removed;
+    bool returned;
+}   Removal;
+
+static void *remover(void *arg)
+{
+    Removal *r = (Removal*) arg;
+    while (!__atomic_load_n(& r->entered, __ATOMIC_ACQUIRE))
+    {
+        usleep(100);
+    }
+    EXPECT_TRUE(cli_remove(r->head, r->cmd));
+    __atomic_store_n(& r->removed, true, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static void wait_removed(CLI *cli, CliCommand *cmd)
+{
+    UNUSED(cli);
+    Removal *r = (Removal*) cmd->ctx;
+    __atomic_store_n(& r->entered, true, __ATOMIC_RELEASE);
+    // give up after a second rather than deadlock
+    for (int i = 0; (i < 10000) && !__atomic_load_n(& r->removed, __ATOMIC_ACQUIRE); i++)
+    {
+        usleep(100);
+    }
+    EXPECT_TRUE(__atomic_load_n(& r->removed, __ATOMIC_ACQUIRE));
+    __atomic_store_n(& r->returned, true, __ATOMIC_RELEASE);
+}
+
+static void linger(CLI *cli, CliCommand *cmd)
+{
+    UNUSED(cli);
+    Removal *r = (Removal*) cmd->ctx;
+    __atomic_store_n(& r->entered, true, __ATOMIC_RELEASE);
+    usleep(20000);
+    EXPECT_FALSE(__atomic_load_n(& r->removed, __ATOMIC_ACQUIRE));
+    __atomic_store_n(& r->returned, true, __ATOMIC_RELEASE);
+}
+
+TEST(Rcu, Handler)
+{
+    CliOutput out = { quiet, 0 };
+    CLI cli = {
+        .output = & out,
+        .prompt = "",
+        .eol = "",
+    };
+    cli_init(& cli, 64, 0);
+
+    Removal r = { & cli.head, 0, false, false, false };
+    CliCommand other = { .cmd = "other", };
+    CliCommand wait = { .cmd = "wait", .handler = wait_removed, .ctx = & r, };
+    CliCommand slow = { .cmd = "slow", .handler = linger, .ctx = & r, };
+    cli_insert(& cli, & cli.head, & other);
+    cli_insert(& cli, & cli.head, & wait);
+    cli_insert(& cli, & cli.head, & slow);
+
+    // the handler waits for the removal of another command
+    pthread_t thread;
+    r.cmd = & other;
+    pthread_create(& thread, 0, remover, & r);
+    cli_process_buffer(& cli, "wait\n", 5);
+    pthread_join(thread, 0);
+    EXPECT_TRUE(r.removed);
+
+    // removing a running command waits for its handler
+    r = { & cli.head, & slow, false, false, false };
+    pthread_create(& thread, 0, remover, & r);
+    cli_process_buffer(& cli, "slow\n", 5);
+    pthread_join(thread, 0);
+    EXPECT_TRUE(r.removed);
+    EXPECT_TRUE(r.returned);
+
+    cli_close(& cli);
+}
+
+//  FIN
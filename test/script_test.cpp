@@ -0,0 +1,182 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include <cli_debug.h>
+
+#include "../src/cli.h"
+#include "../src/linux/cli_script.h"
+#include "test_io.h"
+
+#if defined(CLI_NS)
+using namespace CLI_NS;
+#endif
+
+static void say(CLI *cli, CliCommand *cmd)
+{
+    UNUSED(cmd);
+    cli_print(cli, "%s", cmd->cmd);
+    for (int i = 0; i < cli_argc(cli); i++)
+    {
+        cli_print(cli, " %s", cli_get_arg(cli, i));
+    }
+    cli_print(cli, "%s", cli->eol);
+}
+
+static void fail(CLI *cli, CliCommand *cmd)
+{
+    UNUSED(cmd);
+    cli_set_status(cli, 1);
+}
+
+static int counted = 0;
+
+static void count(CLI *cli, CliCommand *cmd)
+{
+    UNUSED(cli);
+    UNUSED(cmd);
+    counted += 1;
+}
+
+static void source(CLI *cli, CliCommand *cmd)
+{
+    UNUSED(cmd);
+    const char *path = cli_get_arg(cli, 0);
+    if (!path)
+    {
+        cli_set_status(cli, 1);
+        return;
+    }
+    const bool stop = (cli_argc(cli) > 1) && !strcmp(cli_get_arg(cli, 1), "-e");
+    cli_run_script(cli, path, stop ? CLI_STOP_ON_ERROR : 0);
+    // the args are kept
+    cli_print(cli, "sourced %s%s", cli_get_arg(cli, 0), cli->eol);
+}
+
+static CliCommand commands[] = {
+    { .cmd = "say", .handler = say, },
+    { .cmd = "fail", .handler = fail, },
+    { .cmd = "count", .handler = count, },
+    { .cmd = "source", .handler = source, },
+};
+
+static const size_t num_commands = sizeof(commands) / sizeof(commands[0]);
+
+static std::string temp_file(const std::string &text)
+{
+    char path[] = "/tmp/cli_scriptXXXXXX";
+    const int fd = mkstemp(path);
+    EXPECT_GE(fd, 0);
+    EXPECT_EQ((ssize_t) text.size(), write(fd, text.data(), text.size()));
+    close(fd);
+    return path;
+}
+
+TEST(Script, Lines)
+{
+    std::string text;
+    CliOutput out = { capture_fprintf, & text };
+    CLI cli;
+    session_init(& cli, & out, 128, commands, num_commands);
+    text.clear();
+
+    // blank lines, CRLF, and no eol at the end
+    const char *s = "say a b\n\n   \r\nsay 'c d'\r\n  say e ; say f\nsay g";
+    EXPECT_EQ(0, cli_run_lines(& cli, 0, s, strlen(s), 0));
+    EXPECT_STREQ("say a b\r\nsay c d\r\nsay e\r\nsay f\r\nsay g\r\n", text.c_str());
+    EXPECT_EQ(0, cli.status);
+
+    // not NUL terminated
+    text.clear();
+    EXPECT_EQ(0, cli_run_lines(& cli, 0, "say xyz", 5, 0));
+    EXPECT_STREQ("say x\r\n", text.c_str());
+
+    // errors are reported, the first is returned
+    text.clear();
+    const std::string errors = "say 1\nfail\nnope\nsay 'x\nsay " + std::string(200, 'x') + "\nsay 2\n";
+    s = errors.c_str();
+    EXPECT_EQ(2, cli_run_lines(& cli, "test", s, strlen(s), 0));
+    EXPECT_STREQ("say 1\r\n"
+                 "test:2 : failed\r\n"
+                 "'nope' not found\r\ntest:3 : failed\r\n"
+                 "unterminated quote\r\ntest:4 : failed\r\n"
+                 "test:5 : too long\r\n"
+                 "say 2\r\n", text.c_str());
+    EXPECT_EQ(1, cli.status);
+
+    // or stop the run
+    text.clear();
+    EXPECT_EQ(2, cli_run_lines(& cli, 0, s, strlen(s), CLI_STOP_ON_ERROR));
+    EXPECT_STREQ("say 1\r\nline 2 : failed\r\n", text.c_str());
+
+    // no prompt or echo, and the line editor is left alone
+    text.clear();
+    cli_process_buffer(& cli, "say", 3);
+    EXPECT_EQ(0, cli_run_lines(& cli, 0, "say q\n", 6, 0));
+    cli_process_buffer(& cli, " r\n", 3);
+    EXPECT_STREQ("say q\r\nsay r\r\n> ", text.c_str());
+
+    cli_close(& cli);
+}
+
+TEST(Script, File)
+{
+    std::string text;
+    CliOutput out = { capture_fprintf, & text };
+    CLI cli;
+    session_init(& cli, & out, 128, commands, num_commands);
+
+    std::string script;
+    for (int i = 0; i < 20000; i++)
+    {
+        script += "count\n";
+    }
+    script += "say end\n";
+    const std::string path = temp_file(script);
+
+    counted = 0;
+    text.clear();
+    EXPECT_EQ(0, cli_run_script(& cli, path.c_str(), 0));
+    EXPECT_EQ(20000, counted);
+    EXPECT_STREQ("say end\r\n", text.c_str());
+
+    // from a handler, in a compound line
+    const std::string bad = temp_file("say x\nfail\nsay y\n");
+    text.clear();
+    const std::string line = "source " + bad + " && say ok ; say z\n";
+    cli_process_buffer(& cli, line.c_str(), line.size());
+    EXPECT_EQ("say x\r\n" + bad + ":2 : failed\r\nsay y\r\nsourced " + bad + "\r\nsay z\r\n> ", text);
+
+    text.clear();
+    const std::string stop = "source " + bad + " -e\n";
+    cli_process_buffer(& cli, stop.c_str(), stop.size());
+    EXPECT_EQ("say x\r\n" + bad + ":2 : failed\r\nsourced " + bad + "\r\n> ", text);
+
+    // nested
+    const std::string outer = temp_file("say in\nsource " + path + "\nsay out\n");
+    counted = 0;
+    text.clear();
+    EXPECT_EQ(0, cli_run_script(& cli, outer.c_str(), 0));
+    EXPECT_EQ(20000, counted);
+    EXPECT_EQ("say in\r\nsay end\r\nsourced " + path + "\r\nsay out\r\n", text);
+
+    // empty, missing
+    const std::string empty = temp_file("");
+    EXPECT_EQ(0, cli_run_script(& cli, empty.c_str(), 0));
+    text.clear();
+    EXPECT_EQ(-1, cli_run_script(& cli, "/no/such/file", 0));
+    EXPECT_STREQ("error opening file '/no/such/file'\r\n", text.c_str());
+    EXPECT_EQ(1, cli.status);
+
+    unlink(path.c_str());
+    unlink(bad.c_str());
+    unlink(outer.c_str());
+    unlink(empty.c_str());
+    cli_close(& cli);
+}
+
+//  FIN
@@ -0,0 +1,568 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <cli_debug.h>
+
+#include "../src/cli.h"
+#include "../src/linux/cli_server.h"
+#include "../src/linux/cli_pool.h"
+
+#if defined(CLI_NS)
+using namespace CLI_NS;
+#endif
+
+static void cmd_ping(CLI *cli, CliCommand *cmd)
+{
+    UNUSED(cmd);
+    cli_print(cli, "pong%s", cli->eol);
+}
+
+static void cmd_quit(CLI *cli, CliCommand *cmd)
+{
+    UNUSED(cmd);
+    cli_print(cli, "bye%s", cli->eol);
+    cli_server_hangup(cli);
+}
+
+// set to let "slow" finish
+static int slow_gate;
+
+static void cmd_slow(CLI *cli, CliCommand *cmd)
+{
+    UNUSED(cmd);
+    for (int i = 0; (i < 5000) && !__atomic_load_n(& slow_gate, __ATOMIC_ACQUIRE); i++)
+    {
+        usleep(1000);
+    }
+    cli_print(cli, "done%s", cli->eol);
+}
+
+static CliCommand slow = {
+    .cmd = "slow",
+    .handler = cmd_slow,
+};
+
+// the session can't be closed from a worker
+static CliCommand quit = {
+    .cmd = "quit",
+    .handler = cmd_quit,
+    .help = 0,
+    .subcommand = 0,
+    .ctx = 0,
+    .next = & slow,
+    .flags = CLI_INLINE,
+};
+
+static CliCommand ping = {
+    .cmd = "ping",
+    .handler = cmd_ping,
+    .help = 0,
+    .subcommand = 0,
+    .ctx = 0,
+    .next = & quit,
+};
+
+static void *server_thread(void *arg)
+{
+    cli_server_loop((CliServer*) arg);
+    return 0;
+}
+
+static int connect_unix(const char *path)
+{
+    struct sockaddr_un addr;
+    memset(& addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    EXPECT_LE(0, fd);
+    EXPECT_EQ(0, connect(fd, (struct sockaddr*) & addr, sizeof(addr)));
+    return fd;
+}
+
+static int connect_tcp(int port)
+{
+    struct sockaddr_in addr;
+    memset(& addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((uint16_t) port);
+
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    EXPECT_LE(0, fd);
+    EXPECT_EQ(0, connect(fd, (struct sockaddr*) & addr, sizeof(addr)));
+    return fd;
+}
+
+    /*
+     *  Read until the text ends with \a end, or the socket closes,
+     *  or nothing comes for 5s
+     */
+
+static const char *read_until(int fd, const char *end, char *buf, size_t size)
+{
+    size_t used = 0;
+    const size_t len = strlen(end);
+
+    while (used < (size - 1))
+    {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(& pfd, 1, 5000) <= 0)
+        {
+            ADD_FAILURE() << "read_until() timed out";
+            break;
+        }
+        const ssize_t n = read(fd, & buf[used], size - 1 - used);
+        if (n <= 0)
+        {
+            break;
+        }
+        used += (size_t) n;
+        buf[used] = '\0';
+        if ((used >= len) && !strcmp(& buf[used - len], end))
+        {
+            break;
+        }
+    }
+    buf[used] = '\0';
+    return buf;
+}
+
+static void send_str(int fd, const char *s)
+{
+    const ssize_t n = write(fd, s, strlen(s));
+    EXPECT_EQ((ssize_t) strlen(s), n);
+}
+
+static void on_open(CLI *cli, void *arg)
+{
+    UNUSED(cli);
+    __atomic_add_fetch((int*) arg, 1, __ATOMIC_RELAXED);
+}
+
+TEST(Server, Basic)
+{
+    int opened = 0;
+    CliServerConfig config = {
+        .head = & ping,
+        .table = 0,
+        .prompt = "> ",
+        .eol = "\r\n",
+        .echo = false,
+    };
+    config.on_open = on_open;
+    config.arg = & opened;
+
+    CliServer *server = cli_server_create(& config);
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/cli_test_%d.sock", (int) getpid());
+    EXPECT_EQ(0, cli_server_listen_unix(server, path));
+    const int port = cli_server_listen_tcp(server, 0);
+    EXPECT_LT(0, port);
+
+    pthread_t thread;
+    pthread_create(& thread, 0, server_thread, server);
+
+    char buf[256];
+    const int u = connect_unix(path);
+    const int t = connect_tcp(port);
+
+    EXPECT_STREQ("> ", read_until(u, "> ", buf, sizeof(buf)));
+    EXPECT_STREQ("> ", read_until(t, "> ", buf, sizeof(buf)));
+
+    // a command split across writes
+    send_str(u, "pi");
+    send_str(t, "ping\n");
+    EXPECT_STREQ("pong\r\n> ", read_until(t, "> ", buf, sizeof(buf)));
+    send_str(u, "ng\n");
+    EXPECT_STREQ("pong\r\n> ", read_until(u, "> ", buf, sizeof(buf)));
+
+    // several commands in one write
+    send_str(t, "ping\nping\n");
+    EXPECT_STREQ("pong\r\n> pong\r\n> ", read_until(t, "> pong\r\n> ", buf, sizeof(buf)));
+
+    // the server closes the session after the output
+    send_str(u, "quit\n");
+    EXPECT_STREQ("bye\r\n", read_until(u, "never", buf, sizeof(buf)));
+    close(u);
+
+    // closed by the client
+    close(t);
+
+    cli_server_stop(server);
+    pthread_join(thread, 0);
+
+    // pick up the close
+    while (cli_server_sessions(server))
+    {
+        cli_server_run(server, 100);
+    }
+
+    EXPECT_EQ(2, opened);
+    cli_server_delete(server);
+    EXPECT_NE(0, access(path, F_OK));
+}
+
+    /*
+     *  Machine mode set from on_open : no prompt before the first response
+     */
+
+static void on_open_machine(CLI *cli, void *arg)
+{
+    cli_set_machine(cli, (const char*) arg);
+}
+
+TEST(Server, Machine)
+{
+    CliServerConfig config = {
+        .head = & ping,
+        .table = 0,
+        .prompt = "> ",
+        .eol = "\r\n",
+        .echo = false,
+    };
+    config.on_open = on_open_machine;
+    config.arg = (void*) ".";
+
+    CliServer *server = cli_server_create(& config);
+    const int port = cli_server_listen_tcp(server, 0);
+    EXPECT_LT(0, port);
+
+    pthread_t thread;
+    pthread_create(& thread, 0, server_thread, server);
+
+    char buf[256];
+    const int t = connect_tcp(port);
+
+    // the first bytes are the response, then the marker
+    const char *expect = "pong\r\n. 0\r\n. 0\r\npong\r\n. 0\r\n";
+    send_str(t, "ping\n\nping\n");
+    EXPECT_STREQ(expect, read_until(t, expect, buf, sizeof(buf)));
+    close(t);
+
+    cli_server_stop(server);
+    pthread_join(thread, 0);
+    cli_server_delete(server);
+}
+
+    /*
+     *  A slow handler on the executor doesn't hold up the other sessions.
+     *  Only the order is checked : a lost reply fails in read_until()
+     */
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, & ts);
+    return ((uint64_t) ts.tv_sec * 1000000000UL) + (uint64_t) ts.tv_nsec;
+}
+
+TEST(Server, Executor)
+{
+    CliPool *pool = cli_pool_create(2);
+
+    CliServerConfig config = {
+        .head = & ping,
+        .table = 0,
+        .prompt = "> ",
+        .eol = "\r\n",
+        .echo = false,
+    };
+    config.executor = cli_pool_executor(pool);
+
+    CliServer *server = cli_server_create(& config);
+    const int port = cli_server_listen_tcp(server, 0);
+    EXPECT_LT(0, port);
+
+    pthread_t thread;
+    pthread_create(& thread, 0, server_thread, server);
+
+    char buf[256];
+    const int a = connect_tcp(port);
+    const int b = connect_tcp(port);
+    EXPECT_STREQ("> ", read_until(a, "> ", buf, sizeof(buf)));
+    EXPECT_STREQ("> ", read_until(b, "> ", buf, sizeof(buf)));
+
+    __atomic_store_n(& slow_gate, 0, __ATOMIC_RELEASE);
+    send_str(a, "slow\nping\n");
+    send_str(b, "ping\n");
+    EXPECT_STREQ("pong\r\n> ", read_until(b, "> ", buf, sizeof(buf)));
+
+    // a is still held by the slow one
+    struct pollfd pfd = { a, POLLIN, 0 };
+    EXPECT_EQ(0, poll(& pfd, 1, 0));
+
+    // in order, after the slow one
+    __atomic_store_n(& slow_gate, 1, __ATOMIC_RELEASE);
+    EXPECT_STREQ("done\r\n> pong\r\n> ", read_until(a, "> pong\r\n> ", buf, sizeof(buf)));
+
+    // closed with a handler still running : the others aren't held up
+    __atomic_store_n(& slow_gate, 0, __ATOMIC_RELEASE);
+    send_str(a, "slow\n");
+    usleep(20000);
+    close(a);
+    usleep(20000);
+    send_str(b, "ping\n");
+    EXPECT_STREQ("pong\r\n> ", read_until(b, "> ", buf, sizeof(buf)));
+    __atomic_store_n(& slow_gate, 1, __ATOMIC_RELEASE);
+
+    send_str(b, "quit\n");
+    EXPECT_STREQ("bye\r\n", read_until(b, "never", buf, sizeof(buf)));
+    close(b);
+
+    cli_server_stop(server);
+    pthread_join(thread, 0);
+    cli_server_delete(server);
+    cli_pool_delete(pool);
+}
+
+    /*
+     *  Out of fds : the server waits for a session to close, not spinning
+     */
+
+static double thread_cpu_s(pthread_t thread)
+{
+    clockid_t clock;
+    struct timespec ts;
+    EXPECT_EQ(0, pthread_getcpuclockid(thread, & clock));
+    clock_gettime(clock, & ts);
+    return (double) ts.tv_sec + ((double) ts.tv_nsec / 1e9);
+}
+
+TEST(Server, Overload)
+{
+    CliServerConfig config = {
+        .head = & ping,
+        .table = 0,
+        .prompt = "> ",
+        .eol = "\r\n",
+        .echo = false,
+    };
+
+    CliServer *server = cli_server_create(& config);
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/cli_overload_%d.sock", (int) getpid());
+    EXPECT_EQ(0, cli_server_listen_unix(server, path));
+
+    pthread_t thread;
+    pthread_create(& thread, 0, server_thread, server);
+
+    char buf[64];
+    const int a = connect_unix(path);
+    EXPECT_STREQ("> ", read_until(a, "> ", buf, sizeof(buf)));
+
+    // use up the fds, bar one for the client end of b
+    struct rlimit lim;
+    EXPECT_EQ(0, getrlimit(RLIMIT_NOFILE, & lim));
+    const struct rlimit was = lim;
+    const int probe = dup(0);
+    close(probe);
+    lim.rlim_cur = (rlim_t) probe + 16;
+    EXPECT_EQ(0, setrlimit(RLIMIT_NOFILE, & lim));
+
+    std::vector<int> spare;
+    for (int fd; (fd = dup(0)) >= 0; )
+    {
+        spare.push_back(fd);
+    }
+    EXPECT_EQ(EMFILE, errno);
+    close(spare.back());
+    spare.pop_back();
+
+    const int b = connect_unix(path);
+
+    // the server can't accept b : it must not spin on the listener
+    usleep(100000);
+    const double cpu = thread_cpu_s(thread);
+    usleep(200000);
+    EXPECT_GT(0.05, thread_cpu_s(thread) - cpu);
+
+    // a session closes : b is accepted
+    close(a);
+    EXPECT_STREQ("> ", read_until(b, "> ", buf, sizeof(buf)));
+    send_str(b, "ping\n");
+    EXPECT_STREQ("pong\r\n> ", read_until(b, "> ", buf, sizeof(buf)));
+    close(b);
+
+    for (int fd : spare)
+    {
+        close(fd);
+    }
+    setrlimit(RLIMIT_NOFILE, & was);
+
+    cli_server_stop(server);
+    pthread_join(thread, 0);
+    cli_server_delete(server);
+}
+
+    /*
+     *  Load test : many sessions, each doing round trips
+     */
+
+typedef struct {
+    int fd;
+    int sent;
+    size_t got;
+    uint64_t start;
+}   Client;
+
+TEST(Server, Load)
+{
+    // each session takes two fds, the client's and the server's
+    struct rlimit lim;
+    EXPECT_EQ(0, getrlimit(RLIMIT_NOFILE, & lim));
+    const struct rlimit was = lim;
+    lim.rlim_cur = lim.rlim_max;
+    setrlimit(RLIMIT_NOFILE, & lim);
+    getrlimit(RLIMIT_NOFILE, & lim);
+    const int num = (int) std::min((rlim_t) 2000, (lim.rlim_cur - 64) / 2);
+    const int rounds = 5;
+    const char *request = "ping\n";
+    const char *reply = "pong\r\n> ";
+    const size_t reply_len = strlen(reply);
+
+    CliServerConfig config = {
+        .head = & ping,
+        .table = 0,
+        .prompt = "> ",
+        .eol = "\r\n",
+        .echo = false,
+    };
+
+    CliServer *server = cli_server_create(& config);
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/cli_load_%d.sock", (int) getpid());
+    EXPECT_EQ(0, cli_server_listen_unix(server, path));
+
+    pthread_t thread;
+    pthread_create(& thread, 0, server_thread, server);
+
+    const int epfd = epoll_create1(EPOLL_CLOEXEC);
+    Client *clients = new Client[num];
+    char buf[64];
+
+    for (int i = 0; i < num; i++)
+    {
+        Client *c = & clients[i];
+        c->fd = connect_unix(path);
+        // the first prompt
+        EXPECT_STREQ("> ", read_until(c->fd, "> ", buf, sizeof(buf)));
+        fcntl(c->fd, F_SETFL, O_NONBLOCK);
+        c->sent = 0;
+        c->got = 0;
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = c;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, c->fd, & ev);
+    }
+
+    std::vector<uint64_t> latency;
+    latency.reserve(num * rounds);
+
+    const uint64_t start = now_ns();
+    for (int i = 0; i < num; i++)
+    {
+        clients[i].start = now_ns();
+        send_str(clients[i].fd, request);
+        clients[i].sent = 1;
+    }
+
+    int done = 0;
+    int errors = 0;
+    struct epoll_event events[256];
+    while (done < num)
+    {
+        const int n = epoll_wait(epfd, events, 256, 5000);
+        if (n <= 0)
+        {
+            // lost a reply
+            errors += 1;
+            break;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            Client *c = (Client*) events[i].data.ptr;
+            const ssize_t got = read(c->fd, buf, sizeof(buf));
+            if (got <= 0)
+            {
+                errors += 1;
+                continue;
+            }
+
+            for (ssize_t j = 0; j < got; j++)
+            {
+                if (buf[j] != reply[c->got])
+                {
+                    errors += 1;
+                }
+                c->got += 1;
+                if (c->got < reply_len)
+                {
+                    continue;
+                }
+
+                // a complete reply
+                c->got = 0;
+                const uint64_t t = now_ns();
+                latency.push_back(t - c->start);
+                if (c->sent == rounds)
+                {
+                    done += 1;
+                    continue;
+                }
+                c->start = t;
+                send_str(c->fd, request);
+                c->sent += 1;
+            }
+        }
+    }
+    const uint64_t elapsed = now_ns() - start;
+
+    EXPECT_EQ(0, errors);
+    EXPECT_EQ((size_t) (num * rounds), latency.size());
+
+    if (!latency.empty())
+    {
+        std::sort(latency.begin(), latency.end());
+        const uint64_t p50 = latency[latency.size() / 2];
+        const uint64_t p99 = latency[(latency.size() * 99) / 100];
+        printf("%d sessions, %d commands : %.0f commands/s, p50 %.3fms, p99 %.3fms\n",
+                num, num * rounds,
+                (double) latency.size() * 1e9 / (double) elapsed,
+                (double) p50 / 1e6, (double) p99 / 1e6);
+    }
+
+    for (int i = 0; i < num; i++)
+    {
+        close(clients[i].fd);
+    }
+    close(epfd);
+    delete[] clients;
+
+    cli_server_stop(server);
+    pthread_join(thread, 0);
+    cli_server_delete(server);
+    setrlimit(RLIMIT_NOFILE, & was);
+}
+
+//  FIN
@@ -0,0 +1,330 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <cli_debug.h>
+#include <cli_mutex.h>
+
+#include "../src/cli_rcu.h"
+#include "../src/list.h"
+#include "../src/skiplist.h"
+
+#if defined(CLI_NS)
+using namespace CLI_NS;
+#endif
+
+typedef struct Timer
+{
+    struct Timer *next;
+    int when;
+    int id;
+}   Timer;
+
+static Timer ** timer_next(Timer *t)
+{
+    return & t->next;
+}
+
+static int timer_cmp(Timer *a, Timer *b)
+{
+    return b->when - a->when;
+}
+
+static int collect(Timer *t, void *arg)
+{
+    Timer ***out = (Timer***) arg;
+    *(*out)++ = t;
+    return 0;
+}
+
+    /*
+     *  Same order as list_add_sorted(), duplicates included
+     */
+
+TEST(SkipList, Order)
+{
+    const int num = 500;
+    Timer *a = new Timer[num];
+    Timer *b = new Timer[num];
+
+    srand(1234);
+    for (int i = 0; i < num; i++)
+    {
+        // plenty of equal keys
+        a[i].when = b[i].when = rand() % 50;
+        a[i].id = b[i].id = i;
+    }
+
+    List<Timer*> list(timer_next);
+    SortedList<Timer*> sorted(timer_cmp, 0);
+
+    EXPECT_TRUE(sorted.empty());
+    EXPECT_EQ(0, sorted.first());
+    EXPECT_EQ(0, sorted.pop());
+
+    for (int i = 0; i < num; i++)
+    {
+        list.add_sorted(& a[i], timer_cmp, 0);
+        sorted.add(& b[i]);
+    }
+    EXPECT_EQ(num, sorted.size());
+
+    Timer **seen = new Timer*[num];
+    Timer **end = seen;
+    sorted.visit(collect, & end);
+    EXPECT_EQ(num, end - seen);
+
+    int i = 0;
+    for (Timer *t = list.head; t; t = t->next, i++)
+    {
+        EXPECT_EQ(t->id, seen[i]->id);
+        EXPECT_EQ(t->when, seen[i]->when);
+    }
+
+    // find gives the first of the equal items
+    Timer key = { 0, 25, -1 };
+    Timer *first = 0;
+    for (Timer *t = list.head; t; t = t->next)
+    {
+        if (t->when == 25)
+        {
+            first = t;
+            break;
+        }
+    }
+    ASSERT(first);
+    EXPECT_EQ(& b[first->id], sorted.find(& key));
+    key.when = 100;
+    EXPECT_EQ(0, sorted.find(& key));
+
+    delete[] seen;
+    delete[] b;
+    delete[] a;
+}
+
+TEST(SkipList, Remove)
+{
+    const int num = 200;
+    Timer items[num];
+    SortedList<Timer*> sorted(timer_cmp, 0);
+
+    for (int i = 0; i < num; i++)
+    {
+        items[i].when = i % 10;
+        items[i].id = i;
+        sorted.add(& items[i]);
+    }
+
+    // remove from the middle of runs of equal items
+    for (int i = 0; i < num; i += 3)
+    {
+        EXPECT_TRUE(sorted.remove(& items[i]));
+        EXPECT_FALSE(sorted.remove(& items[i]));
+    }
+    EXPECT_EQ(num - 67, sorted.size());
+
+    Timer *all[num];
+    Timer **end = all;
+    sorted.visit(collect, & end);
+    EXPECT_EQ(num - 67, end - all);
+    for (Timer **t = all; t < end; t++)
+    {
+        EXPECT_NE(0, (*t)->id % 3);
+        if (t != all)
+        {
+            EXPECT_LE(t[-1]->when, (*t)->when);
+        }
+    }
+
+    // drain as a priority queue
+    int last = -1;
+    int count = 0;
+    for (Timer *t = sorted.pop(); t; t = sorted.pop())
+    {
+        EXPECT_LE(last, t->when);
+        last = t->when;
+        count += 1;
+    }
+    EXPECT_EQ(num - 67, count);
+    EXPECT_TRUE(sorted.empty());
+    EXPECT_EQ(0, sorted.size());
+}
+
+    /*
+     *  Writers adding and removing while readers walk the list
+     */
+
+typedef struct {
+    pthread_t thread;
+    SortedList<Timer*> *sorted;
+    int seed;
+    int bad;
+    Timer items[50];
+}   SkipInfo;
+
+static void *skip_writer(void *arg)
+{
+    SkipInfo *si = (SkipInfo*) arg;
+    Timer *items = si->items;
+
+    // readers may still hold a removed item : don't change them
+    for (int i = 0; i < 50; i++)
+    {
+        items[i].when = (i * si->seed) % 23;
+        items[i].id = i;
+    }
+
+    for (int n = 0; n < 10; n++)
+    {
+        for (int i = 0; i < 50; i++)
+        {
+            si->sorted->add(& items[i]);
+        }
+        for (int i = 0; i < 50; i++)
+        {
+            if (!si->sorted->remove(& items[(i * 7) % 50]))
+            {
+                si->bad += 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int check_order(Timer *t, void *arg)
+{
+    int *last = (int*) arg;
+    if (t->when < *last)
+    {
+        return 1;
+    }
+    *last = t->when;
+    return 0;
+}
+
+static void *skip_reader(void *arg)
+{
+    SkipInfo *si = (SkipInfo*) arg;
+
+    for (int n = 0; n < 200; n++)
+    {
+        int last = -1;
+        if (si->sorted->visit(check_order, & last))
+        {
+            si->bad += 1;
+        }
+        Timer key = { 0, n % 23, -1 };
+        Timer *t = si->sorted->find(& key);
+        if (t && (t->when != key.when))
+        {
+            si->bad += 1;
+        }
+    }
+    return 0;
+}
+
+TEST(SkipList, Thread)
+{
+    Mutex *mutex = Mutex::create();
+    SortedList<Timer*> sorted(timer_cmp, mutex);
+
+    const int num = 4;
+    SkipInfo writers[num];
+    SkipInfo readers[num];
+
+    for (int i = 0; i < num; i++)
+    {
+        writers[i].sorted = & sorted;
+        writers[i].seed = i + 1;
+        writers[i].bad = 0;
+        pthread_create(& writers[i].thread, 0, skip_writer, & writers[i]);
+        readers[i].sorted = & sorted;
+        readers[i].bad = 0;
+        pthread_create(& readers[i].thread, 0, skip_reader, & readers[i]);
+    }
+
+    for (int i = 0; i < num; i++)
+    {
+        pthread_join(writers[i].thread, 0);
+        pthread_join(readers[i].thread, 0);
+        EXPECT_EQ(0, writers[i].bad);
+        EXPECT_EQ(0, readers[i].bad);
+    }
+
+    EXPECT_TRUE(sorted.empty());
+    delete mutex;
+}
+
+    /*
+     *  Removing doesn't wait for a reader : the nodes are freed later
+     */
+
+typedef struct {
+    bool entered;
+    bool leave;
+}   Pause;
+
+static void *pause_reader(void *arg)
+{
+    Pause *p = (Pause*) arg;
+    rcu_read_lock();
+    __atomic_store_n(& p->entered, true, __ATOMIC_RELEASE);
+    while (!__atomic_load_n(& p->leave, __ATOMIC_ACQUIRE))
+    {
+        usleep(100);
+    }
+    rcu_read_unlock();
+    return 0;
+}
+
+TEST(SkipList, Retire)
+{
+    const int num = 1000;
+    Timer *items = new Timer[num];
+    SortedList<Timer*> sorted(timer_cmp, 0);
+
+    Pause p = { false, false };
+    pthread_t thread;
+    pthread_create(& thread, 0, pause_reader, & p);
+    while (!__atomic_load_n(& p.entered, __ATOMIC_ACQUIRE))
+    {
+        usleep(100);
+    }
+
+    // the reader is in a read section throughout
+    for (int n = 0; n < 3; n++)
+    {
+        for (int i = 0; i < num; i++)
+        {
+            items[i].when = i;
+            sorted.add(& items[i]);
+        }
+        for (int i = 0; i < num; i += 2)
+        {
+            EXPECT_TRUE(sorted.remove(& items[i]));
+        }
+        for (int i = 1; i < num; i += 2)
+        {
+            EXPECT_EQ(& items[i], sorted.pop());
+        }
+        EXPECT_TRUE(sorted.empty());
+    }
+
+    __atomic_store_n(& p.leave, true, __ATOMIC_RELEASE);
+    pthread_join(thread, 0);
+
+    // once it has left, the batches waiting can be freed
+    for (int i = 0; i < num; i++)
+    {
+        sorted.add(& items[i]);
+    }
+    for (int i = 0; i < num; i++)
+    {
+        EXPECT_EQ(& items[i], sorted.pop());
+    }
+    delete[] items;
+}
+
+//  FIN
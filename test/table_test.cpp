@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+
+#include <cli_debug.h>
+#include "../src/cli.h"
+#include "../src/cli_table.h"
+#include "test_io.h"
+
+#if defined(CLI_NS)
+using namespace CLI_NS;
+#endif
+
+    /*
+     *  A constant command tree
+     */
+
+static void table_echo(CLI *cli, CliCommand *cmd)
+{
+    const char *s = cli_get_arg(cli, 0);
+    cli_print(cli, "%s %s '%s'%s", cmd->cmd, (const char*) cmd->ctx, s ? s : "", cli->eol);
+}
+
+static char led_ctx[] = "led";
+static char pa1_ctx[] = "pa1";
+static char pb2_ctx[] = "pb2";
+
+static constexpr CliCommand gpio_cmds[] = {
+    { .cmd = "PB2", .handler = table_echo, .help = "port b2", .ctx = pb2_ctx, },
+    { .cmd = "PA1", .handler = table_echo, .help = "port a1", .ctx = pa1_ctx, },
+};
+static constexpr auto gpio_sorted = cli_sort(gpio_cmds);
+static constexpr CliTable gpio_table = cli_table(gpio_sorted);
+
+static constexpr CliCommand top_cmds[] = {
+    { .cmd = "led", .handler = table_echo, .help = "a led", .ctx = led_ctx, },
+    { .cmd = "gpio", .handler = cli_nowt, .help = "gpio ports", .subtable = & gpio_table, .flags = CLI_SUBTABLE, },
+    { .cmd = "help", .handler = cli_help, },
+    { .cmd = "leds", .handler = table_echo, .ctx = led_ctx, },
+};
+static constexpr auto top_sorted = cli_sort(top_cmds);
+static constexpr CliTable top_table = cli_table(top_sorted);
+
+// sorted at compile time
+static_assert(top_table.count == 4, "count");
+static_assert(cli_strcmp(top_sorted.cmds[0].cmd, "gpio") == 0, "sorted");
+static_assert(cli_strcmp(top_sorted.cmds[1].cmd, "help") == 0, "sorted");
+static_assert(cli_strcmp(top_sorted.cmds[2].cmd, "led") == 0, "sorted");
+static_assert(cli_strcmp(top_sorted.cmds[3].cmd, "leds") == 0, "sorted");
+
+TEST(Table, Find)
+{
+    EXPECT_EQ(& top_sorted.cmds[0], table_find(& top_table, "gpio"));
+    EXPECT_EQ(& top_sorted.cmds[2], table_find(& top_table, "led"));
+    EXPECT_EQ(& top_sorted.cmds[3], table_find(& top_table, "leds"));
+    EXPECT_EQ(0, table_find(& top_table, "le"));
+    EXPECT_EQ(0, table_find(& top_table, "ledx"));
+    EXPECT_EQ(0, table_find(& top_table, ""));
+    EXPECT_EQ(0, table_find(0, "led"));
+
+    const CliCommand *first = 0;
+    EXPECT_EQ(2, table_match(& top_table, "le", 2, & first));
+    EXPECT_EQ(& top_sorted.cmds[2], first);
+    EXPECT_EQ(4, table_match(& top_table, "", 0, & first));
+    EXPECT_EQ(& top_sorted.cmds[0], first);
+    EXPECT_EQ(1, table_match(& top_table, "h", 1, & first));
+    EXPECT_EQ(& top_sorted.cmds[1], first);
+    EXPECT_EQ(0, table_match(& top_table, "x", 1, & first));
+    EXPECT_EQ(0, first);
+    EXPECT_EQ(0, table_match(0, "", 0, & first));
+}
+
+    /*
+     *  CLI using the table
+     */
+
+extern CLI cli;
+
+static void cli_send(CLI *cli, const char* s)
+{
+    cli_process_buffer(cli, s, strlen(s));
+}
+
+static void table_test(size_t index)
+{
+    cli_init(& cli, 64, 0);
+    cli_set_index(& cli, index);
+    cli_set_table(& cli, & top_table);
+    cli.echo = false;
+
+    io.reset();
+    cli_send(& cli, "led on\ngpio PA1 1\ngpio PB2\ngpio\nxx\n");
+    EXPECT_STREQ("led led 'on'\r\n> PA1 pa1 '1'\r\n> PB2 pb2 ''\r\n> > 'xx' not found\r\n> ", io.get());
+
+    io.reset();
+    cli_send(& cli, "help gpio PA1\nhelp xx\n");
+    EXPECT_STREQ("PA1 : port a1\r\n> 'xx' not found\r\n> ", io.get());
+
+    // autocomplete
+    cli.echo = true;
+    io.reset();
+    cli_send(& cli, "gp\t");
+    EXPECT_STREQ("gpio ", io.get());
+    io.reset();
+    cli_send(& cli, "PA\t");
+    EXPECT_STREQ("PA1 ", io.get());
+    cli_send(& cli, "\n");
+
+    io.reset();
+    cli_send(& cli, "le\t");
+    EXPECT_STREQ("le\r\nled\r\nleds\r\n> le", io.get());
+    cli_send(& cli, "\n");
+
+    // runtime commands overlay the table
+    CliCommand a0 = { .cmd = "led", .handler = table_echo, .ctx = (void*) "runtime", };
+    CliCommand a1 = { .cmd = "lamp", .handler = table_echo, .ctx = (void*) "lamp", };
+    cli_register(& cli, & a0);
+    cli_register(& cli, & a1);
+    cli.echo = false;
+
+    io.reset();
+    cli_send(& cli, "led\nlamp\nleds\n");
+    EXPECT_STREQ("led runtime ''\r\n> lamp lamp ''\r\n> leds led ''\r\n> ", io.get());
+
+    cli.echo = true;
+    io.reset();
+    cli_send(& cli, "l\t");
+    EXPECT_STREQ("l\r\nlamp\r\nled\r\nleds\r\n> l", io.get());
+    cli_send(& cli, "\n");
+
+    // the hidden table command is not listed
+    cli.echo = false;
+    io.reset();
+    cli_send(& cli, "help\n");
+    EXPECT_STREQ("lamp : \r\nled : \r\ngpio : gpio ports\r\nhelp : \r\nleds : \r\n> ", io.get());
+    cli.echo = true;
+
+    // a runtime command with constant subcommands
+    CliCommand a2 = { .cmd = "port", .handler = cli_nowt, .subtable = & gpio_table, .flags = CLI_SUBTABLE, };
+    cli_register(& cli, & a2);
+    cli.echo = false;
+
+    io.reset();
+    cli_send(& cli, "port PB2 x\n");
+    EXPECT_STREQ("PB2 pb2 'x'\r\n> ", io.get());
+
+    cli_close(& cli);
+}
+
+TEST(Table, Cli)
+{
+    table_test(0);
+}
+
+TEST(Table, CliIndex)
+{
+    table_test(16);
+}
+
+//  FIN
@@ -1,5 +1,6 @@
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <cli_debug.h>
 
@@ -59,4 +60,47 @@ char* IO::get()
 
 IO io;
 
+    /*
+     *
+     */
+
+int capture_fprintf(void *ctx, const char *fmt, va_list va)
+{
+    ASSERT(ctx);
+    std::string *s = (std::string*) ctx;
+
+    va_list again;
+    va_copy(again, va);
+    const int n = vsnprintf(0, 0, fmt, va);
+    if (n > 0)
+    {
+        const size_t used = s->size();
+        // vsnprintf() writes the '\0' past the end
+        s->resize(used + (size_t) n + 1);
+        vsnprintf(& (*s)[used], (size_t) n + 1, fmt, again);
+        s->resize(used + (size_t) n);
+    }
+    va_end(again);
+    return n;
+}
+
+    /*
+     *
+     */
+
+void session_init(CLI *cli, CliOutput *out, size_t size, CliCommand *commands, size_t num)
+{
+    memset(cli, 0, sizeof(CLI));
+    cli->output = out;
+    cli->prompt = "> ";
+    cli->eol = "\r\n";
+    cli_init(cli, size, 0);
+    cli->echo = false;
+    for (size_t i = 0; i < num; i++)
+    {
+        commands[i].next = 0;
+        cli_append(cli, & commands[i]);
+    }
+}
+
 //  FIN
@@ -2,6 +2,8 @@
      *
      */
 
+#include <string>
+
 #include "../src/cli.h"
 
 #include "../src/io.h"
@@ -24,4 +26,16 @@ public:
 
 extern IO io;
 
+    /*
+     *  CliOutput.fprintf that appends to the std::string at ctx
+     */
+
+int capture_fprintf(void *ctx, const char *fmt, va_list va);
+
+    /*
+     *  Init a CLI with no echo, a line of \a size, and the \a num commands
+     */
+
+void session_init(CLI *cli, CliOutput *out, size_t size, CliCommand *commands, size_t num);
+
 //  FIN